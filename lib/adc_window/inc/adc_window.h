@@ -0,0 +1,45 @@
+/** Background ADC sampling spread across a window, summarised when the window closes */
+
+#ifndef ADC_WINDOW_H
+#define ADC_WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <applibs/adc.h>
+#include <applibs/eventloop.h>
+
+#include "event_loop_timer.h"
+
+typedef struct {
+	double mean;
+	uint32_t median;
+	uint32_t min;
+	uint32_t max;
+	uint32_t count; // samples summarised
+	uint32_t errors; // polls that failed during the window
+} adc_window_stats_t;
+
+typedef struct {
+	int _fd;
+	ADC_ChannelId _channel;
+	EventLoopTimer* _timer;
+	uint32_t* _samples; // ring, the oldest samples are overwritten if a window runs long
+	size_t _capacity;
+	size_t _next;
+	size_t _count;
+	uint32_t _errors;
+} adc_window_t;
+
+/// Poll channel every interval on loop, keeping up to capacity samples per window.
+int AdcWindowInit(adc_window_t* window, EventLoop* loop, int adc_fd, ADC_ChannelId channel, const struct timespec* interval, size_t capacity);
+/// Poll every interval from now on, the samples already taken stay in the window.
+int AdcWindowSetInterval(adc_window_t* window, const struct timespec* interval);
+/// Summarise the samples taken since the last call and start a new window. Returns -1 if there were none.
+int AdcWindowClose(adc_window_t* window, adc_window_stats_t* stats_out);
+/// Report the polling timer in the handler stats under name.
+void AdcWindowSetName(adc_window_t* window, const char* name);
+void AdcWindowDestroy(adc_window_t* window);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_MODULE LogModule_Sensors
+#include "logging.h"
+#include "mem_budget.h"
+#include "adc_window.h"
+
+static void handle_poll(EventLoopTimer* timer, void* ctx) {
+	adc_window_t* window = (adc_window_t*)ctx;
+	ConsumeEventLoopTimerEvent(timer);
+
+	uint32_t value;
+	if (ADC_Poll(window->_fd, window->_channel, &value) < 0) {
+		window->_errors++;
+		return;
+	}
+	window->_samples[window->_next] = value;
+	window->_next = (window->_next + 1) % window->_capacity;
+	if (window->_count < window->_capacity)
+		window->_count++;
+}
+
+static int compare_u32(const void* a, const void* b) {
+	const uint32_t x = *(const uint32_t*)a;
+	const uint32_t y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+
+int AdcWindowInit(adc_window_t* window, EventLoop* loop, int adc_fd, ADC_ChannelId channel, const struct timespec* interval, size_t capacity) {
+	memset(window, 0, sizeof(*window));
+	window->_fd = adc_fd;
+	window->_channel = channel;
+	window->_capacity = capacity;
+
+	window->_samples = MemBudgetAlloc(MemTag_Deque, capacity * sizeof(uint32_t));
+	if (window->_samples == NULL)
+		return -1;
+	window->_timer = CreateEventLoopPeriodicTimer(loop, handle_poll, window, interval);
+	if (window->_timer == NULL) {
+		LOG_ERROR("Failed to create ADC window timer\n");
+		return -1;
+	}
+	return 0;
+}
+
+int AdcWindowSetInterval(adc_window_t* window, const struct timespec* interval) {
+	return SetEventLoopTimerPeriod(window->_timer, interval, interval);
+}
+
+int AdcWindowClose(adc_window_t* window, adc_window_stats_t* stats_out) {
+	memset(stats_out, 0, sizeof(*stats_out));
+	stats_out->errors = window->_errors;
+	const size_t count = window->_count;
+	window->_count = 0;
+	window->_next = 0;
+	window->_errors = 0;
+	if (count == 0)
+		return -1;
+
+	// order does not matter for the summary, so sort in place
+	uint32_t* samples = window->_samples;
+	qsort(samples, count, sizeof(uint32_t), compare_u32);
+	uint64_t sum = 0;
+	for (size_t i = 0; i < count; i++)
+		sum += samples[i];
+
+	stats_out->mean = (double)sum / (double)count;
+	stats_out->median = samples[count / 2];
+	stats_out->min = samples[0];
+	stats_out->max = samples[count - 1];
+	stats_out->count = (uint32_t)count;
+	return 0;
+}
+
+void AdcWindowSetName(adc_window_t* window, const char* name) {
+	SetEventLoopTimerName(window->_timer, name);
+}
+
+void AdcWindowDestroy(adc_window_t* window) {
+	if (window->_timer)
+		DisposeEventLoopTimer(window->_timer);
+	MemBudgetFree(window->_samples);
+	memset(window, 0, sizeof(*window));
+}
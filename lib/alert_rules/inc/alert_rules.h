@@ -0,0 +1,48 @@
+/** Threshold alert rules over sampled channels, with hysteresis so a value sitting on a limit does not flap */
+
+#ifndef ALERT_RULES_H
+#define ALERT_RULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ALERT_RULES_MAX 32 // rule states are kept as bits
+
+typedef enum {
+	AlertKind_Below = 0, // raised when the value drops under low
+	AlertKind_Above = 1, // raised when the value rises over high
+	AlertKind_Outside = 2 // raised when the value leaves [low, high]
+} alert_kind_t;
+
+typedef struct {
+	const char* name;
+	size_t channel; // index into the values handed to AlertRulesEvaluate
+	alert_kind_t kind;
+	double low;
+	double high;
+	double hysteresis; // how far back inside its limit the value has to come before the alert clears
+} alert_rule_t;
+
+typedef struct {
+	alert_rule_t _rules[ALERT_RULES_MAX]; // copied so their limits can be tuned, the names stay borrowed
+	size_t _count;
+	uint32_t _active;
+} alert_rules_t;
+
+/// The rules are copied, their names are borrowed and must outlive the set. Returns -1 with more than ALERT_RULES_MAX rules.
+int AlertRulesInit(alert_rules_t* set, const alert_rule_t* rules, size_t count);
+/// Check every rule whose channel is set in valid_mask. Returns the rules raised by this sample as bits,
+/// the rules that cleared go to cleared_out.
+uint32_t AlertRulesEvaluate(alert_rules_t* set, const double* values, uint32_t valid_mask, uint32_t* cleared_out);
+/// Rules currently raised, as bits.
+uint32_t AlertRulesActive(const alert_rules_t* set);
+/// Put back the raised rules after a restart so they are not raised a second time.
+void AlertRulesRestore(alert_rules_t* set, uint32_t active);
+/// Move the low or high limit of a rule, a raised alert then clears against the new limit.
+/// Returns -1 for an unknown rule.
+int AlertRulesSetLimit(alert_rules_t* set, size_t index, bool high, double limit);
+const alert_rule_t* AlertRulesGet(const alert_rules_t* set, size_t index);
+size_t AlertRulesCount(const alert_rules_t* set);
+
+#endif
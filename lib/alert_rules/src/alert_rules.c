@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include "alert_rules.h"
+
+int AlertRulesInit(alert_rules_t* set, const alert_rule_t* rules, size_t count) {
+	if (count > ALERT_RULES_MAX)
+		return -1;
+	memcpy(set->_rules, rules, count * sizeof(alert_rule_t));
+	set->_count = count;
+	set->_active = 0;
+	return 0;
+}
+
+static bool is_tripped(const alert_rule_t* rule, double value) {
+	switch (rule->kind) {
+	case AlertKind_Below:
+		return value < rule->low;
+	case AlertKind_Above:
+		return value > rule->high;
+	case AlertKind_Outside:
+		return value < rule->low || value > rule->high;
+	default:
+		return false;
+	}
+}
+
+// an active alert only clears once the value is hysteresis inside every limit it watches
+static bool is_clear(const alert_rule_t* rule, double value) {
+	switch (rule->kind) {
+	case AlertKind_Below:
+		return value >= rule->low + rule->hysteresis;
+	case AlertKind_Above:
+		return value <= rule->high - rule->hysteresis;
+	case AlertKind_Outside:
+		return value >= rule->low + rule->hysteresis && value <= rule->high - rule->hysteresis;
+	default:
+		return true;
+	}
+}
+
+uint32_t AlertRulesEvaluate(alert_rules_t* set, const double* values, uint32_t valid_mask, uint32_t* cleared_out) {
+	uint32_t raised = 0, cleared = 0;
+	for (size_t i = 0; i < set->_count; i++) {
+		const alert_rule_t* rule = &set->_rules[i];
+		// a channel that failed to read says nothing, the rule keeps its state
+		if (rule->channel >= 32 || (valid_mask & (1U << rule->channel)) == 0)
+			continue;
+
+		const double value = values[rule->channel];
+		const uint32_t bit = 1U << i;
+		if ((set->_active & bit) == 0 && is_tripped(rule, value))
+			raised |= bit;
+		else if ((set->_active & bit) != 0 && is_clear(rule, value))
+			cleared |= bit;
+	}
+	set->_active = (set->_active | raised) & ~cleared;
+	if (cleared_out != NULL)
+		*cleared_out = cleared;
+	return raised;
+}
+
+uint32_t AlertRulesActive(const alert_rules_t* set) { return set->_active; }
+
+void AlertRulesRestore(alert_rules_t* set, uint32_t active) {
+	const uint32_t known = set->_count < 32 ? (1U << set->_count) - 1 : UINT32_MAX;
+	set->_active = active & known;
+}
+
+int AlertRulesSetLimit(alert_rules_t* set, size_t index, bool high, double limit) {
+	if (index >= set->_count)
+		return -1;
+	if (high)
+		set->_rules[index].high = limit;
+	else
+		set->_rules[index].low = limit;
+	return 0;
+}
+
+const alert_rule_t* AlertRulesGet(const alert_rules_t* set, size_t index) { return index < set->_count ? &set->_rules[index] : NULL; }
+
+size_t AlertRulesCount(const alert_rules_t* set) { return set->_count; }
@@ -0,0 +1,24 @@
+/** Capped exponential backoff with jitter for retrying network operations */
+
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t _base_ms;
+	uint32_t _max_ms;
+	uint32_t _attempts; // failures since the last BackoffReset
+	uint32_t _rng;
+} backoff_t;
+
+/// The n-th delay is drawn from [cap / 2, cap] with cap = min(base_ms * 2^n, max_ms), so devices
+/// that failed together spread out while each still waits at least half the nominal delay.
+void BackoffInit(backoff_t* backoff, uint32_t base_ms, uint32_t max_ms, uint32_t seed);
+/// Delay before the next attempt, counting one more failure.
+uint32_t BackoffNextMs(backoff_t* backoff);
+/// Call on success, the next failure starts over at base_ms.
+void BackoffReset(backoff_t* backoff);
+uint32_t BackoffAttempts(const backoff_t* backoff);
+
+#endif
@@ -0,0 +1,34 @@
+#include "backoff.h"
+
+// xorshift32, plenty for spreading retries and never zero once seeded with a non zero value
+static uint32_t next_random(backoff_t* backoff) {
+	uint32_t x = backoff->_rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	backoff->_rng = x;
+	return x;
+}
+
+void BackoffInit(backoff_t* backoff, uint32_t base_ms, uint32_t max_ms, uint32_t seed) {
+	backoff->_base_ms = base_ms > 0 ? base_ms : 1;
+	backoff->_max_ms = max_ms > backoff->_base_ms ? max_ms : backoff->_base_ms;
+	backoff->_attempts = 0;
+	backoff->_rng = seed != 0 ? seed : 0x9e3779b9U;
+}
+
+uint32_t BackoffNextMs(backoff_t* backoff) {
+	uint32_t cap = backoff->_base_ms;
+	for (uint32_t i = 0; i < backoff->_attempts && cap < backoff->_max_ms; i++)
+		cap = cap > backoff->_max_ms / 2 ? backoff->_max_ms : cap * 2;
+	if (cap > backoff->_max_ms)
+		cap = backoff->_max_ms;
+	backoff->_attempts++;
+
+	const uint32_t half = cap / 2;
+	return half + next_random(backoff) % (cap - half + 1);
+}
+
+void BackoffReset(backoff_t* backoff) { backoff->_attempts = 0; }
+
+uint32_t BackoffAttempts(const backoff_t* backoff) { return backoff->_attempts; }
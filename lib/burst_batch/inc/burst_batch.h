@@ -0,0 +1,36 @@
+/** Packs burst sample rows into one JSON payload in a buffer of its own, sized for many rows per message */
+
+#ifndef BURST_BATCH_H
+#define BURST_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	char* _buf;
+	size_t _capacity;
+	size_t _len;
+	const char* _name;
+	uint32_t _max_rows;
+	uint32_t _rows;
+	int64_t _time; // of the first row
+} burst_batch_t;
+
+/// Payloads read {"meta":{"time":first row,"name":name},"burst":{"rows":[[seconds after meta.time,columns...],...]}},
+/// at most capacity bytes with the terminating NUL and max_rows rows. name must outlive the batch.
+/// Returns -1 on allocation failure.
+int BurstBatchInit(burst_batch_t* batch, const char* name, size_t capacity, uint32_t max_rows);
+/// Add a row of count columns, null for a column whose bit in valid_mask is clear. The first row sets the batch time.
+/// Returns -1 when the row does not fit, the batch is left as it was: finish it and append again.
+int BurstBatchAppend(burst_batch_t* batch, int64_t time, const double* columns, uint32_t valid_mask, size_t count);
+bool BurstBatchEmpty(const burst_batch_t* batch);
+uint32_t BurstBatchRows(const burst_batch_t* batch);
+/// Wall clock second of the first row.
+int64_t BurstBatchTime(const burst_batch_t* batch);
+/// Close the payload and start an empty batch. Returns the NUL terminated text, valid until the next append,
+/// or NULL if there were no rows.
+const char* BurstBatchFinish(burst_batch_t* batch, size_t* len);
+void BurstBatchDestroy(burst_batch_t* batch);
+
+#endif
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "burst_batch.h"
+#include "mem_budget.h"
+
+#define BURST_BATCH_HEAD "{\"meta\":{\"time\":%lld,\"name\":\"%s\"},\"burst\":{\"rows\":["
+#define BURST_BATCH_TAIL "]}}"
+
+int BurstBatchInit(burst_batch_t* batch, const char* name, size_t capacity, uint32_t max_rows) {
+	memset(batch, 0, sizeof(*batch));
+	batch->_buf = MemBudgetAlloc(MemTag_Payload, capacity);
+	if (batch->_buf == NULL)
+		return -1;
+	batch->_capacity = capacity;
+	batch->_name = name;
+	batch->_max_rows = max_rows;
+	return 0;
+}
+
+int BurstBatchAppend(burst_batch_t* batch, int64_t time, const double* columns, uint32_t valid_mask, size_t count) {
+	if (batch->_rows >= batch->_max_rows || batch->_capacity < sizeof(BURST_BATCH_TAIL))
+		return -1;
+	// rows stop short of the room the tail needs, so finishing never fails
+	const size_t room = batch->_capacity - sizeof(BURST_BATCH_TAIL) + 1;
+	const int64_t batch_time = batch->_rows == 0 ? time : batch->_time;
+	size_t len = batch->_len;
+	int res = batch->_rows == 0
+		? snprintf(batch->_buf, room, BURST_BATCH_HEAD "[%lld", (long long)time, batch->_name, 0LL)
+		: snprintf(batch->_buf + len, room - len, ",[%lld", (long long)(time - batch_time));
+	for (size_t i = 0; i < count && res >= 0 && len + (size_t)res < room; i++) {
+		len += (size_t)res;
+		res = valid_mask & (1U << i)
+			? snprintf(batch->_buf + len, room - len, ",%.2f", columns[i])
+			: snprintf(batch->_buf + len, room - len, ",null");
+	}
+	if (res >= 0 && len + (size_t)res < room) {
+		len += (size_t)res;
+		res = snprintf(batch->_buf + len, room - len, "]");
+	}
+	// a row that did not fit is left past _len, where the next row or the tail overwrites it
+	if (res < 0 || len + (size_t)res >= room)
+		return -1;
+
+	batch->_len = len + (size_t)res;
+	batch->_time = batch_time;
+	batch->_rows++;
+	return 0;
+}
+
+bool BurstBatchEmpty(const burst_batch_t* batch) { return batch->_rows == 0; }
+
+uint32_t BurstBatchRows(const burst_batch_t* batch) { return batch->_rows; }
+
+int64_t BurstBatchTime(const burst_batch_t* batch) { return batch->_time; }
+
+const char* BurstBatchFinish(burst_batch_t* batch, size_t* len) {
+	if (batch->_rows == 0)
+		return NULL;
+	memcpy(batch->_buf + batch->_len, BURST_BATCH_TAIL, sizeof(BURST_BATCH_TAIL));
+	*len = batch->_len + sizeof(BURST_BATCH_TAIL) - 1;
+	batch->_len = 0;
+	batch->_rows = 0;
+	return batch->_buf;
+}
+
+void BurstBatchDestroy(burst_batch_t* batch) {
+	MemBudgetFree(batch->_buf);
+	memset(batch, 0, sizeof(*batch));
+}
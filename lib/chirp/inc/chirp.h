@@ -8,8 +8,14 @@
 #include <errno.h>
 #include <stdbool.h>
 
+#include "duty_cycle.h"
+
 #define CHIRP_ADDR_1 (0x24 & 0xFEU)
 #define CHIRP_ADDR_2 (0x26 & 0xFEU)
+/// time between ChirpTrigger and a valid ChirpRead
+#define CHIRP_CONVERSION_MS 2000
+/// time between ChirpWake and the sensor answering again
+#define CHIRP_WAKE_MS 20
 
 typedef struct {
 	uint16_t soil_moisture;
@@ -19,11 +25,23 @@ typedef struct {
 	int _fd;
 	I2C_DeviceAddress _addr;
 	bool _is_active;
+	bool _asleep;
+	duty_cycle_t _duty;
 } chirp_t;
 
 
 int ChirpInit(chirp_t* chirp, int i2cfd, I2C_DeviceAddress addr);
-int ChirpMeasure(chirp_t* chirp, chirp_data_t* data_out);
+/// Warm start for a sensor left asleep by ChirpSleep, nothing is sent until ChirpWake.
+void ChirpResume(chirp_t* chirp, int i2cfd, I2C_DeviceAddress addr);
+/// Start a conversion, several sensors can convert at the same time.
+int ChirpTrigger(chirp_t* chirp);
+/// Read the result CHIRP_CONVERSION_MS after ChirpTrigger.
+int ChirpRead(chirp_t* chirp, chirp_data_t* data_out);
+/// Put the sensor to sleep until the next ChirpWake.
+int ChirpSleep(chirp_t* chirp);
+/// Wake a sleeping sensor, give it CHIRP_WAKE_MS before ChirpTrigger.
+int ChirpWake(chirp_t* chirp);
 bool ChirpIsOk(chirp_t* chirp);
+const duty_cycle_t* ChirpDutyCycle(chirp_t* chirp);
 
 #endif
\ No newline at end of file
@@ -1,7 +1,9 @@
-#include <time.h>
 #include <string.h>
 
+#define LOG_MODULE LogModule_Sensors
+#include "logging.h"
 #include "chirp.h"
+#include "i2c_metrics.h"
 
 typedef union {
 	uint16_t u16bit;
@@ -12,46 +14,56 @@ int ChirpInit(chirp_t* chirp, int i2c_fd, I2C_DeviceAddress addr) {
 	chirp->_fd = i2c_fd;
 	chirp->_addr = addr;
 	chirp->_is_active = false;
+	chirp->_asleep = false;
 	// verify sensor is attatched
 	axis1bit16_t out;
 	const uint8_t reg = 0;
-	int ret = I2CMaster_WriteThenRead(chirp->_fd, addr, &reg, 1, out.u8bit, 2);
+	int ret = I2CMetricsWriteThenRead(chirp->_fd, addr, &reg, 1, out.u8bit, 2);
 	if (ret < 0 || out.u16bit != 1) {
-		Log_Debug("Soil sensor with addr %i not found! Error: %s\n", chirp->_addr, strerror(errno));
+		LOG_WARN("Soil sensor with addr %i not found! Error: %s\n", chirp->_addr, strerror(errno));
 		return -1;
 	}
 
 	chirp->_is_active = true;
+	DutyCycleAwake(&chirp->_duty);
 	return 0;
 }
 
-int ChirpMeasure(chirp_t* chirp, chirp_data_t* data_out) {
-	// read data!
+void ChirpResume(chirp_t* chirp, int i2c_fd, I2C_DeviceAddress addr) {
+	chirp->_fd = i2c_fd;
+	chirp->_addr = addr;
+	chirp->_is_active = true;
+	chirp->_asleep = true;
+	DutyCycleAsleep(&chirp->_duty);
+}
+
+int ChirpTrigger(chirp_t* chirp) {
 	if (!chirp->_is_active)
 		return -1;
 
 	axis1bit16_t out;
-	uint8_t reg = 0;
+	const uint8_t reg = 0;
 	// trigger sensor
-	int ret = I2CMaster_WriteThenRead(chirp->_fd, chirp->_addr, &reg, 1, out.u8bit, 2);
+	int ret = I2CMetricsWriteThenRead(chirp->_fd, chirp->_addr, &reg, 1, out.u8bit, 2);
 	if (ret < 0 || out.u16bit != 1) {
-		Log_Debug("Soil sensor with addr %i not found!\n", chirp->_addr);
+		LOG_WARN("Soil sensor with addr %i not found!\n", chirp->_addr);
 		chirp->_is_active = false;
 		return -1;
 	}
+	return 0;
+}
 
-	// wait for cycle to complete
-	const struct timespec sleep_time = { .tv_sec = 2, .tv_nsec = 0 };
-	struct timespec sleep_time_rem = {};
-	int err = clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, &sleep_time_rem);
-	if (err == EINTR)
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time_rem, NULL);
+int ChirpRead(chirp_t* chirp, chirp_data_t* data_out) {
+	// read data!
+	if (!chirp->_is_active)
+		return -1;
 
 	// read value
-	reg = 1;
-	ret = I2CMaster_WriteThenRead(chirp->_fd, chirp->_addr, &reg, 1, out.u8bit, 2);
+	axis1bit16_t out;
+	const uint8_t reg = 1;
+	int ret = I2CMetricsWriteThenRead(chirp->_fd, chirp->_addr, &reg, 1, out.u8bit, 2);
 	if (ret < 0 || out.u16bit > 10000U) {
-		Log_Debug("Soil sensor with addr %i did not read correctly!\n", chirp->_addr);
+		LOG_WARN("Soil sensor with addr %i did not read correctly!\n", chirp->_addr);
 		chirp->_is_active = false;
 		return -1;
 	}
@@ -59,4 +71,39 @@ int ChirpMeasure(chirp_t* chirp, chirp_data_t* data_out) {
 	return 0;
 }
 
-bool ChirpIsOk(chirp_t* chirp) { return chirp->_is_active; }
\ No newline at end of file
+int ChirpSleep(chirp_t* chirp) {
+	if (!chirp->_is_active)
+		return -1;
+	if (chirp->_asleep)
+		return 0;
+
+	const uint8_t reg = 8;
+	if (I2CMetricsWrite(chirp->_fd, chirp->_addr, &reg, 1) < 0) {
+		LOG_WARN("Soil sensor with addr %i did not go to sleep!\n", chirp->_addr);
+		chirp->_is_active = false;
+		return -1;
+	}
+	chirp->_asleep = true;
+	DutyCycleAsleep(&chirp->_duty);
+	return 0;
+}
+
+int ChirpWake(chirp_t* chirp) {
+	if (!chirp->_is_active)
+		return -1;
+	if (!chirp->_asleep)
+		return 0;
+
+	// the sensor wakes on its address and drops that first request, so the result is ignored. It goes
+	// around the metrics, the expected NACK on every sample would otherwise read as a failing bus
+	axis1bit16_t out;
+	const uint8_t reg = 9;
+	I2CMaster_WriteThenRead(chirp->_fd, chirp->_addr, &reg, 1, out.u8bit, 2);
+	chirp->_asleep = false;
+	DutyCycleAwake(&chirp->_duty);
+	return 0;
+}
+
+bool ChirpIsOk(chirp_t* chirp) { return chirp->_is_active; }
+
+const duty_cycle_t* ChirpDutyCycle(chirp_t* chirp) { return &chirp->_duty; }
\ No newline at end of file
@@ -12,6 +12,11 @@
 #include <errno.h>
 #include <stdbool.h>
 
+#include "duty_cycle.h"
+
+/// upper bound on a low power LPS22HH one shot conversion
+#define CLIMATE_ONE_SHOT_MS 10
+
 typedef struct {
 	double avg_tempurature;
 	double avg_pressure;
@@ -29,10 +34,22 @@ typedef struct {
 	stmdev_ctx_t _press_ctx;
 	stmdev_ctx_t _ag_ctx;
 	bool _is_active;
+	lps22hh_odr_t _odr; // kept across ClimateSensorInit, LPS22HH_POWER_DOWN means one shot
+	duty_cycle_t _duty;
 } climate_t;
 
 int ClimateSensorInit(climate_t* climate, int i2cfd);
+/// Warm start for a sensor that stayed powered and configured, skipping the resets. Returns -1 if it did not answer.
+int ClimateSensorResume(climate_t* climate, int i2cfd);
+/// LPS22HH_POWER_DOWN or LPS22HH_ONE_SHOOT convert once per ClimateSensorTrigger and power down in between,
+/// any other rate runs continuously and ClimateSensorMeasure averages the FIFO.
+/// Takes effect at once on an active sensor, otherwise at the next ClimateSensorInit.
+int ClimateSensorSetDataRate(climate_t* climate, lps22hh_odr_t odr);
+/// Start a one shot conversion, ready CLIMATE_ONE_SHOT_MS later. Does nothing at continuous rates.
+int ClimateSensorTrigger(climate_t* climate);
 int ClimateSensorMeasure(climate_t* climate, climate_data_t* data_out);
 bool ClimateSensorIsOk(climate_t* climate);
+/// Covers the LPS22HH, the LSM6DSO only passes the bus through and keeps its own sensors off.
+const duty_cycle_t* ClimateSensorDutyCycle(climate_t* climate);
 
 #endif
\ No newline at end of file
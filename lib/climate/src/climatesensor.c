@@ -1,4 +1,11 @@
+#define LOG_MODULE LogModule_Sensors
+#include "logging.h"
 #include "climatesensor.h"
+#include "i2c_metrics.h"
+#include "trace.h"
+
+// the reset bits clear within a few polls, a wedged sensor must not hang the caller
+#define CLIMATE_RESET_MAX_POLLS 100
 
 typedef struct {
 	int i2cfd;
@@ -29,10 +36,9 @@ static int32_t platform_write(void* handle, uint8_t Reg, uint8_t* Bufp,
 	buf_cpy[0] = Reg;
 	for (uint16_t i = 0; i < len; i++)
 		buf_cpy[i + 1] = Bufp[i];
-	int ret = I2CMaster_Write(ctx->i2cfd, ctx->addr, buf_cpy, (size_t)(len + 1));
-	if (ret == -1) {
-		Log_Debug("I2C write fail\n");
-	}
+	int ret = I2CMetricsWrite(ctx->i2cfd, ctx->addr, buf_cpy, (size_t)(len + 1));
+	if (ret == -1)
+		TraceRecord(TraceId_I2CWriteFail, ctx->addr, Reg, (uint32_t)errno);
 	return ret != -1 ? 0 : -1;
 }
 
@@ -50,22 +56,38 @@ static int32_t platform_read(void* handle, uint8_t Reg, uint8_t* Bufp,
 	uint16_t len)
 {
 	handle_ctx_t* ctx = (handle_ctx_t* )handle;
-	int ret = I2CMaster_WriteThenRead(ctx->i2cfd, ctx->addr, &Reg, 1, Bufp, len);
+	int ret = I2CMetricsWriteThenRead(ctx->i2cfd, ctx->addr, &Reg, 1, Bufp, len);
 	if (ret == -1)
-		Log_Debug("Climate I2C read fail %s\n", strerror(errno));
+		TraceRecord(TraceId_I2CReadFail, ctx->addr, Reg, (uint32_t)errno);
 	return ret != -1 ? 0 : -1;
 }
 
-int ClimateSensorInit(climate_t* climate, int i2cfd) {
+static bool is_one_shot(lps22hh_odr_t odr) { return odr == LPS22HH_POWER_DOWN || odr == LPS22HH_ONE_SHOOT; }
+
+static int climate_apply_rate(climate_t* climate) {
+	if (is_one_shot(climate->_odr)) {
+		if (lps22hh_fifo_mode_set(&climate->_press_ctx, LPS22HH_BYPASS_MODE) != 0
+			|| lps22hh_data_rate_set(&climate->_press_ctx, LPS22HH_POWER_DOWN) != 0)
+			return -1;
+		DutyCycleAsleep(&climate->_duty);
+		return 0;
+	}
+	if (lps22hh_fifo_mode_set(&climate->_press_ctx, LPS22HH_BYPASS_MODE) != 0
+		|| lps22hh_fifo_mode_set(&climate->_press_ctx, LPS22HH_FIFO_MODE) != 0
+		|| lps22hh_data_rate_set(&climate->_press_ctx, climate->_odr) != 0)
+		return -1;
+	DutyCycleAwake(&climate->_duty);
+	return 0;
+}
+
+static void climate_bind(climate_t* climate, int i2cfd) {
 	// initialize global contexts
 	climate->_gyro_handle_ctx.i2cfd = i2cfd;
 	climate->_gyro_handle_ctx.addr = (LSM6DSO_I2C_ADD_L & 0xFEU) >> 1;
 	climate->_press_handle_ctx.i2cfd = i2cfd;
 	climate->_press_handle_ctx.addr = (LPS22HH_I2C_ADD_L & 0xFEU) >> 1;
 	climate->_is_active = false;
-	
-	
-	uint8_t whoamI, rst;
+
 	/* Initialize lsm6dso driver interface */
 	climate->_ag_ctx.write_reg = platform_write;
 	climate->_ag_ctx.read_reg = platform_read;
@@ -75,6 +97,12 @@ int ClimateSensorInit(climate_t* climate, int i2cfd) {
 	climate->_press_ctx.read_reg = platform_read;
 	climate->_press_ctx.write_reg = platform_write;
 	climate->_press_ctx.handle = &climate->_press_handle_ctx;
+}
+
+int ClimateSensorInit(climate_t* climate, int i2cfd) {
+	climate_bind(climate, i2cfd);
+	uint8_t whoamI, rst;
+	int polls;
 
 	/*
 	 * Check Connected devices.
@@ -82,14 +110,18 @@ int ClimateSensorInit(climate_t* climate, int i2cfd) {
 	 /* Check lsm6dso ID. */
 	lsm6dso_device_id_get(&climate->_ag_ctx, &whoamI);
 	if (whoamI != LSM6DSO_ID) {
-		Log_Debug("Could not find accel\n");
+		LOG_ERROR("Could not find accel\n");
 		return -1;
 	}
 
 	/* Restore default configuration. */
 	lsm6dso_reset_set(&climate->_ag_ctx, PROPERTY_ENABLE);
+	polls = 0;
 	do {
-		lsm6dso_reset_get(&climate->_ag_ctx, &rst);
+		if (lsm6dso_reset_get(&climate->_ag_ctx, &rst) != 0 || ++polls > CLIMATE_RESET_MAX_POLLS) {
+			LOG_ERROR("Accel did not come out of reset\n");
+			return -1;
+		}
 	} while (rst);
 
 	/* Disable I3C interface.*/
@@ -111,22 +143,28 @@ int ClimateSensorInit(climate_t* climate, int i2cfd) {
     /* Check if LPS22HH connected to Sensor Hub. */
 	lps22hh_device_id_get(&climate->_press_ctx, &whoamI);
 	if (whoamI != LPS22HH_ID) {
-		Log_Debug("Could not find pressure sensor\n");
+		LOG_ERROR("Could not find pressure sensor\n");
 		return -1;
 	}
 
 	// Restore the default configuration
 	lps22hh_reset_set(&climate->_press_ctx, PROPERTY_ENABLE);
+	polls = 0;
 	do {
-		lps22hh_reset_get(&climate->_press_ctx, &rst);
+		if (lps22hh_reset_get(&climate->_press_ctx, &rst) != 0 || ++polls > CLIMATE_RESET_MAX_POLLS) {
+			LOG_ERROR("Pressure sensor did not come out of reset\n");
+			return -1;
+		}
 	} while (rst);
 
 	/* Configure LPS22HH. */
 	lps22hh_i3c_interface_set(&climate->_press_ctx, LPS22HH_I3C_DISABLE);
 	// lps22hh_block_data_update_set(&press_ctx, PROPERTY_ENABLE);
-	lps22hh_fifo_mode_set(&climate->_press_ctx, LPS22HH_FIFO_MODE);
-	lps22hh_data_rate_set(&climate->_press_ctx, LPS22HH_1_Hz_LOW_NOISE);
 	lps22hh_lp_bandwidth_set(&climate->_press_ctx, LPS22HH_LPF_ODR_DIV_20);
+	if (climate_apply_rate(climate) != 0) {
+		LOG_ERROR("Could not set pressure sensor data rate\n");
+		return -1;
+	}
 	
 	climate->_is_active = true;
 	return 0;
@@ -142,16 +180,67 @@ typedef union {
 	uint8_t u8bit[2];
 } axis1bit16_t;
 
+int ClimateSensorSetDataRate(climate_t* climate, lps22hh_odr_t odr) {
+	climate->_odr = odr;
+	if (!climate->_is_active)
+		return 0;
+	if (climate_apply_rate(climate) != 0) {
+		climate->_is_active = false;
+		return -1;
+	}
+	return 0;
+}
+
+int ClimateSensorTrigger(climate_t* climate) {
+	if (!climate->_is_active)
+		return -1;
+	if (!is_one_shot(climate->_odr))
+		return 0;
+	if (lps22hh_data_rate_set(&climate->_press_ctx, LPS22HH_ONE_SHOOT) != 0) {
+		climate->_is_active = false;
+		return -1;
+	}
+	DutyCycleAddActive(&climate->_duty, CLIMATE_ONE_SHOT_MS * 1000);
+	return 0;
+}
+
+static int climate_measure_one_shot(climate_t* climate, climate_data_t* data_out) {
+	uint8_t ready = 0;
+	if (lps22hh_press_flag_data_ready_get(&climate->_press_ctx, &ready) != 0) {
+		climate->_is_active = false;
+		return -1;
+	}
+	if (!ready) {
+		LOG_WARN("Pressure one shot was not triggered\n");
+		return -1;
+	}
+
+	axis1bit32_t data_raw_pressure;
+	axis1bit16_t data_raw_temperature;
+	memset(&data_raw_pressure, 0, sizeof(data_raw_pressure));
+	if (lps22hh_pressure_raw_get(&climate->_press_ctx, data_raw_pressure.u8bit) != 0
+		|| lps22hh_temperature_raw_get(&climate->_press_ctx, data_raw_temperature.u8bit) != 0) {
+		climate->_is_active = false;
+		return -1;
+	}
+	data_out->avg_pressure = lps22hh_from_lsb_to_hpa(data_raw_pressure.i32bit);
+	data_out->avg_tempurature = lps22hh_from_lsb_to_celsius(data_raw_temperature.i16bit);
+	data_out->num_samples = 1;
+	return 0;
+}
+
 int ClimateSensorMeasure(climate_t* climate, climate_data_t* data_out) {
 	if (!climate->_is_active)
 		return -1;
+	if (is_one_shot(climate->_odr))
+		return climate_measure_one_shot(climate, data_out);
 
 	/* Read number of samples in FIFO. */
 	uint8_t fifo_level = 0;
 
 	int32_t ret = lps22hh_fifo_data_level_get(&climate->_press_ctx, &fifo_level);
 	if (ret == -1 || fifo_level == 0) {
-		Log_Debug("Failed to get fifo data level\n");
+		LOG_WARN("Failed to get fifo data level\n");
 		climate->_is_active = false;
 		return -1;
 	}
@@ -186,4 +275,24 @@ int ClimateSensorMeasure(climate_t* climate, climate_data_t* data_out) {
 	return 0;
 }
 
-bool ClimateSensorIsOk(climate_t* climate) { return climate->_is_active; }
\ No newline at end of file
+int ClimateSensorResume(climate_t* climate, int i2cfd) {
+	climate_bind(climate, i2cfd);
+	uint8_t whoamI;
+
+	// the hub still passes the bus through, so both devices answer without a reset
+	lsm6dso_device_id_get(&climate->_ag_ctx, &whoamI);
+	if (whoamI != LSM6DSO_ID)
+		return -1;
+	lps22hh_device_id_get(&climate->_press_ctx, &whoamI);
+	if (whoamI != LPS22HH_ID)
+		return -1;
+	if (climate_apply_rate(climate) != 0)
+		return -1;
+
+	climate->_is_active = true;
+	return 0;
+}
+
+bool ClimateSensorIsOk(climate_t* climate) { return climate->_is_active; }
+
+const duty_cycle_t* ClimateSensorDutyCycle(climate_t* climate) { return &climate->_duty; }
\ No newline at end of file
@@ -0,0 +1,59 @@
+/** Stackless coroutines (protothreads) resumed by an EventLoopTimer or EventLoopEvent */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <applibs/eventloop.h>
+
+#include "event_loop_event.h"
+#include "event_loop_timer.h"
+
+typedef enum {
+	CO_WAITING = 0,
+	CO_DONE = 1
+} co_status_t;
+
+/// Resume point of one coroutine function. Locals do not survive a yield, keep state next to this.
+typedef struct {
+	int _line;
+} coroutine_t;
+
+struct co_task;
+typedef co_status_t (*CoTaskStep)(struct co_task* task, void* ctx);
+
+/// A top level coroutine and the timer and event that resume it.
+typedef struct co_task {
+	EventLoopTimer* _timer;
+	EventLoopEvent_t* _wake_event;
+	CoTaskStep _step;
+	void* _ctx;
+	bool _running;
+} co_task_t;
+
+// The body of a coroutine is one switch statement, so yields cannot sit inside another
+// switch and two yields cannot share a source line.
+#define CO_BEGIN(co) switch ((co)->_line) { case 0:
+#define CO_END(co) } (co)->_line = 0; return CO_DONE
+#define CO_EXIT(co) do { (co)->_line = 0; return CO_DONE; } while (0)
+/// Give the loop back and resume after delay.
+#define CO_SLEEP(co, task, delay) do { (co)->_line = __LINE__; CoTaskSleep(task, delay); return CO_WAITING; case __LINE__:; } while (0)
+/// Give the loop back until CoTaskWake is called.
+#define CO_WAIT(co) do { (co)->_line = __LINE__; return CO_WAITING; case __LINE__:; } while (0)
+/// Run a child coroutine call, resuming it until it returns CO_DONE.
+#define CO_AWAIT(co, call) do { (co)->_line = __LINE__; case __LINE__: if ((call) == CO_WAITING) return CO_WAITING; } while (0)
+
+int CoTaskInit(co_task_t* task, EventLoop* loop, CoTaskStep step, void* ctx);
+/// Runs the first step right away. Returns -1 with errno EBUSY if the task has not finished yet.
+int CoTaskStart(co_task_t* task);
+bool CoTaskRunning(const co_task_t* task);
+int CoTaskSleep(co_task_t* task, const struct timespec* delay);
+/// Resume a task parked in CO_WAIT. Safe from any thread.
+int CoTaskWake(co_task_t* task);
+/// Report the task's steps in the handler stats under name.
+void CoTaskSetName(co_task_t* task, const char* name);
+void CoTaskDestroy(co_task_t* task);
+
+#endif
@@ -0,0 +1,70 @@
+#include <errno.h>
+#include <string.h>
+
+#include "coroutine.h"
+
+static void run_step(co_task_t* task) {
+	if (task->_running && task->_step(task, task->_ctx) == CO_DONE)
+		task->_running = false;
+}
+
+static void handle_resume_timer(EventLoopTimer* timer, void* ctx) {
+	ConsumeEventLoopTimerEvent(timer);
+	run_step((co_task_t*)ctx);
+}
+
+static void handle_wake_event(EventLoopEvent_t* event, void* ctx) {
+	co_task_t* task = (co_task_t*)ctx;
+	eventfd_t out = 0;
+	ConsumeEventLoopEvent(event, &out);
+	// a wake ends any sleep the task was parked in
+	DisarmEventLoopTimer(task->_timer);
+	run_step(task);
+}
+
+int CoTaskInit(co_task_t* task, EventLoop* loop, CoTaskStep step, void* ctx) {
+	memset(task, 0, sizeof(*task));
+	task->_step = step;
+	task->_ctx = ctx;
+
+	task->_timer = CreateEventLoopDisarmedTimer(loop, handle_resume_timer, task);
+	if (task->_timer == NULL)
+		return -1;
+	task->_wake_event = CreateEventLoopEvent(loop, handle_wake_event, task);
+	if (task->_wake_event == NULL)
+		return -1;
+	return 0;
+}
+
+int CoTaskStart(co_task_t* task) {
+	if (task->_running) {
+		errno = EBUSY;
+		return -1;
+	}
+	task->_running = true;
+	run_step(task);
+	return 0;
+}
+
+bool CoTaskRunning(const co_task_t* task) { return task->_running; }
+
+int CoTaskSleep(co_task_t* task, const struct timespec* delay) {
+	return SetEventLoopTimerOneShot(task->_timer, delay);
+}
+
+int CoTaskWake(co_task_t* task) {
+	return PostEventLoopEvent(task->_wake_event);
+}
+
+void CoTaskSetName(co_task_t* task, const char* name) {
+	SetEventLoopTimerName(task->_timer, name);
+	SetEventLoopEventName(task->_wake_event, name);
+}
+
+void CoTaskDestroy(co_task_t* task) {
+	if (task->_timer)
+		DisposeEventLoopTimer(task->_timer);
+	if (task->_wake_event)
+		DisposeEventLoopEvent(task->_wake_event);
+	memset(task, 0, sizeof(*task));
+}
@@ -0,0 +1,44 @@
+/** Report by exception: holds back samples whose channels all stay within a deadband of the last reported sample */
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEADBAND_MAX_CHANNELS 8
+
+typedef struct {
+	double _tolerance[DEADBAND_MAX_CHANNELS];
+	double _relative[DEADBAND_MAX_CHANNELS]; // fraction of the reported value, 0 for a fixed band
+	size_t _count;
+	uint32_t _heartbeat_every;
+	double _reported[DEADBAND_MAX_CHANNELS]; // the reference, only moved when a sample is reported
+	uint32_t _reported_valid;
+	uint32_t _since_report;
+	uint32_t _suppressed;
+} deadband_t;
+
+/// tolerance[i] is how far channel i may move from its last reported value unnoticed, a negative
+/// tolerance reports every sample. heartbeat_every reports at least every that many samples, 0 never forces one.
+/// Returns -1 with more than DEADBAND_MAX_CHANNELS channels.
+int DeadbandInit(deadband_t* deadband, const double* tolerance, size_t count, uint32_t heartbeat_every);
+/// Widen the band of channel to fraction of its reported value wherever that is more than its tolerance, for
+/// channels spanning decades such as light. Returns -1 for an unknown channel.
+int DeadbandSetRelative(deadband_t* deadband, size_t channel, double fraction);
+/// Whether this sample has to be reported: forced, due for a heartbeat, a channel came or went in valid_mask,
+/// or a valid channel left its deadband. A sample held back is counted, one to report leaves the reference
+/// alone until DeadbandCommit.
+bool DeadbandCheck(deadband_t* deadband, const double* values, uint32_t valid_mask, bool force);
+/// Make a sample DeadbandCheck passed the new reference, once it is on its way. A sample that could not be
+/// handed on is not committed, so the next one is compared against what was really reported.
+void DeadbandCommit(deadband_t* deadband, const double* values, uint32_t valid_mask);
+/// Change how many samples may pass before one is forced, keeping the reference. 0 never forces one.
+void DeadbandSetHeartbeat(deadband_t* deadband, uint32_t heartbeat_every);
+/// Put back the reference kept across a restart.
+void DeadbandRestore(deadband_t* deadband, const double* reported, uint32_t valid_mask, uint32_t since_report, uint32_t suppressed);
+/// Samples held back so far.
+uint32_t DeadbandSuppressed(const deadband_t* deadband);
+
+#endif
@@ -0,0 +1,69 @@
+#include <math.h>
+#include <string.h>
+
+#include "deadband.h"
+
+int DeadbandInit(deadband_t* deadband, const double* tolerance, size_t count, uint32_t heartbeat_every) {
+	memset(deadband, 0, sizeof(*deadband));
+	if (count > DEADBAND_MAX_CHANNELS)
+		return -1;
+	memcpy(deadband->_tolerance, tolerance, count * sizeof(double));
+	deadband->_count = count;
+	deadband->_heartbeat_every = heartbeat_every;
+	return 0;
+}
+
+int DeadbandSetRelative(deadband_t* deadband, size_t channel, double fraction) {
+	if (channel >= deadband->_count)
+		return -1;
+	deadband->_relative[channel] = fraction;
+	return 0;
+}
+
+static bool is_outside(const deadband_t* deadband, const double* values, uint32_t valid_mask) {
+	const uint32_t known = (1U << deadband->_count) - 1;
+	// a channel that started or stopped reading is news on its own
+	if ((valid_mask & known) != deadband->_reported_valid)
+		return true;
+	for (size_t i = 0; i < deadband->_count; i++) {
+		if ((valid_mask & (1U << i)) == 0)
+			continue;
+		if (deadband->_tolerance[i] < 0)
+			return true;
+		const double relative = deadband->_relative[i] * fabs(deadband->_reported[i]);
+		if (fabs(values[i] - deadband->_reported[i]) > fmax(deadband->_tolerance[i], relative))
+			return true;
+	}
+	return false;
+}
+
+bool DeadbandCheck(deadband_t* deadband, const double* values, uint32_t valid_mask, bool force) {
+	const bool heartbeat = deadband->_heartbeat_every > 0 && deadband->_since_report + 1 >= deadband->_heartbeat_every;
+	if (!force && !heartbeat && !is_outside(deadband, values, valid_mask)) {
+		deadband->_since_report++;
+		deadband->_suppressed++;
+		return false;
+	}
+	return true;
+}
+
+void DeadbandCommit(deadband_t* deadband, const double* values, uint32_t valid_mask) {
+	const uint32_t known = (1U << deadband->_count) - 1;
+	for (size_t i = 0; i < deadband->_count; i++) {
+		if (valid_mask & (1U << i))
+			deadband->_reported[i] = values[i];
+	}
+	deadband->_reported_valid = valid_mask & known;
+	deadband->_since_report = 0;
+}
+
+void DeadbandSetHeartbeat(deadband_t* deadband, uint32_t heartbeat_every) { deadband->_heartbeat_every = heartbeat_every; }
+
+void DeadbandRestore(deadband_t* deadband, const double* reported, uint32_t valid_mask, uint32_t since_report, uint32_t suppressed) {
+	memcpy(deadband->_reported, reported, deadband->_count * sizeof(double));
+	deadband->_reported_valid = valid_mask & ((1U << deadband->_count) - 1);
+	deadband->_since_report = since_report;
+	deadband->_suppressed = suppressed;
+}
+
+uint32_t DeadbandSuppressed(const deadband_t* deadband) { return deadband->_suppressed; }
@@ -0,0 +1,28 @@
+/** When the system may power down between samples, and the persist then power down step itself */
+
+#ifndef DEEP_SLEEP_H
+#define DEEP_SLEEP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbox_store.h"
+
+typedef struct {
+	uint32_t wake_lead_s; // boot and sensor warm start before the sample deadline
+	uint32_t min_residency_s; // shorter power downs cost more than they save
+	uint32_t upload_grace_s; // how long a due upload keeps the system up waiting for the network
+} deep_sleep_config_t;
+
+/// Wall clock second to wake at when the system may power down at now, or 0 to stay up. Samples fall on multiples
+/// of sample_interval_s. A next_upload of 0 counts as due now, one overdue past the grace is skipped to
+/// now + upload_interval_s so the queue is persisted instead, either way next_upload is updated.
+int64_t DeepSleepWakeAt(const deep_sleep_config_t* config, int64_t now, uint32_t sample_interval_s, int64_t* next_upload, uint32_t upload_interval_s);
+/// Persist count payloads with resume and ask for a power down until wake. On failure the store is cleared, the
+/// payloads are still queued and a later boot must not replay them. Returns -1 on failure with errno set.
+int DeepSleepPowerDown(int store_fd, const outbox_resume_t* resume, const char* const* payloads, const int64_t* queued_at, size_t count, int64_t wake);
+/// A boot at now resumed from a save at saved_at in time for the next sample, within margin_s of it.
+bool DeepSleepWarmStart(int64_t now, int64_t saved_at, uint32_t sample_interval_s, uint32_t margin_s);
+
+#endif
@@ -0,0 +1,45 @@
+#include <errno.h>
+#include <string.h>
+
+#include <applibs/powermanagement.h>
+
+#include "logging.h"
+#include "deep_sleep.h"
+
+int64_t DeepSleepWakeAt(const deep_sleep_config_t* config, int64_t now, uint32_t sample_interval_s, int64_t* next_upload, uint32_t upload_interval_s) {
+	// never uploaded counts as due, a cold boot has to stay up long enough to join the network at least once
+	if (*next_upload == 0)
+		*next_upload = now;
+	if (now >= *next_upload) {
+		if (now < *next_upload + config->upload_grace_s)
+			return 0;
+		// no network in time, the queue is persisted and this round is skipped
+		*next_upload = now + upload_interval_s;
+	}
+
+	const int64_t next_sample = (now / sample_interval_s + 1) * sample_interval_s;
+	const int64_t wake = next_sample - config->wake_lead_s;
+	return wake - now < (int64_t)config->min_residency_s ? 0 : wake;
+}
+
+int DeepSleepPowerDown(int store_fd, const outbox_resume_t* resume, const char* const* payloads, const int64_t* queued_at, size_t count, int64_t wake) {
+	if (OutboxStoreSave(store_fd, resume, payloads, queued_at, count) != 0) {
+		const int err = errno;
+		LOG_WARN("Could not persist the outbox, staying up: %s\n", strerror(err));
+		OutboxStoreClear(store_fd);
+		errno = err;
+		return -1;
+	}
+	if (PowerManagement_ForceSystemPowerDown((unsigned int)(wake - resume->saved_at)) != 0) {
+		const int err = errno;
+		LOG_WARN("System power down refused: %s\n", strerror(err));
+		OutboxStoreClear(store_fd);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+bool DeepSleepWarmStart(int64_t now, int64_t saved_at, uint32_t sample_interval_s, uint32_t margin_s) {
+	return now >= saved_at && now - saved_at <= (int64_t)sample_interval_s + margin_s;
+}
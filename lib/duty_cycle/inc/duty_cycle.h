@@ -0,0 +1,25 @@
+/** Estimated fraction of time a peripheral spends powered up, for sizing batteries and panels */
+
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/// A zeroed duty_cycle_t is valid and starts accounting at its first call.
+/// Updated by the thread that owns the device, read from any thread.
+typedef struct {
+	atomic_uint_fast64_t _since_us; // start of accounting, 0 before the first call
+	atomic_uint_fast64_t _awake_at_us; // start of the current awake interval, 0 while asleep
+	atomic_uint_fast64_t _active_us; // completed awake time
+} duty_cycle_t;
+
+/// The device is powered up until DutyCycleAsleep. Calling it while awake does nothing.
+void DutyCycleAwake(duty_cycle_t* duty);
+void DutyCycleAsleep(duty_cycle_t* duty);
+/// Account a self timed conversion, for devices that power down on their own.
+void DutyCycleAddActive(duty_cycle_t* duty, uint32_t active_us);
+/// Awake time per million, including the current awake interval.
+uint32_t DutyCyclePpm(const duty_cycle_t* duty);
+
+#endif
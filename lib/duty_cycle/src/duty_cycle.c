@@ -0,0 +1,51 @@
+#include <time.h>
+
+#include "duty_cycle.h"
+
+static uint64_t now_us(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	// never 0, which marks an unset timestamp
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000 + 1;
+}
+
+static uint64_t start(duty_cycle_t* duty) {
+	const uint64_t now = now_us();
+	if (atomic_load_explicit(&duty->_since_us, memory_order_relaxed) == 0)
+		atomic_store_explicit(&duty->_since_us, now, memory_order_relaxed);
+	return now;
+}
+
+void DutyCycleAwake(duty_cycle_t* duty) {
+	const uint64_t now = start(duty);
+	if (atomic_load_explicit(&duty->_awake_at_us, memory_order_relaxed) == 0)
+		atomic_store_explicit(&duty->_awake_at_us, now, memory_order_relaxed);
+}
+
+void DutyCycleAsleep(duty_cycle_t* duty) {
+	const uint64_t now = start(duty);
+	const uint64_t awake_at = atomic_exchange_explicit(&duty->_awake_at_us, 0, memory_order_relaxed);
+	if (awake_at != 0)
+		atomic_fetch_add_explicit(&duty->_active_us, now - awake_at, memory_order_relaxed);
+}
+
+void DutyCycleAddActive(duty_cycle_t* duty, uint32_t active_us) {
+	start(duty);
+	atomic_fetch_add_explicit(&duty->_active_us, active_us, memory_order_relaxed);
+}
+
+uint32_t DutyCyclePpm(const duty_cycle_t* duty) {
+	const uint64_t since = atomic_load_explicit(&duty->_since_us, memory_order_relaxed);
+	if (since == 0)
+		return 0;
+	// the fields are read one by one, a reader racing a transition is off by one interval at most
+	const uint64_t now = now_us();
+	const uint64_t awake_at = atomic_load_explicit(&duty->_awake_at_us, memory_order_relaxed);
+	uint64_t active = atomic_load_explicit(&duty->_active_us, memory_order_relaxed);
+	if (awake_at != 0 && now > awake_at)
+		active += now - awake_at;
+	const uint64_t elapsed = now - since;
+	if (elapsed == 0 || active >= elapsed)
+		return 1000000;
+	return (uint32_t)(active * 1000000 / elapsed);
+}
@@ -1,8 +1,12 @@
+#ifndef EVENT_LOOP_EVENT_H
+#define EVENT_LOOP_EVENT_H
+
 #include <sys/eventfd.h>
 
 #include <applibs/eventloop.h>
 
 struct EventLoopEvent;
+struct handler_stats;
 typedef struct EventLoopEvent EventLoopEvent_t;
 
 typedef void (*EventLoopEventHandler)(EventLoopEvent_t* event, void* ctx);
@@ -13,9 +17,14 @@ struct EventLoopEvent {
     void* _ctx;
     int _fd;
     EventRegistration* _registration;
+    struct handler_stats* _stats;
 };
 
 EventLoopEvent_t* CreateEventLoopEvent(EventLoop* loop, EventLoopEventHandler handler, void* ctx);
 int PostEventLoopEvent(EventLoopEvent_t* event);
 int ConsumeEventLoopEvent(EventLoopEvent_t* event, eventfd_t* out);
-void DisposeEventLoopEvent(EventLoopEvent_t* event);
\ No newline at end of file
+/// Collect run times for the handler under name, which must outlive the process.
+int SetEventLoopEventName(EventLoopEvent_t* event, const char* name);
+void DisposeEventLoopEvent(EventLoopEvent_t* event);
+
+#endif
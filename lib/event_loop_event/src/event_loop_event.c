@@ -3,35 +3,42 @@
 #include <unistd.h>
 #include <stdlib.h>
 
-#include <applibs/log.h>
-
+#define LOG_MODULE LogModule_Loop
+#include "logging.h"
+#include "mem_budget.h"
+#include "handler_stats.h"
 #include "event_loop_event.h"
 
 // This satisfies the EventLoopIoCallback signature.
 static void TimerCallback(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
 {
 	EventLoopEvent_t* event = (EventLoopEvent_t*)context;
+	// the handler may dispose the event, the stats entry outlives it
+	handler_stats_t* stats = event->_stats;
+	const uint64_t start_us = HandlerStatsNowUs();
 	event->_handler(event, event->_ctx);
+	HandlerStatsRecord(stats, HandlerStatsNowUs() - start_us, HANDLER_STATS_NO_LATENESS);
 }
 
 EventLoopEvent_t* CreateEventLoopEvent(EventLoop* loop, EventLoopEventHandler handler, void* ctx) {
-	EventLoopEvent_t* event = malloc(sizeof(EventLoopEvent_t));
+	EventLoopEvent_t* event = MemBudgetAlloc(MemTag_EventLoop, sizeof(EventLoopEvent_t));
 	if (event == NULL)
 		return NULL;
 	
 	event->_event_loop = loop;
 	event->_handler = handler;
 	event->_ctx = ctx;
+	event->_stats = NULL;
 
 	event->_fd = eventfd(0, 0);
 	if (event->_fd == -1) {
-		Log_Debug("Failed to create eventfd with error %i\n", errno);
+		LOG_ERROR("Failed to create eventfd with error %i\n", errno);
 		goto failed;
 	}
 	
 	event->_registration = EventLoop_RegisterIo(event->_event_loop, event->_fd, EventLoop_Input, TimerCallback, event);
 	if (event->_registration == NULL) {
-		Log_Debug("Failed to create event registration for event with error %i", errno);
+		LOG_ERROR("Failed to create event registration for event with error %i", errno);
 		goto failed;
 	}
 
@@ -50,10 +57,19 @@ int ConsumeEventLoopEvent(EventLoopEvent_t* event, eventfd_t* out) {
 	return eventfd_read(event->_fd, out);
 }
 
+int SetEventLoopEventName(EventLoopEvent_t* event, const char* name) {
+	event->_stats = HandlerStatsGet(name);
+	if (event->_stats == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
 void DisposeEventLoopEvent(EventLoopEvent_t* event) {
 	if (event->_registration) 
 		EventLoop_UnregisterIo(event->_event_loop, event->_registration);
 	if (event->_fd != -1) 
 		close(event->_fd);
-	free(event);
+	MemBudgetFree(event);
 }
\ No newline at end of file
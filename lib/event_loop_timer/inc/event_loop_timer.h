@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <time.h>
 #include <unistd.h>
 #include <applibs/eventloop.h>
@@ -14,6 +15,15 @@
    /// </summary>
 typedef struct EventLoopTimer EventLoopTimer;
 
+/// <summary>
+/// Wakeup counters for all timers sharing an event loop.
+/// </summary>
+typedef struct {
+    uint32_t wakeups; // times the loop woke for timers
+    uint32_t expirations; // timer handlers run
+    uint32_t coalesced; // wakeups that ran more than one handler
+} event_loop_timer_stats_t;
+
 /// <summary>
 /// Applications implement a function with this signature to be
 /// notified when a timer expires.
@@ -98,4 +108,33 @@ int SetEventLoopTimerOneShot(EventLoopTimer* timer, const struct timespec* delay
 /// information.</returns>
 /// <seealso cref="SetEventLoopTimerOneShot" />
 /// <seealso cref="SetEventLoopTimerPeriod" />
-int DisarmEventLoopTimer(EventLoopTimer* timer);
\ No newline at end of file
+int DisarmEventLoopTimer(EventLoopTimer* timer);
+
+/// <summary>
+/// Allow the timer to expire up to slack after its deadline. Deadlines whose windows
+/// overlap are rounded to a common tick so they are served by a single wakeup. Periodic
+/// timers keep their nominal period, the slack never accumulates.
+/// </summary>
+/// <param name="timer">Timer previously allocated with <see cref="CreateEventLoopPeriodicTimer" />
+/// or <see cref="CreateEventLoopDisarmedTimer" />.</param>
+/// <param name="slack">Tolerated lateness, or NULL for none.</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int SetEventLoopTimerSlack(EventLoopTimer* timer, const struct timespec* slack);
+
+/// <summary>
+/// Name the timer's handler so its run time and lateness are collected in the handler
+/// stats registry. Timers sharing a name share one set of histograms.
+/// </summary>
+/// <param name="timer">Timer previously allocated with <see cref="CreateEventLoopPeriodicTimer" />
+/// or <see cref="CreateEventLoopDisarmedTimer" />.</param>
+/// <param name="name">Handler name, must outlive the process (normally a string literal).</param>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int SetEventLoopTimerName(EventLoopTimer* timer, const char* name);
+
+/// <summary>
+/// Read the wakeup counters of the timers on an event loop. Safe to call from any thread.
+/// </summary>
+/// <param name="eventLoop">Event loop owning the timers.</param>
+/// <param name="stats">Receives the counters.</param>
+/// <returns>0 on success, -1 if the loop has no timers, in which case errno is ENOENT.</returns>
+int GetEventLoopTimerStats(EventLoop* eventLoop, event_loop_timer_stats_t* stats);
@@ -3,49 +3,448 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/timerfd.h>
 
-#include <applibs/log.h>
 #include <applibs/eventloop.h>
 
+#define LOG_MODULE LogModule_Loop
+#include "logging.h"
+#include "mem_budget.h"
+#include "handler_stats.h"
 #include "event_loop_timer.h"
 
-static int SetTimerPeriod(int timerFd, const struct timespec* initial,
-    const struct timespec* repeat);
+// All timers on an EventLoop share one hierarchical timer wheel backed by a single timerfd,
+// which is always armed for the next tick at which the wheel has work to do.
+#define WHEEL_TICK_NS 1000000LL // 1 ms
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4 // 64^4 ticks, roughly 4.6 hours, longer timers get re-cascaded
+#define WHEEL_NO_TICK UINT64_MAX
 
-static int SetTimerPeriod(int timerFd, const struct timespec* initial,
-    const struct timespec* repeat)
-{
-    static const struct timespec nullTimeSpec = { .tv_sec = 0, .tv_nsec = 0 };
-    struct itimerspec newValue = { .it_value = initial ? *initial : nullTimeSpec,
-                                  .it_interval = repeat ? *repeat : nullTimeSpec };
+typedef struct timer_link {
+    struct timer_link* prev;
+    struct timer_link* next;
+} timer_link_t;
 
-    if (timerfd_settime(timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
-        Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
-        return -1;
-    }
+typedef enum {
+    TimerState_Idle = 0,
+    TimerState_Queued = 1, // in a wheel slot
+    TimerState_Expired = 2 // waiting in the dispatch list for its handler to run
+} timer_state_t;
 
-    return 0;
-}
+typedef struct timer_wheel timer_wheel_t;
 
 struct EventLoopTimer {
-    EventLoop* eventLoop;
+    timer_link_t link; // must stay first, links are cast back to their timer
+    timer_wheel_t* wheel;
     EventLoopTimerHandler handler;
     void* ctx;
+    uint64_t expires; // nominal tick, periodic timers advance from this so slack never adds drift
+    uint64_t period; // ticks, 0 for one-shot
+    uint64_t slack; // ticks the expiry may be deferred to share a wakeup
+    uint32_t pending; // expirations not yet consumed
+    timer_state_t state;
+    uint8_t level;
+    uint8_t slot;
+    handler_stats_t* stats; // NULL until the timer is named
+};
+
+struct timer_wheel {
+    timer_wheel_t* next_wheel;
+    EventLoop* eventLoop;
     int fd;
     EventRegistration* registration;
+    unsigned int refs;
+    bool dispatching;
+    uint64_t now; // next tick to be processed
+    uint64_t armedTick;
+    uint64_t occupied[WHEEL_LEVELS];
+    timer_link_t slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    // read from other threads by GetEventLoopTimerStats
+    atomic_uint wakeups;
+    atomic_uint expirations;
+    atomic_uint coalesced;
 };
 
+// one wheel per EventLoop, the list is only touched when timers are created or disposed
+static pthread_mutex_t wheelsLock = PTHREAD_MUTEX_INITIALIZER;
+static timer_wheel_t* wheels = NULL;
+
+static void ListInit(timer_link_t* head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+static bool ListEmpty(const timer_link_t* head)
+{
+    return head->next == head;
+}
+
+static void ListPushBack(timer_link_t* head, timer_link_t* node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void ListUnlink(timer_link_t* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    ListInit(node);
+}
+
+// move every node of src onto the end of dst, leaving src empty
+static void ListSplice(timer_link_t* dst, timer_link_t* src)
+{
+    if (ListEmpty(src)) {
+        return;
+    }
+    src->next->prev = dst->prev;
+    dst->prev->next = src->next;
+    src->prev->next = dst;
+    dst->prev = src->prev;
+    ListInit(src);
+}
+
+static uint64_t Rotr64(uint64_t x, unsigned int r)
+{
+    return r ? (x >> r) | (x << (64 - r)) : x;
+}
+
+static uint64_t CurrentTick(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec) / WHEEL_TICK_NS;
+}
+
+static uint64_t TimespecToTicks(const struct timespec* ts)
+{
+    const uint64_t ns = (uint64_t)ts->tv_sec * 1000000000ULL + (uint64_t)ts->tv_nsec;
+    return (ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+}
+
+static uint64_t DeadlineTick(const struct timespec* delay)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec
+        + (uint64_t)delay->tv_sec * 1000000000ULL + (uint64_t)delay->tv_nsec;
+    return (ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+}
+
+// Pick the tick inside [expires, expires + slack] with the most trailing zero bits. Timers whose
+// windows overlap round to the same aligned tick and so share one wakeup.
+static uint64_t ApplySlack(uint64_t expires, uint64_t slack)
+{
+    if (slack == 0) {
+        return expires;
+    }
+    const uint64_t limit = expires + slack;
+    const unsigned int bit = 63 - (unsigned int)__builtin_clzll(expires ^ limit);
+    return limit & ~(((uint64_t)1 << bit) - 1);
+}
+
+static void WheelEnqueue(timer_wheel_t* wheel, EventLoopTimer* timer)
+{
+    const uint64_t maxDelta = ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    const uint64_t fire = ApplySlack(timer->expires, timer->slack);
+    uint64_t place = fire < wheel->now ? wheel->now : fire;
+    if (place - wheel->now > maxDelta) {
+        place = wheel->now + maxDelta;
+    }
+
+    const uint64_t delta = place - wheel->now;
+    unsigned int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    const unsigned int slot = (unsigned int)(place >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    ListPushBack(&wheel->slots[level][slot], &timer->link);
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)slot;
+    timer->state = TimerState_Queued;
+}
+
+static void WheelDequeue(timer_wheel_t* wheel, EventLoopTimer* timer)
+{
+    if (timer->state == TimerState_Idle) {
+        return;
+    }
+
+    ListUnlink(&timer->link);
+    if (timer->state == TimerState_Queued && ListEmpty(&wheel->slots[timer->level][timer->slot])) {
+        wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+    }
+    timer->state = TimerState_Idle;
+}
+
+// The earliest tick at which a level 0 slot expires or a higher level slot must be cascaded.
+static uint64_t WheelNextEventTick(const timer_wheel_t* wheel)
+{
+    uint64_t best = WHEEL_NO_TICK;
+    for (unsigned int level = 0; level < WHEEL_LEVELS; level++) {
+        if (wheel->occupied[level] == 0) {
+            continue;
+        }
+        const unsigned int shift = WHEEL_BITS * level;
+        const uint64_t unit = (uint64_t)1 << shift;
+        const uint64_t block = (wheel->now + unit - 1) >> shift;
+        const unsigned int dist =
+            (unsigned int)__builtin_ctzll(Rotr64(wheel->occupied[level], (unsigned int)(block & (WHEEL_SLOTS - 1))));
+        const uint64_t tick = (block + dist) << shift;
+        if (tick < best) {
+            best = tick;
+        }
+    }
+    return best;
+}
+
+static void WheelCascade(timer_wheel_t* wheel, unsigned int level, unsigned int slot)
+{
+    timer_link_t moving;
+    ListInit(&moving);
+    ListSplice(&moving, &wheel->slots[level][slot]);
+    wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+    while (!ListEmpty(&moving)) {
+        EventLoopTimer* timer = (EventLoopTimer*)moving.next;
+        ListUnlink(&timer->link);
+        WheelEnqueue(wheel, timer);
+    }
+}
+
+// process wheel->now: cascade every level whose block starts here, then collect level 0
+static void WheelProcessTick(timer_wheel_t* wheel, timer_link_t* expired)
+{
+    const uint64_t tick = wheel->now;
+    for (unsigned int level = WHEEL_LEVELS - 1; level > 0; level--) {
+        const unsigned int shift = WHEEL_BITS * level;
+        if ((tick & (((uint64_t)1 << shift) - 1)) == 0) {
+            WheelCascade(wheel, level, (unsigned int)(tick >> shift) & (WHEEL_SLOTS - 1));
+        }
+    }
+
+    const unsigned int slot = (unsigned int)tick & (WHEEL_SLOTS - 1);
+    for (timer_link_t* node = wheel->slots[0][slot].next; node != &wheel->slots[0][slot]; node = node->next) {
+        ((EventLoopTimer*)node)->state = TimerState_Expired;
+    }
+    ListSplice(expired, &wheel->slots[0][slot]);
+    wheel->occupied[0] &= ~((uint64_t)1 << slot);
+}
+
+// Jump over idle ticks so timers added after a long quiet period are placed relative to the
+// real time. Only safe when nothing in the wheel is due in between.
+static void WheelCatchUp(timer_wheel_t* wheel)
+{
+    const uint64_t current = CurrentTick();
+    if (current > wheel->now && WheelNextEventTick(wheel) > current) {
+        wheel->now = current;
+    }
+}
+
+static int WheelRearm(timer_wheel_t* wheel)
+{
+    const uint64_t next = WheelNextEventTick(wheel);
+    if (next == wheel->armedTick) {
+        return 0;
+    }
+
+    struct itimerspec newValue = { .it_value = { 0, 0 }, .it_interval = { 0, 0 } };
+    if (next != WHEEL_NO_TICK) {
+        const uint64_t ns = next * WHEEL_TICK_NS;
+        newValue.it_value.tv_sec = (time_t)(ns / 1000000000ULL);
+        newValue.it_value.tv_nsec = (long)(ns % 1000000000ULL);
+    }
+
+    if (timerfd_settime(wheel->fd, TFD_TIMER_ABSTIME, &newValue, /* old_value */ NULL) == -1) {
+        LOG_ERROR("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        return -1;
+    }
+    wheel->armedTick = next;
+    return 0;
+}
+
+static void DestroyWheel(timer_wheel_t* wheel)
+{
+    if (wheel->registration != NULL) {
+        EventLoop_UnregisterIo(wheel->eventLoop, wheel->registration);
+    }
+    if (wheel->fd != -1) {
+        close(wheel->fd);
+    }
+    MemBudgetFree(wheel);
+}
+
 // This satisfies the EventLoopIoCallback signature.
-static void TimerCallback(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+static void WheelCallback(EventLoop* el, int fd, EventLoop_IoEvents events, void* context)
+{
+    timer_wheel_t* wheel = (timer_wheel_t*)context;
+
+    uint64_t timerData = 0;
+    if (read(wheel->fd, &timerData, sizeof(timerData)) == -1 && errno != EAGAIN) {
+        LOG_ERROR("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    }
+    wheel->armedTick = WHEEL_NO_TICK;
+
+    timer_link_t expired;
+    ListInit(&expired);
+    const uint64_t target = CurrentTick();
+    for (uint64_t next = WheelNextEventTick(wheel); next <= target; next = WheelNextEventTick(wheel)) {
+        wheel->now = next;
+        WheelProcessTick(wheel, &expired);
+        wheel->now++;
+    }
+    if (wheel->now <= target) {
+        wheel->now = target + 1;
+    }
+
+    unsigned int fired = 0;
+    for (timer_link_t* node = expired.next; node != &expired; node = node->next) {
+        fired++;
+    }
+    atomic_fetch_add_explicit(&wheel->wakeups, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&wheel->expirations, fired, memory_order_relaxed);
+    if (fired > 1) {
+        atomic_fetch_add_explicit(&wheel->coalesced, 1, memory_order_relaxed);
+    }
+
+    // handlers may re-arm or dispose any timer, including ones still waiting in the expired list
+    wheel->dispatching = true;
+    while (!ListEmpty(&expired)) {
+        EventLoopTimer* timer = (EventLoopTimer*)expired.next;
+        ListUnlink(&timer->link);
+        timer->state = TimerState_Idle;
+        timer->pending++;
+        const uint64_t dueUs = timer->expires * (WHEEL_TICK_NS / 1000);
+
+        if (timer->period != 0) {
+            timer->expires += timer->period;
+            if (timer->expires < wheel->now) {
+                const uint64_t missed = (wheel->now - timer->expires + timer->period - 1) / timer->period;
+                timer->pending += (uint32_t)missed;
+                timer->expires += missed * timer->period;
+            }
+            WheelEnqueue(wheel, timer);
+        }
+
+        // the handler may dispose its timer, so only the long lived stats are touched afterwards
+        handler_stats_t* stats = timer->stats;
+        const uint64_t startUs = HandlerStatsNowUs();
+        timer->handler(timer, timer->ctx);
+        HandlerStatsRecord(stats, HandlerStatsNowUs() - startUs, startUs > dueUs ? startUs - dueUs : 0);
+    }
+    wheel->dispatching = false;
+
+    if (wheel->refs == 0) {
+        DestroyWheel(wheel);
+        return;
+    }
+    WheelRearm(wheel);
+}
+
+static timer_wheel_t* AcquireWheel(EventLoop* eventLoop)
+{
+    pthread_mutex_lock(&wheelsLock);
+
+    timer_wheel_t* wheel = wheels;
+    while (wheel != NULL && wheel->eventLoop != eventLoop) {
+        wheel = wheel->next_wheel;
+    }
+    if (wheel != NULL) {
+        wheel->refs++;
+        goto done;
+    }
+
+    wheel = MemBudgetAlloc(MemTag_EventLoop, sizeof(timer_wheel_t));
+    if (wheel == NULL) {
+        goto done;
+    }
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->eventLoop = eventLoop;
+    wheel->fd = -1;
+    wheel->armedTick = WHEEL_NO_TICK;
+    wheel->now = CurrentTick();
+    for (unsigned int level = 0; level < WHEEL_LEVELS; level++) {
+        for (unsigned int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            ListInit(&wheel->slots[level][slot]);
+        }
+    }
+
+    wheel->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (wheel->fd == -1) {
+        LOG_ERROR("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        goto failed;
+    }
+
+    wheel->registration =
+        EventLoop_RegisterIo(eventLoop, wheel->fd, EventLoop_Input, WheelCallback, wheel);
+    if (wheel->registration == NULL) {
+        LOG_ERROR("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        goto failed;
+    }
+
+    wheel->refs = 1;
+    wheel->next_wheel = wheels;
+    wheels = wheel;
+    goto done;
+
+failed:
+    DestroyWheel(wheel);
+    wheel = NULL;
+done:
+    pthread_mutex_unlock(&wheelsLock);
+    return wheel;
+}
+
+static void ReleaseWheel(timer_wheel_t* wheel)
+{
+    pthread_mutex_lock(&wheelsLock);
+    if (--wheel->refs == 0) {
+        timer_wheel_t** link = &wheels;
+        while (*link != wheel) {
+            link = &(*link)->next_wheel;
+        }
+        *link = wheel->next_wheel;
+        // a handler disposing the last timer leaves the wheel for WheelCallback to free
+        if (!wheel->dispatching) {
+            DestroyWheel(wheel);
+        }
+    }
+    pthread_mutex_unlock(&wheelsLock);
+}
+
+static int SetTimerPeriod(EventLoopTimer* timer, const struct timespec* initial,
+    const struct timespec* repeat)
 {
-    EventLoopTimer* timer = (EventLoopTimer*)context;
+    timer_wheel_t* wheel = timer->wheel;
+    WheelDequeue(wheel, timer);
+
+    // like timerfd, a zero initial expiry disarms the timer
+    if (initial != NULL && (initial->tv_sec != 0 || initial->tv_nsec != 0)) {
+        WheelCatchUp(wheel);
+        timer->expires = DeadlineTick(initial);
+        timer->period = 0;
+        if (repeat != NULL && (repeat->tv_sec != 0 || repeat->tv_nsec != 0)) {
+            timer->period = TimespecToTicks(repeat);
+        }
+        WheelEnqueue(wheel, timer);
+    }
 
-    timer->handler(timer, timer->ctx);
+    // the dispatcher re-arms once every handler has run
+    return wheel->dispatching ? 0 : WheelRearm(wheel);
 }
 
 EventLoopTimer* CreateEventLoopPeriodicTimer(EventLoop* eventLoop, EventLoopTimerHandler handler, void* ctx,
@@ -56,33 +455,22 @@ EventLoopTimer* CreateEventLoopPeriodicTimer(EventLoop* eventLoop, EventLoopTime
         return NULL;
     }
 
-    EventLoopTimer* timer = malloc(sizeof(EventLoopTimer));
+    EventLoopTimer* timer = MemBudgetAlloc(MemTag_EventLoop, sizeof(EventLoopTimer));
     if (timer == NULL) {
         return NULL;
     }
 
-    timer->eventLoop = eventLoop;
+    memset(timer, 0, sizeof(*timer));
+    ListInit(&timer->link);
     timer->handler = handler;
     timer->ctx = ctx;
 
-    // Initialize to unused values in case have to clean up partially initialized object.
-    timer->fd = -1;
-    timer->registration = NULL;
-
-    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timer->fd == -1) {
-        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+    timer->wheel = AcquireWheel(eventLoop);
+    if (timer->wheel == NULL) {
         goto failed;
     }
 
-    if (SetTimerPeriod(timer->fd, /* initial */ period, /* repeat */ period) == -1) {
-        goto failed;
-    }
-
-    timer->registration =
-        EventLoop_RegisterIo(eventLoop, timer->fd, EventLoop_Input, TimerCallback, timer);
-    if (timer->registration == NULL) {
-        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+    if (SetTimerPeriod(timer, /* initial */ period, /* repeat */ period) == -1) {
         goto failed;
     }
 
@@ -104,38 +492,80 @@ void DisposeEventLoopTimer(EventLoopTimer* timer)
         return;
     }
 
-    EventLoop_UnregisterIo(timer->eventLoop, timer->registration);
-
-    if (timer->fd != -1) {
-        close(timer->fd);
+    if (timer->wheel != NULL) {
+        WheelDequeue(timer->wheel, timer);
+        ReleaseWheel(timer->wheel);
     }
 
-    free(timer);
+    MemBudgetFree(timer);
 }
 
 int ConsumeEventLoopTimerEvent(EventLoopTimer* timer)
 {
-    uint64_t timerData = 0;
-
-    if (read(timer->fd, &timerData, sizeof(timerData)) == -1) {
-        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+    if (timer->pending == 0) {
+        errno = EAGAIN;
+        LOG_ERROR("ERROR: Could not consume timer event %s (%d).\n", strerror(errno), errno);
         return -1;
     }
 
+    timer->pending = 0;
+    return 0;
+}
+
+int SetEventLoopTimerSlack(EventLoopTimer* timer, const struct timespec* slack)
+{
+    timer->slack = slack != NULL ? TimespecToTicks(slack) : 0;
+    if (timer->state != TimerState_Queued) {
+        return 0;
+    }
+
+    WheelDequeue(timer->wheel, timer);
+    WheelEnqueue(timer->wheel, timer);
+    return timer->wheel->dispatching ? 0 : WheelRearm(timer->wheel);
+}
+
+int SetEventLoopTimerName(EventLoopTimer* timer, const char* name)
+{
+    timer->stats = HandlerStatsGet(name);
+    if (timer->stats == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
     return 0;
 }
 
+int GetEventLoopTimerStats(EventLoop* eventLoop, event_loop_timer_stats_t* stats)
+{
+    int ret = -1;
+    pthread_mutex_lock(&wheelsLock);
+    for (timer_wheel_t* wheel = wheels; wheel != NULL; wheel = wheel->next_wheel) {
+        if (wheel->eventLoop == eventLoop) {
+            stats->wakeups = atomic_load_explicit(&wheel->wakeups, memory_order_relaxed);
+            stats->expirations = atomic_load_explicit(&wheel->expirations, memory_order_relaxed);
+            stats->coalesced = atomic_load_explicit(&wheel->coalesced, memory_order_relaxed);
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wheelsLock);
+
+    if (ret == -1) {
+        errno = ENOENT;
+    }
+    return ret;
+}
+
 int SetEventLoopTimerPeriod(EventLoopTimer* timer, const struct timespec* initial, const struct timespec* period)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ initial, /* repeat */ period);
+    return SetTimerPeriod(timer, /* initial */ initial, /* repeat */ period);
 }
 
 int SetEventLoopTimerOneShot(EventLoopTimer* timer, const struct timespec* delay)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ delay, /* repeat */ NULL);
+    return SetTimerPeriod(timer, /* initial */ delay, /* repeat */ NULL);
 }
 
 int DisarmEventLoopTimer(EventLoopTimer* timer)
 {
-    return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
-}
\ No newline at end of file
+    return SetTimerPeriod(timer, /* initial */ NULL, /* repeat */ NULL);
+}
@@ -0,0 +1,71 @@
+/** Typed message queue for an EventLoop: a lock-free ring drained behind a single eventfd doorbell */
+
+#ifndef EVENT_MAILBOX_H
+#define EVENT_MAILBOX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+typedef struct {
+	uint32_t type;
+	union {
+		int64_t i;
+		uint64_t u;
+		double d;
+		void* p;
+	} arg;
+} mailbox_msg_t;
+
+struct EventMailbox;
+struct handler_stats;
+typedef struct EventMailbox EventMailbox_t;
+
+typedef void (*EventMailboxHandler)(EventMailbox_t* mailbox, const mailbox_msg_t* msg, void* ctx);
+
+typedef struct {
+	uint32_t posted;
+	uint32_t dropped; // posts rejected because the ring was full
+	uint32_t doorbells; // eventfd writes, at most one per burst of posts
+	uint32_t batches; // wakeups that drained messages
+	uint32_t max_batch; // most messages drained in one wakeup
+} event_mailbox_stats_t;
+
+typedef struct {
+	atomic_size_t _seq;
+	mailbox_msg_t _msg;
+} _mailbox_cell_t;
+
+struct EventMailbox {
+	EventLoop* _event_loop;
+	EventMailboxHandler _handler;
+	void* _ctx;
+	int _fd;
+	EventRegistration* _registration;
+	struct handler_stats* _stats;
+	_mailbox_cell_t* _cells;
+	size_t _mask;
+	atomic_size_t _tail; // shared by producers
+	size_t _head; // consumer only
+	atomic_bool _doorbell_rung;
+	atomic_uint _posted;
+	atomic_uint _dropped;
+	atomic_uint _doorbells;
+	uint32_t _batches;
+	uint32_t _max_batch;
+};
+
+/// capacity is rounded up to a power of two.
+EventMailbox_t* CreateEventMailbox(EventLoop* loop, size_t capacity, EventMailboxHandler handler, void* ctx);
+/// Safe from any thread and from signal handlers. Returns -1 with errno set to EAGAIN when the mailbox is full.
+int PostEventMailbox(EventMailbox_t* mailbox, const mailbox_msg_t* msg);
+/// Must be called from the thread running the mailbox's event loop.
+event_mailbox_stats_t EventMailboxStats(EventMailbox_t* mailbox);
+/// Collect per-message handler run times under name, which must outlive the process.
+int SetEventMailboxName(EventMailbox_t* mailbox, const char* name);
+void DisposeEventMailbox(EventMailbox_t* mailbox);
+
+#endif
@@ -0,0 +1,156 @@
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_MODULE LogModule_Loop
+#include "logging.h"
+#include "mem_budget.h"
+#include "handler_stats.h"
+#include "event_mailbox.h"
+
+// Bounded multi-producer queue after Dmitry Vyukov: each cell carries a sequence number that
+// tells producers and the consumer whose turn it is, so no locks are needed on either side.
+
+static bool mailbox_pop(EventMailbox_t* mailbox, mailbox_msg_t* out) {
+	_mailbox_cell_t* cell = &mailbox->_cells[mailbox->_head & mailbox->_mask];
+	const size_t seq = atomic_load_explicit(&cell->_seq, memory_order_acquire);
+	if (seq != mailbox->_head + 1)
+		return false;
+
+	*out = cell->_msg;
+	atomic_store_explicit(&cell->_seq, mailbox->_head + mailbox->_mask + 1, memory_order_release);
+	mailbox->_head++;
+	return true;
+}
+
+static void ring_doorbell(EventMailbox_t* mailbox) {
+	if (!atomic_exchange_explicit(&mailbox->_doorbell_rung, true, memory_order_acq_rel)) {
+		eventfd_write(mailbox->_fd, 1);
+		atomic_fetch_add_explicit(&mailbox->_doorbells, 1, memory_order_relaxed);
+	}
+}
+
+// This satisfies the EventLoopIoCallback signature.
+static void MailboxCallback(EventLoop* el, int fd, EventLoop_IoEvents events, void* context) {
+	EventMailbox_t* mailbox = (EventMailbox_t*)context;
+	eventfd_t out = 0;
+	eventfd_read(mailbox->_fd, &out);
+	// re-open the doorbell before draining, anything posted from here on rings again
+	atomic_store_explicit(&mailbox->_doorbell_rung, false, memory_order_seq_cst);
+
+	// drain at most one ring's worth so a busy producer cannot starve the rest of the loop
+	uint32_t batch = 0;
+	mailbox_msg_t msg;
+	while (batch <= mailbox->_mask && mailbox_pop(mailbox, &msg)) {
+		batch++;
+		const uint64_t start_us = HandlerStatsNowUs();
+		mailbox->_handler(mailbox, &msg, mailbox->_ctx);
+		HandlerStatsRecord(mailbox->_stats, HandlerStatsNowUs() - start_us, HANDLER_STATS_NO_LATENESS);
+	}
+	if (batch > mailbox->_mask)
+		ring_doorbell(mailbox);
+
+	if (batch > 0)
+		mailbox->_batches++;
+	if (batch > mailbox->_max_batch)
+		mailbox->_max_batch = batch;
+}
+
+EventMailbox_t* CreateEventMailbox(EventLoop* loop, size_t capacity, EventMailboxHandler handler, void* ctx) {
+	EventMailbox_t* mailbox = MemBudgetAlloc(MemTag_EventLoop, sizeof(EventMailbox_t));
+	if (mailbox == NULL)
+		return NULL;
+	memset(mailbox, 0, sizeof(*mailbox));
+
+	mailbox->_event_loop = loop;
+	mailbox->_handler = handler;
+	mailbox->_ctx = ctx;
+	mailbox->_fd = -1;
+
+	size_t rounded = 1;
+	while (rounded < capacity)
+		rounded <<= 1;
+	mailbox->_mask = rounded - 1;
+	mailbox->_cells = MemBudgetAlloc(MemTag_EventLoop, rounded * sizeof(_mailbox_cell_t));
+	if (mailbox->_cells == NULL)
+		goto failed;
+	for (size_t i = 0; i < rounded; i++)
+		atomic_init(&mailbox->_cells[i]._seq, i);
+	atomic_init(&mailbox->_tail, 0);
+	atomic_init(&mailbox->_doorbell_rung, false);
+
+	mailbox->_fd = eventfd(0, EFD_NONBLOCK);
+	if (mailbox->_fd == -1) {
+		LOG_ERROR("Failed to create eventfd with error %i\n", errno);
+		goto failed;
+	}
+
+	mailbox->_registration = EventLoop_RegisterIo(loop, mailbox->_fd, EventLoop_Input, MailboxCallback, mailbox);
+	if (mailbox->_registration == NULL) {
+		LOG_ERROR("Failed to create event registration for mailbox with error %i", errno);
+		goto failed;
+	}
+
+	return mailbox;
+
+failed:
+	DisposeEventMailbox(mailbox);
+	return NULL;
+}
+
+int PostEventMailbox(EventMailbox_t* mailbox, const mailbox_msg_t* msg) {
+	size_t pos = atomic_load_explicit(&mailbox->_tail, memory_order_relaxed);
+	_mailbox_cell_t* cell;
+	for (;;) {
+		cell = &mailbox->_cells[pos & mailbox->_mask];
+		const size_t seq = atomic_load_explicit(&cell->_seq, memory_order_acquire);
+		const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&mailbox->_tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			atomic_fetch_add_explicit(&mailbox->_dropped, 1, memory_order_relaxed);
+			errno = EAGAIN;
+			return -1;
+		}
+		else
+			pos = atomic_load_explicit(&mailbox->_tail, memory_order_relaxed);
+	}
+
+	cell->_msg = *msg;
+	atomic_store_explicit(&cell->_seq, pos + 1, memory_order_release);
+	atomic_fetch_add_explicit(&mailbox->_posted, 1, memory_order_relaxed);
+	ring_doorbell(mailbox);
+	return 0;
+}
+
+int SetEventMailboxName(EventMailbox_t* mailbox, const char* name) {
+	mailbox->_stats = HandlerStatsGet(name);
+	if (mailbox->_stats == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+event_mailbox_stats_t EventMailboxStats(EventMailbox_t* mailbox) {
+	event_mailbox_stats_t ret = {
+		.posted = atomic_load_explicit(&mailbox->_posted, memory_order_relaxed),
+		.dropped = atomic_load_explicit(&mailbox->_dropped, memory_order_relaxed),
+		.doorbells = atomic_load_explicit(&mailbox->_doorbells, memory_order_relaxed),
+		.batches = mailbox->_batches,
+		.max_batch = mailbox->_max_batch
+	};
+	return ret;
+}
+
+void DisposeEventMailbox(EventMailbox_t* mailbox) {
+	if (mailbox->_registration)
+		EventLoop_UnregisterIo(mailbox->_event_loop, mailbox->_registration);
+	if (mailbox->_fd != -1)
+		close(mailbox->_fd);
+	MemBudgetFree(mailbox->_cells);
+	MemBudgetFree(mailbox);
+}
@@ -0,0 +1,23 @@
+/** Light flicker analysis: a paced ADC burst run through a Goertzel filter bank */
+
+#ifndef FLICKER_H
+#define FLICKER_H
+
+#include <stdint.h>
+
+#include <applibs/adc.h>
+
+#define FLICKER_BURST_SAMPLES 256
+
+typedef struct {
+	double dc; // mean ADC reading
+	double percent; // (max - min) / (max + min) * 100 over the burst
+	double dominant_hz; // strongest mains related component, 0 if none stands out
+	double dominant_ratio; // its amplitude relative to dc
+	double sample_rate_hz; // rate actually achieved by the burst
+} flicker_result_t;
+
+/// Blocks for FLICKER_BURST_SAMPLES / sample_rate_hz seconds while polling the channel.
+int FlickerMeasure(int adc_fd, ADC_ChannelId channel, uint32_t sample_rate_hz, flicker_result_t* out);
+
+#endif
@@ -0,0 +1,94 @@
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_MODULE LogModule_Sensors
+#include "logging.h"
+#include "flicker.h"
+
+// twice the mains frequency for 50 and 60 Hz grids, and their second harmonics
+static const double bank_hz[] = { 100.0, 120.0, 200.0, 240.0 };
+// components weaker than this fraction of dc are treated as noise
+static const double min_ratio = 0.01;
+
+static void timespec_add_ns(struct timespec* ts, long ns) {
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000L) {
+		ts->tv_nsec -= 1000000000L;
+		ts->tv_sec++;
+	}
+}
+
+static double timespec_diff_s(const struct timespec* a, const struct timespec* b) {
+	return (double)(a->tv_sec - b->tv_sec) + (double)(a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+// amplitude of the freq component, dc removed first so it does not leak into the bin
+static double goertzel(const uint32_t* samples, size_t count, double dc, double freq, double rate) {
+	const double coeff = 2.0 * cos(2.0 * M_PI * freq / rate);
+	double s1 = 0, s2 = 0;
+	for (size_t i = 0; i < count; i++) {
+		const double s = ((double)samples[i] - dc) + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s;
+	}
+	const double power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+	return 2.0 * sqrt(power > 0 ? power : 0) / (double)count;
+}
+
+int FlickerMeasure(int adc_fd, ADC_ChannelId channel, uint32_t sample_rate_hz, flicker_result_t* out) {
+	memset(out, 0, sizeof(*out));
+	uint32_t samples[FLICKER_BURST_SAMPLES];
+	const long period_ns = 1000000000L / (long)sample_rate_hz;
+
+	// pace polls against absolute deadlines so a slow poll does not stretch every later period
+	struct timespec first, last, deadline;
+	clock_gettime(CLOCK_MONOTONIC, &first);
+	deadline = first;
+	for (size_t i = 0; i < FLICKER_BURST_SAMPLES; i++) {
+		if (i > 0) {
+			timespec_add_ns(&deadline, period_ns);
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+		}
+		if (ADC_Poll(adc_fd, channel, &samples[i]) < 0) {
+			LOG_WARN("Flicker burst poll failed: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &last);
+
+	const double elapsed = timespec_diff_s(&last, &first);
+	out->sample_rate_hz = elapsed > 0 ? (double)(FLICKER_BURST_SAMPLES - 1) / elapsed : 0;
+
+	uint64_t sum = 0;
+	uint32_t min = UINT32_MAX, max = 0;
+	for (size_t i = 0; i < FLICKER_BURST_SAMPLES; i++) {
+		sum += samples[i];
+		if (samples[i] < min)
+			min = samples[i];
+		if (samples[i] > max)
+			max = samples[i];
+	}
+	out->dc = (double)sum / FLICKER_BURST_SAMPLES;
+	if (max + min > 0)
+		out->percent = 100.0 * (double)(max - min) / (double)(max + min);
+	if (out->dc <= 0)
+		return 0;
+
+	double best = 0;
+	for (size_t i = 0; i < sizeof(bank_hz) / sizeof(bank_hz[0]); i++) {
+		// bins past Nyquist would alias onto lower frequencies
+		if (2.0 * bank_hz[i] >= out->sample_rate_hz)
+			continue;
+		const double amplitude = goertzel(samples, FLICKER_BURST_SAMPLES, out->dc, bank_hz[i], out->sample_rate_hz);
+		if (amplitude > best) {
+			best = amplitude;
+			out->dominant_hz = bank_hz[i];
+		}
+	}
+	out->dominant_ratio = best / out->dc;
+	if (out->dominant_ratio < min_ratio)
+		out->dominant_hz = 0;
+	return 0;
+}
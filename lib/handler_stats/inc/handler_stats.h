@@ -0,0 +1,45 @@
+/** Per-handler latency histograms and stall detection for event loop dispatch */
+
+#ifndef HANDLER_STATS_H
+#define HANDLER_STATS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Bucket i counts values in [2^i, 2^(i+1)) microseconds, the last bucket also takes everything longer.
+#define HANDLER_STATS_BUCKETS 24
+#define HANDLER_STATS_NO_LATENESS UINT64_MAX
+
+typedef struct handler_stats {
+	struct handler_stats* _next;
+	const char* _name;
+	// written by the thread running the handler, read by whoever reports
+	atomic_uint _runs;
+	atomic_uint _stalls;
+	atomic_uint _overruns;
+	atomic_uint _budget_us; // 0 for no budget
+	atomic_uint _max_us;
+	atomic_uint _duration[HANDLER_STATS_BUCKETS];
+	atomic_uint _lateness[HANDLER_STATS_BUCKETS];
+} handler_stats_t;
+
+/// Find or create the stats for a handler name. Entries live for the whole process, so they
+/// outlast the timers and events that feed them. Returns NULL on allocation failure.
+handler_stats_t* HandlerStatsGet(const char* name);
+/// Dispatchers that run handlers which did not register a name pass NULL here, stalls are still logged.
+void HandlerStatsRecord(handler_stats_t* stats, uint64_t duration_us, uint64_t lateness_us);
+/// Handlers running longer than this are counted and logged as stalls.
+void HandlerStatsSetStallThreshold(uint32_t threshold_ms);
+/// Declare how long the named handler may run. Handlers cannot be preempted, so a run over
+/// budget is logged and counted as an overrun. Returns -1 on allocation failure.
+int HandlerStatsSetBudget(const char* name, uint32_t budget_ms);
+/// Overruns across all handlers since boot, callers compare snapshots to spot new ones.
+uint32_t HandlerStatsOverruns(void);
+uint64_t HandlerStatsNowUs(void);
+/// Writes one compact row ["name",runs,stalls,overruns,max_ms,"bucket:count,...","..."] with the run time and
+/// lateness histograms last, and returns the snprintf style length. Empty buckets are left out.
+int HandlerStatsFormat(const handler_stats_t* stats, char* buf, size_t len);
+void HandlerStatsForEach(void (*fn)(const handler_stats_t* stats, void* ctx), void* ctx);
+
+#endif
@@ -0,0 +1,130 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_MODULE LogModule_Loop
+#include "logging.h"
+#include "mem_budget.h"
+#include "handler_stats.h"
+
+// the registry only grows, so ForEach can walk it after dropping the lock
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static handler_stats_t* registry = NULL;
+static atomic_uint stall_threshold_ms = 500;
+static atomic_uint total_overruns = 0;
+
+static unsigned int bucket_of(uint64_t us) {
+	unsigned int bucket = 0;
+	while (us > 1 && bucket < HANDLER_STATS_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+handler_stats_t* HandlerStatsGet(const char* name) {
+	pthread_mutex_lock(&registry_lock);
+	handler_stats_t* stats = registry;
+	while (stats != NULL && strcmp(stats->_name, name) != 0)
+		stats = stats->_next;
+
+	if (stats == NULL) {
+		stats = MemBudgetCalloc(MemTag_EventLoop, 1, sizeof(handler_stats_t));
+		if (stats != NULL) {
+			stats->_name = name;
+			stats->_next = registry;
+			registry = stats;
+		}
+	}
+	pthread_mutex_unlock(&registry_lock);
+	return stats;
+}
+
+void HandlerStatsRecord(handler_stats_t* stats, uint64_t duration_us, uint64_t lateness_us) {
+	const uint64_t threshold_us = (uint64_t)atomic_load_explicit(&stall_threshold_ms, memory_order_relaxed) * 1000;
+	const char* name = stats != NULL ? stats->_name : "(unnamed)";
+	if (duration_us > threshold_us)
+		LOG_WARN("Stall: %s blocked its event loop for %u ms\n", name, (unsigned int)(duration_us / 1000));
+
+	if (stats == NULL)
+		return;
+
+	atomic_fetch_add_explicit(&stats->_runs, 1, memory_order_relaxed);
+	if (duration_us > threshold_us)
+		atomic_fetch_add_explicit(&stats->_stalls, 1, memory_order_relaxed);
+	const uint64_t budget_us = atomic_load_explicit(&stats->_budget_us, memory_order_relaxed);
+	if (budget_us != 0 && duration_us > budget_us) {
+		LOG_WARN("Overrun: %s ran %u ms of its %u ms budget\n", name, (unsigned int)(duration_us / 1000), (unsigned int)(budget_us / 1000));
+		atomic_fetch_add_explicit(&stats->_overruns, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&total_overruns, 1, memory_order_relaxed);
+	}
+	const unsigned int duration_clamped = duration_us > UINT32_MAX ? UINT32_MAX : (unsigned int)duration_us;
+	if (duration_clamped > atomic_load_explicit(&stats->_max_us, memory_order_relaxed))
+		atomic_store_explicit(&stats->_max_us, duration_clamped, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats->_duration[bucket_of(duration_us)], 1, memory_order_relaxed);
+	if (lateness_us != HANDLER_STATS_NO_LATENESS)
+		atomic_fetch_add_explicit(&stats->_lateness[bucket_of(lateness_us)], 1, memory_order_relaxed);
+}
+
+void HandlerStatsSetStallThreshold(uint32_t threshold_ms) {
+	atomic_store_explicit(&stall_threshold_ms, threshold_ms, memory_order_relaxed);
+}
+
+int HandlerStatsSetBudget(const char* name, uint32_t budget_ms) {
+	handler_stats_t* stats = HandlerStatsGet(name);
+	if (stats == NULL)
+		return -1;
+	atomic_store_explicit(&stats->_budget_us, budget_ms * 1000, memory_order_relaxed);
+	return 0;
+}
+
+uint32_t HandlerStatsOverruns(void) {
+	return atomic_load_explicit(&total_overruns, memory_order_relaxed);
+}
+
+uint64_t HandlerStatsNowUs(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static int format_histogram(const atomic_uint* buckets, char* buf, size_t len) {
+	int res = 0;
+	for (unsigned int i = 0; i < HANDLER_STATS_BUCKETS && res >= 0 && (size_t)res < len; i++) {
+		const unsigned int count = atomic_load_explicit(&buckets[i], memory_order_relaxed);
+		if (count > 0)
+			res += snprintf(buf + res, len - res, res == 0 ? "%u:%u" : ",%u:%u", i, count);
+	}
+	return res;
+}
+
+int HandlerStatsFormat(const handler_stats_t* stats, char* buf, size_t len) {
+	int res = snprintf(buf, len, "[\"%s\",%u,%u,%u,%u,\"",
+		stats->_name,
+		atomic_load_explicit(&stats->_runs, memory_order_relaxed),
+		atomic_load_explicit(&stats->_stalls, memory_order_relaxed),
+		atomic_load_explicit(&stats->_overruns, memory_order_relaxed),
+		atomic_load_explicit(&stats->_max_us, memory_order_relaxed) / 1000);
+	if (res < 0 || (size_t)res >= len)
+		return res;
+	res += format_histogram(stats->_duration, buf + res, len - res);
+	if ((size_t)res >= len)
+		return res;
+	res += snprintf(buf + res, len - res, "\",\"");
+	if ((size_t)res >= len)
+		return res;
+	res += format_histogram(stats->_lateness, buf + res, len - res);
+	if ((size_t)res >= len)
+		return res;
+	return res + snprintf(buf + res, len - res, "\"]");
+}
+
+void HandlerStatsForEach(void (*fn)(const handler_stats_t* stats, void* ctx), void* ctx) {
+	pthread_mutex_lock(&registry_lock);
+	handler_stats_t* stats = registry;
+	pthread_mutex_unlock(&registry_lock);
+
+	for (; stats != NULL; stats = stats->_next)
+		fn(stats, ctx);
+}
@@ -9,17 +9,45 @@
 #include <applibs/i2c.h>
 #include <applibs/log.h>
 
+#include "coroutine.h"
+#include "duty_cycle.h"
+
+/// high repeatability single shot conversion time
+#define HUMIDITY_CONVERSION_MS 15
+
 typedef struct {
 	double humidity;
 } humidity_data_t;
 
+/// Single shot converts once per HumidityTrigger and idles in between, periodic modes free-run.
+typedef enum {
+	HumidityMode_SingleShot = 0,
+	HumidityMode_Periodic_0_5Hz = 1,
+	HumidityMode_Periodic_1Hz = 2,
+	HumidityMode_Periodic_2Hz = 3,
+	HumidityMode_Periodic_4Hz = 4,
+	HumidityMode_Periodic_10Hz = 5
+} humidity_mode_t;
+
 typedef struct {
 	int _fd;
 	bool _is_active;
+	humidity_mode_t _mode; // kept across HumidityInit
+	coroutine_t _init_co;
+	duty_cycle_t _duty;
 } humidity_t;
 
-int HumidityInit(humidity_t* humidity, int i2cfd);
+/// Probe, reset and enter the configured mode, yielding on task while the reset completes.
+/// result is set to 0 or -1 once the call returns CO_DONE.
+co_status_t HumidityInit(humidity_t* humidity, co_task_t* task, int i2cfd, int* result);
+/// Warm start for a sensor that stayed powered in the configured mode, skipping the probe and reset.
+void HumidityResume(humidity_t* humidity, int i2cfd);
+/// Takes effect at once on an active sensor, otherwise at the next HumidityInit.
+int HumiditySetMode(humidity_t* humidity, humidity_mode_t mode);
+/// Start a single shot conversion, the result is ready HUMIDITY_CONVERSION_MS later. Does nothing in periodic modes.
+int HumidityTrigger(humidity_t* humidity);
 int HumidityMeasure(humidity_t* humidity, humidity_data_t* data_out);
 bool HumidityIsOk(humidity_t* humidity);
+const duty_cycle_t* HumidityDutyCycle(humidity_t* humidity);
 
 #endif
\ No newline at end of file
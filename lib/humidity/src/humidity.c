@@ -1,52 +1,143 @@
+#define LOG_MODULE LogModule_Sensors
+#include "logging.h"
 #include "humidity.h"
+#include "i2c_metrics.h"
 
 const static I2C_DeviceAddress humid_addr = 0x44;
 const static uint16_t SHT3XD_CMD_READ_SERIAL_NUMBER = 0x3780;
 const static uint16_t SHT3XD_CMD_SOFT_RESET = 0x30A2;
-const static uint16_t SHT3XD_CMD_PERIODIC_HALF_H = 0x2032;
+const static uint16_t SHT3XD_CMD_SINGLE_SHOT_HIGH = 0x2400; // high repeatability, no clock stretching
+const static uint16_t SHT3XD_CMD_BREAK = 0x3093;
 const static uint16_t SHT3XD_CMD_FETCH_DATA = 0xE000;
+// high repeatability periodic commands, indexed by humidity_mode_t
+const static uint16_t SHT3XD_CMD_PERIODIC[] = { 0, 0x2032, 0x2130, 0x2236, 0x2334, 0x2737 };
+// leaving periodic mode takes 1 ms after a break
+const static struct timespec SHT3XD_BREAK_TIME = { .tv_sec = 0, .tv_nsec = 1000000 };
+// soft reset takes at most 1.5 ms, commands sent earlier are ignored
+const static struct timespec SHT3XD_RESET_TIME = { .tv_sec = 0, .tv_nsec = 2000000 };
 
-int HumidityInit(humidity_t* humidity, int i2cfd) {
-	humidity->_fd = i2cfd;
-	humidity->_is_active = false;
+static int humidity_probe(int i2cfd) {
 	// verify that the sensor attatched is the SHT31D
 	const uint8_t ser_cmd[2] = { (uint8_t)(SHT3XD_CMD_READ_SERIAL_NUMBER >> 8), SHT3XD_CMD_READ_SERIAL_NUMBER & 0xFFU };
 	uint8_t out[6];
-	int ret = I2CMaster_WriteThenRead(i2cfd, humid_addr, ser_cmd, sizeof(ser_cmd), out, sizeof(out));
+	int ret = I2CMetricsWriteThenRead(i2cfd, humid_addr, ser_cmd, sizeof(ser_cmd), out, sizeof(out));
 	if (ret < 0) {
-		Log_Debug("Initialize humid failed\n");
+		LOG_ERROR("Initialize humid failed\n");
 		return -1;
 	}
 	// ignore CRC check for now
 	uint32_t serial = ((uint32_t)(out[0]) << 24) | ((uint32_t)(out[1]) << 16) | ((uint32_t)out[3] << 8) | (uint32_t)(out[4]);
 	if (serial == 0 || serial == 0xFFFFU) {
-		Log_Debug("Got invalid humidity serial number!\n");
+		LOG_ERROR("Got invalid humidity serial number!\n");
 		return -1;
 	}
-	Log_Debug("Found humidity sensor with serial %u\n", serial);
-	// reset the sensor, and set it into periodic mode at the slowest setting
-	const uint8_t reset_cmd[2] = { (uint8_t)(SHT3XD_CMD_SOFT_RESET >> 8), SHT3XD_CMD_SOFT_RESET & 0xFFU };
-	const uint8_t poll_cmd[2] = { (uint8_t)(SHT3XD_CMD_PERIODIC_HALF_H >> 8), SHT3XD_CMD_PERIODIC_HALF_H & 0xFFU };
-	if (I2CMaster_Write(i2cfd, humid_addr, reset_cmd, sizeof(reset_cmd)) < 0
-		|| I2CMaster_Write(i2cfd, humid_addr, poll_cmd, sizeof(poll_cmd)) < 0) {
-		
-		Log_Debug("Configuring humid failed\n");
+	LOG_INFO("Found humidity sensor with serial %u\n", serial);
+	return 0;
+}
+
+static int humidity_command(int i2cfd, uint16_t cmd) {
+	const uint8_t buf[2] = { (uint8_t)(cmd >> 8), cmd & 0xFFU };
+	if (I2CMetricsWrite(i2cfd, humid_addr, buf, sizeof(buf)) < 0) {
+		LOG_ERROR("Configuring humid failed\n");
 		return -1;
 	}
+	return 0;
+}
+
+static int humidity_start_mode(humidity_t* humidity) {
+	if (humidity->_mode == HumidityMode_SingleShot) {
+		DutyCycleAsleep(&humidity->_duty);
+		return 0;
+	}
+	if (humidity_command(humidity->_fd, SHT3XD_CMD_PERIODIC[humidity->_mode]) < 0)
+		return -1;
+	// counted as awake, the sensor idles between periodic conversions so this is an upper bound
+	DutyCycleAwake(&humidity->_duty);
+	return 0;
+}
+
+co_status_t HumidityInit(humidity_t* humidity, co_task_t* task, int i2cfd, int* result) {
+	CO_BEGIN(&humidity->_init_co);
+	humidity->_fd = i2cfd;
+	humidity->_is_active = false;
+	*result = -1;
+	if (humidity_probe(i2cfd) < 0)
+		CO_EXIT(&humidity->_init_co);
 
+	// reset the sensor, which leaves it idle, and enter the configured mode
+	if (humidity_command(i2cfd, SHT3XD_CMD_SOFT_RESET) < 0)
+		CO_EXIT(&humidity->_init_co);
+	CO_SLEEP(&humidity->_init_co, task, &SHT3XD_RESET_TIME);
+	if (humidity_start_mode(humidity) < 0)
+		CO_EXIT(&humidity->_init_co);
+
+	humidity->_is_active = true;
+	*result = 0;
+	CO_END(&humidity->_init_co);
+}
+
+void HumidityResume(humidity_t* humidity, int i2cfd) {
+	humidity->_fd = i2cfd;
 	humidity->_is_active = true;
+	if (humidity->_mode == HumidityMode_SingleShot)
+		DutyCycleAsleep(&humidity->_duty);
+	else
+		DutyCycleAwake(&humidity->_duty);
+}
+
+int HumiditySetMode(humidity_t* humidity, humidity_mode_t mode) {
+	if ((unsigned int)mode > HumidityMode_Periodic_10Hz) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (mode == humidity->_mode)
+		return 0;
+
+	const humidity_mode_t old_mode = humidity->_mode;
+	humidity->_mode = mode;
+	if (!humidity->_is_active)
+		return 0;
+	if (old_mode != HumidityMode_SingleShot) {
+		if (humidity_command(humidity->_fd, SHT3XD_CMD_BREAK) < 0) {
+			humidity->_is_active = false;
+			return -1;
+		}
+		nanosleep(&SHT3XD_BREAK_TIME, NULL);
+	}
+	if (humidity_start_mode(humidity) < 0) {
+		humidity->_is_active = false;
+		return -1;
+	}
+	return 0;
+}
+
+int HumidityTrigger(humidity_t* humidity) {
+	if (!humidity->_is_active)
+		return -1;
+	if (humidity->_mode != HumidityMode_SingleShot)
+		return 0;
+	if (humidity_command(humidity->_fd, SHT3XD_CMD_SINGLE_SHOT_HIGH) < 0) {
+		humidity->_is_active = false;
+		return -1;
+	}
+	DutyCycleAddActive(&humidity->_duty, HUMIDITY_CONVERSION_MS * 1000);
 	return 0;
 }
 
 int HumidityMeasure(humidity_t* humidity, humidity_data_t* data_out) {
 	if (!humidity->_is_active)
 		return -1;
-	// read the sensor!
-	const uint8_t fetch_cmd[2] = { (uint8_t)(SHT3XD_CMD_FETCH_DATA >> 8), SHT3XD_CMD_FETCH_DATA & 0xFFU };
+	// read the sensor! a single shot result is read directly, periodic ones are fetched
 	uint8_t out[6];
-	int ret = I2CMaster_WriteThenRead(humidity->_fd, humid_addr, fetch_cmd, sizeof(fetch_cmd), out, sizeof(out));
+	int ret;
+	if (humidity->_mode == HumidityMode_SingleShot)
+		ret = I2CMetricsRead(humidity->_fd, humid_addr, out, sizeof(out));
+	else {
+		const uint8_t fetch_cmd[2] = { (uint8_t)(SHT3XD_CMD_FETCH_DATA >> 8), SHT3XD_CMD_FETCH_DATA & 0xFFU };
+		ret = I2CMetricsWriteThenRead(humidity->_fd, humid_addr, fetch_cmd, sizeof(fetch_cmd), out, sizeof(out));
+	}
 	if (ret < 0) {
-		Log_Debug("Failed to read humid\n");
+		LOG_WARN("Failed to read humid\n");
 		humidity->_is_active = false;
 		return -1;
 	}
@@ -56,4 +147,6 @@ int HumidityMeasure(humidity_t* humidity, humidity_data_t* data_out) {
 	return 0;
 }
 
-bool HumidityIsOk(humidity_t* humidity) { return humidity->_is_active; }
\ No newline at end of file
+bool HumidityIsOk(humidity_t* humidity) { return humidity->_is_active; }
+
+const duty_cycle_t* HumidityDutyCycle(humidity_t* humidity) { return &humidity->_duty; }
\ No newline at end of file
@@ -0,0 +1,40 @@
+/** Counting wrappers around the I2C master calls, with per device address metrics */
+
+#ifndef I2C_METRICS_H
+#define I2C_METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <applibs/i2c.h>
+
+#define I2C_METRICS_MAX_DEVICES 8
+/// Latency bucket i counts transactions taking [2^i, 2^(i+1)) microseconds.
+#define I2C_METRICS_BUCKETS 20
+
+typedef struct {
+	I2C_DeviceAddress address;
+	uint32_t transactions;
+	uint32_t bytes_written; // as reported by successful calls, failed transfers add none
+	uint32_t bytes_read;
+	uint64_t bus_time_us;
+	uint32_t p50_us; // upper bound of the bucket holding the median
+	uint32_t p99_us;
+	uint32_t nacks; // device did not acknowledge (ENXIO)
+	uint32_t timeouts; // bus timeout (ETIMEDOUT)
+	uint32_t errors; // any other failure
+} i2c_device_stats_t;
+
+/// Same contract as I2CMaster_Write, and recorded against address.
+ssize_t I2CMetricsWrite(int fd, I2C_DeviceAddress address, const uint8_t* data, size_t length);
+/// Same contract as I2CMaster_Read, and recorded against address.
+ssize_t I2CMetricsRead(int fd, I2C_DeviceAddress address, uint8_t* buffer, size_t max_length);
+/// Same contract as I2CMaster_WriteThenRead, and recorded against address.
+ssize_t I2CMetricsWriteThenRead(int fd, I2C_DeviceAddress address, const uint8_t* write_data, size_t write_len, uint8_t* read_data, size_t read_len);
+/// Devices are numbered in the order they were first addressed. Safe from any thread.
+/// Returns -1 once index runs past the devices seen so far.
+int I2CMetricsGet(size_t index, i2c_device_stats_t* stats_out);
+
+#endif
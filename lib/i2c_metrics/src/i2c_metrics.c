@@ -0,0 +1,146 @@
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "i2c_metrics.h"
+
+typedef struct {
+	I2C_DeviceAddress address;
+	atomic_uint transactions;
+	atomic_uint bytes_written;
+	atomic_uint bytes_read;
+	atomic_uint_fast64_t bus_time_us; // 32 bits of microseconds wrap after 71 minutes on the bus
+	atomic_uint nacks;
+	atomic_uint timeouts;
+	atomic_uint errors;
+	atomic_uint latency[I2C_METRICS_BUCKETS];
+} device_metrics_t;
+
+// slots are claimed under the lock and never released, readers only look below device_count
+static pthread_mutex_t devices_lock = PTHREAD_MUTEX_INITIALIZER;
+static device_metrics_t devices[I2C_METRICS_MAX_DEVICES];
+static atomic_size_t device_count = 0;
+
+static device_metrics_t* find_device(I2C_DeviceAddress address) {
+	const size_t count = atomic_load_explicit(&device_count, memory_order_acquire);
+	for (size_t i = 0; i < count; i++) {
+		if (devices[i].address == address)
+			return &devices[i];
+	}
+
+	device_metrics_t* device = NULL;
+	pthread_mutex_lock(&devices_lock);
+	const size_t locked_count = atomic_load_explicit(&device_count, memory_order_relaxed);
+	for (size_t i = 0; i < locked_count && device == NULL; i++) {
+		if (devices[i].address == address)
+			device = &devices[i];
+	}
+	if (device == NULL && locked_count < I2C_METRICS_MAX_DEVICES) {
+		device = &devices[locked_count];
+		device->address = address;
+		atomic_store_explicit(&device_count, locked_count + 1, memory_order_release);
+	}
+	pthread_mutex_unlock(&devices_lock);
+	return device;
+}
+
+static uint64_t now_us(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// written and read are what the call reported as transferred, never what was asked for
+static void record(I2C_DeviceAddress address, ssize_t ret, int err, uint64_t start_us, size_t written, size_t read) {
+	const uint64_t elapsed = now_us() - start_us;
+	device_metrics_t* device = find_device(address);
+	if (device == NULL)
+		return;
+
+	atomic_fetch_add_explicit(&device->transactions, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&device->bus_time_us, elapsed, memory_order_relaxed);
+	unsigned int bucket = 0;
+	for (uint64_t us = elapsed; us > 1 && bucket < I2C_METRICS_BUCKETS - 1; us >>= 1)
+		bucket++;
+	atomic_fetch_add_explicit(&device->latency[bucket], 1, memory_order_relaxed);
+
+	if (ret < 0) {
+		if (err == ENXIO)
+			atomic_fetch_add_explicit(&device->nacks, 1, memory_order_relaxed);
+		else if (err == ETIMEDOUT)
+			atomic_fetch_add_explicit(&device->timeouts, 1, memory_order_relaxed);
+		else
+			atomic_fetch_add_explicit(&device->errors, 1, memory_order_relaxed);
+		return;
+	}
+	atomic_fetch_add_explicit(&device->bytes_written, (unsigned int)written, memory_order_relaxed);
+	atomic_fetch_add_explicit(&device->bytes_read, (unsigned int)read, memory_order_relaxed);
+}
+
+ssize_t I2CMetricsWrite(int fd, I2C_DeviceAddress address, const uint8_t* data, size_t length) {
+	const uint64_t start = now_us();
+	const ssize_t ret = I2CMaster_Write(fd, address, data, length);
+	const int err = errno;
+	record(address, ret, err, start, ret > 0 ? (size_t)ret : 0, 0);
+	errno = err;
+	return ret;
+}
+
+ssize_t I2CMetricsRead(int fd, I2C_DeviceAddress address, uint8_t* buffer, size_t max_length) {
+	const uint64_t start = now_us();
+	const ssize_t ret = I2CMaster_Read(fd, address, buffer, max_length);
+	const int err = errno;
+	record(address, ret, err, start, 0, ret > 0 ? (size_t)ret : 0);
+	errno = err;
+	return ret;
+}
+
+ssize_t I2CMetricsWriteThenRead(int fd, I2C_DeviceAddress address, const uint8_t* write_data, size_t write_len, uint8_t* read_data, size_t read_len) {
+	const uint64_t start = now_us();
+	const ssize_t ret = I2CMaster_WriteThenRead(fd, address, write_data, write_len, read_data, read_len);
+	const int err = errno;
+	// the call reports the bytes written and read together, the write goes out first
+	const size_t transferred = ret > 0 ? (size_t)ret : 0;
+	const size_t written = transferred < write_len ? transferred : write_len;
+	record(address, ret, err, start, written, transferred - written);
+	errno = err;
+	return ret;
+}
+
+static uint32_t percentile_us(const uint32_t* buckets, uint32_t total, uint32_t percent) {
+	const uint64_t target = ((uint64_t)total * percent + 99) / 100;
+	uint64_t seen = 0;
+	for (unsigned int i = 0; i < I2C_METRICS_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= target && seen > 0)
+			return (2u << i) - 1;
+	}
+	return 0;
+}
+
+int I2CMetricsGet(size_t index, i2c_device_stats_t* stats_out) {
+	if (index >= atomic_load_explicit(&device_count, memory_order_acquire))
+		return -1;
+
+	const device_metrics_t* device = &devices[index];
+	uint32_t buckets[I2C_METRICS_BUCKETS];
+	uint32_t total = 0;
+	for (unsigned int i = 0; i < I2C_METRICS_BUCKETS; i++) {
+		buckets[i] = atomic_load_explicit(&device->latency[i], memory_order_relaxed);
+		total += buckets[i];
+	}
+
+	memset(stats_out, 0, sizeof(*stats_out));
+	stats_out->address = device->address;
+	stats_out->transactions = atomic_load_explicit(&device->transactions, memory_order_relaxed);
+	stats_out->bytes_written = atomic_load_explicit(&device->bytes_written, memory_order_relaxed);
+	stats_out->bytes_read = atomic_load_explicit(&device->bytes_read, memory_order_relaxed);
+	stats_out->bus_time_us = atomic_load_explicit(&device->bus_time_us, memory_order_relaxed);
+	stats_out->p50_us = percentile_us(buckets, total, 50);
+	stats_out->p99_us = percentile_us(buckets, total, 99);
+	stats_out->nacks = atomic_load_explicit(&device->nacks, memory_order_relaxed);
+	stats_out->timeouts = atomic_load_explicit(&device->timeouts, memory_order_relaxed);
+	stats_out->errors = atomic_load_explicit(&device->errors, memory_order_relaxed);
+	return 0;
+}
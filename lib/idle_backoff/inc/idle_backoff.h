@@ -0,0 +1,23 @@
+/** Polling interval that runs fast while there is work and doubles towards a ceiling once it goes quiet */
+
+#ifndef IDLE_BACKOFF_H
+#define IDLE_BACKOFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+	uint32_t _min_ms;
+	uint32_t _max_ms;
+	uint32_t _interval_ms; // last interval handed out
+} idle_backoff_t;
+
+/// Starts at min_ms, as after IdleBackoffReset.
+void IdleBackoffInit(idle_backoff_t* backoff, uint32_t min_ms, uint32_t max_ms);
+/// Delay to the next poll: min_ms while busy, otherwise double the last one up to max_ms.
+uint32_t IdleBackoffNextMs(idle_backoff_t* backoff, bool busy);
+/// Work just arrived, the next idle poll doubles from min_ms again.
+void IdleBackoffReset(idle_backoff_t* backoff);
+uint32_t IdleBackoffIntervalMs(const idle_backoff_t* backoff);
+
+#endif
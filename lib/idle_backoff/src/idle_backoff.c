@@ -0,0 +1,19 @@
+#include "idle_backoff.h"
+
+void IdleBackoffInit(idle_backoff_t* backoff, uint32_t min_ms, uint32_t max_ms) {
+	backoff->_min_ms = min_ms > 0 ? min_ms : 1;
+	backoff->_max_ms = max_ms > backoff->_min_ms ? max_ms : backoff->_min_ms;
+	backoff->_interval_ms = backoff->_min_ms;
+}
+
+uint32_t IdleBackoffNextMs(idle_backoff_t* backoff, bool busy) {
+	if (busy)
+		backoff->_interval_ms = backoff->_min_ms;
+	else
+		backoff->_interval_ms = backoff->_interval_ms > backoff->_max_ms / 2 ? backoff->_max_ms : backoff->_interval_ms * 2;
+	return backoff->_interval_ms;
+}
+
+void IdleBackoffReset(idle_backoff_t* backoff) { backoff->_interval_ms = backoff->_min_ms; }
+
+uint32_t IdleBackoffIntervalMs(const idle_backoff_t* backoff) { return backoff->_interval_ms; }
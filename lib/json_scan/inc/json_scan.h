@@ -0,0 +1,19 @@
+/** Minimal JSON scanning: finds object members and reads numbers in place, without building a tree */
+
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stddef.h>
+
+typedef struct {
+	const char* ptr;
+	size_t len;
+} json_span_t;
+
+/// Find the member key of the object spanning json, which need not be NUL terminated. Keys are compared
+/// byte for byte, escapes included. Returns -1 if json is not a well formed object or has no such member.
+int JsonScanMember(json_span_t json, const char* key, json_span_t* value_out);
+/// Read value as a finite number. Returns -1 for anything else.
+int JsonScanNumber(json_span_t value, double* out);
+
+#endif
@@ -0,0 +1,120 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_scan.h"
+
+// longest number token read, far more digits than a double holds
+#define JSON_NUMBER_MAX_CHARS 32
+
+typedef struct {
+	const char* p;
+	const char* end;
+} cursor_t;
+
+static void skip_space(cursor_t* c) {
+	while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+		c->p++;
+}
+
+// c points at the opening quote, leaves it after the closing one
+static bool skip_string(cursor_t* c) {
+	for (c->p++; c->p < c->end; c->p++) {
+		if (*c->p == '\\')
+			c->p++;
+		else if (*c->p == '"') {
+			c->p++;
+			return true;
+		}
+	}
+	return false;
+}
+
+// objects and arrays are skipped by bracket depth, their contents are not validated
+static bool skip_value(cursor_t* c) {
+	if (c->p >= c->end)
+		return false;
+	if (*c->p == '"')
+		return skip_string(c);
+	if (*c->p == '{' || *c->p == '[') {
+		int depth = 0;
+		while (c->p < c->end) {
+			if (*c->p == '"') {
+				if (!skip_string(c))
+					return false;
+				continue;
+			}
+			if (*c->p == '{' || *c->p == '[')
+				depth++;
+			else if ((*c->p == '}' || *c->p == ']') && --depth == 0) {
+				c->p++;
+				return true;
+			}
+			c->p++;
+		}
+		return false;
+	}
+
+	// numbers, true, false and null run up to the next delimiter
+	const char* start = c->p;
+	while (c->p < c->end && strchr(",}] \t\r\n", *c->p) == NULL)
+		c->p++;
+	return c->p > start;
+}
+
+int JsonScanMember(json_span_t json, const char* key, json_span_t* value_out) {
+	cursor_t c = { .p = json.ptr, .end = json.ptr + json.len };
+	const size_t key_len = strlen(key);
+
+	skip_space(&c);
+	if (c.p >= c.end || *c.p != '{')
+		return -1;
+	c.p++;
+	for (;;) {
+		skip_space(&c);
+		if (c.p >= c.end || *c.p != '"')
+			return -1;
+		const char* name = c.p + 1;
+		if (!skip_string(&c))
+			return -1;
+		const size_t name_len = (size_t)(c.p - 1 - name);
+
+		skip_space(&c);
+		if (c.p >= c.end || *c.p != ':')
+			return -1;
+		c.p++;
+		skip_space(&c);
+		const char* value = c.p;
+		if (!skip_value(&c))
+			return -1;
+		if (name_len == key_len && memcmp(name, key, key_len) == 0) {
+			value_out->ptr = value;
+			value_out->len = (size_t)(c.p - value);
+			return 0;
+		}
+
+		skip_space(&c);
+		if (c.p >= c.end || *c.p != ',')
+			return -1;
+		c.p++;
+	}
+}
+
+int JsonScanNumber(json_span_t value, double* out) {
+	char buf[JSON_NUMBER_MAX_CHARS + 1];
+	if (value.len == 0 || value.len > JSON_NUMBER_MAX_CHARS)
+		return -1;
+	// strtod also takes hex, infinities and leading spaces, none of which are JSON
+	if (strchr("-0123456789", value.ptr[0]) == NULL || memchr(value.ptr, 'x', value.len) != NULL || memchr(value.ptr, 'X', value.len) != NULL)
+		return -1;
+	memcpy(buf, value.ptr, value.len);
+	buf[value.len] = '\0';
+
+	char* end;
+	const double parsed = strtod(buf, &end);
+	if (end != buf + value.len || !isfinite(parsed))
+		return -1;
+	*out = parsed;
+	return 0;
+}
@@ -0,0 +1,78 @@
+/** Leveled logging over Log_Debug with a compile time floor and per module runtime levels */
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <stdatomic.h>
+
+#include <applibs/log.h>
+
+#define LOG_LEVEL_OFF 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+// least severe level compiled in, every site above it compiles to nothing (set per build type in CMakeLists.txt)
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+typedef enum {
+	LogModule_App = 0,
+	LogModule_Sensors = 1,
+	LogModule_Loop = 2,
+	LogModule_Count
+} log_module_t;
+
+// a source file picks its module by defining LOG_MODULE before including this header
+#ifndef LOG_MODULE
+#define LOG_MODULE LogModule_App
+#endif
+
+extern atomic_int _log_module_levels[LogModule_Count];
+
+/// Set the runtime level of a module, it cannot raise a module past LOG_MIN_LEVEL. Returns -1 on a bad module.
+int LogSetModuleLevel(log_module_t module, int level);
+int LogModuleLevel(log_module_t module);
+const char* LogLevelName(int level);
+
+#define _LOG_AT(level, ...) do { \
+	if ((level) <= atomic_load_explicit(&_log_module_levels[LOG_MODULE], memory_order_relaxed)) \
+		Log_Debug(__VA_ARGS__); \
+} while (0)
+// keeps the format checked without emitting any code or evaluating the arguments
+#define _LOG_OFF(...) do { if (0) Log_Debug(__VA_ARGS__); } while (0)
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) _LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) _LOG_OFF(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) _LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) _LOG_OFF(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) _LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) _LOG_OFF(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) _LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) _LOG_OFF(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) _LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) _LOG_OFF(__VA_ARGS__)
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+#include "logging.h"
+
+atomic_int _log_module_levels[LogModule_Count] = {
+	[LogModule_App] = LOG_MIN_LEVEL,
+	[LogModule_Sensors] = LOG_MIN_LEVEL,
+	[LogModule_Loop] = LOG_MIN_LEVEL,
+};
+
+int LogSetModuleLevel(log_module_t module, int level) {
+	if ((unsigned int)module >= LogModule_Count)
+		return -1;
+	if (level < LOG_LEVEL_OFF)
+		level = LOG_LEVEL_OFF;
+	if (level > LOG_MIN_LEVEL)
+		level = LOG_MIN_LEVEL;
+	atomic_store_explicit(&_log_module_levels[module], level, memory_order_relaxed);
+	return 0;
+}
+
+int LogModuleLevel(log_module_t module) {
+	if ((unsigned int)module >= LogModule_Count)
+		return LOG_LEVEL_OFF;
+	return atomic_load_explicit(&_log_module_levels[module], memory_order_relaxed);
+}
+
+const char* LogLevelName(int level) {
+	switch (level) {
+	case LOG_LEVEL_OFF: return "off";
+	case LOG_LEVEL_ERROR: return "error";
+	case LOG_LEVEL_WARN: return "warn";
+	case LOG_LEVEL_INFO: return "info";
+	case LOG_LEVEL_DEBUG: return "debug";
+	case LOG_LEVEL_TRACE: return "trace";
+	default: return "?";
+	}
+}
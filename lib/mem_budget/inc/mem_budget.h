@@ -0,0 +1,40 @@
+/** Tagged heap accounting so memory use can be attributed to subsystems */
+
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+	MemTag_EventLoop = 0, // timers and events from the event loop helpers
+	MemTag_Deque = 1, // packet queues and rings
+	MemTag_Payload = 2, // telemetry payload slabs and their heap fallback
+	MemTag_Count
+} mem_tag_t;
+
+typedef struct {
+	size_t current_bytes;
+	size_t peak_bytes;
+	uint32_t allocs;
+} mem_budget_tag_stats_t;
+
+typedef struct {
+	size_t total_kb;
+	size_t user_kb;
+	size_t peak_user_kb;
+	size_t untracked_kb; // user mode usage not attributed to any tag, dominated by the IoT SDK
+} mem_budget_process_t;
+
+void* MemBudgetAlloc(mem_tag_t tag, size_t size);
+void* MemBudgetCalloc(mem_tag_t tag, size_t count, size_t size);
+void* MemBudgetRealloc(mem_tag_t tag, void* ptr, size_t size);
+/// Free a buffer from any of the MemBudget allocators, the tag is remembered per allocation. Safe to call with NULL.
+void MemBudgetFree(void* ptr);
+
+mem_budget_tag_stats_t MemBudgetTagStats(mem_tag_t tag);
+const char* MemBudgetTagName(mem_tag_t tag);
+/// Read the OS counters for this application, including the peak user mode usage.
+mem_budget_process_t MemBudgetSampleProcess(void);
+
+#endif
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <applibs/applications.h>
+
+#include "mem_budget.h"
+
+// prepended to every allocation, sized to keep the returned pointer 8 byte aligned
+typedef struct {
+	uint32_t size;
+	uint32_t tag;
+} mem_header_t;
+
+typedef struct {
+	atomic_size_t current_bytes;
+	atomic_size_t peak_bytes;
+	atomic_uint allocs;
+} tag_counters_t;
+
+static tag_counters_t counters[MemTag_Count];
+
+static void account_alloc(mem_tag_t tag, size_t size) {
+	tag_counters_t* c = &counters[tag];
+	size_t now = atomic_fetch_add(&c->current_bytes, size) + size;
+	size_t peak = atomic_load(&c->peak_bytes);
+	while (now > peak && !atomic_compare_exchange_weak(&c->peak_bytes, &peak, now))
+		;
+	atomic_fetch_add(&c->allocs, 1);
+}
+
+static void account_free(mem_tag_t tag, size_t size) {
+	atomic_fetch_sub(&counters[tag].current_bytes, size);
+}
+
+void* MemBudgetAlloc(mem_tag_t tag, size_t size) {
+	mem_header_t* header = malloc(sizeof(mem_header_t) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = (uint32_t)size;
+	header->tag = (uint32_t)tag;
+	account_alloc(tag, size);
+	return header + 1;
+}
+
+void* MemBudgetCalloc(mem_tag_t tag, size_t count, size_t size) {
+	if (size != 0 && count > SIZE_MAX / size)
+		return NULL;
+	void* ptr = MemBudgetAlloc(tag, count * size);
+	if (ptr != NULL)
+		memset(ptr, 0, count * size);
+	return ptr;
+}
+
+void* MemBudgetRealloc(mem_tag_t tag, void* ptr, size_t size) {
+	if (ptr == NULL)
+		return MemBudgetAlloc(tag, size);
+
+	mem_header_t* header = (mem_header_t*)ptr - 1;
+	const size_t old_size = header->size;
+	const mem_tag_t old_tag = (mem_tag_t)header->tag;
+	mem_header_t* resized = realloc(header, sizeof(mem_header_t) + size);
+	if (resized == NULL)
+		return NULL;
+	account_free(old_tag, old_size);
+	resized->size = (uint32_t)size;
+	resized->tag = (uint32_t)tag;
+	account_alloc(tag, size);
+	return resized + 1;
+}
+
+void MemBudgetFree(void* ptr) {
+	if (ptr == NULL)
+		return;
+	mem_header_t* header = (mem_header_t*)ptr - 1;
+	account_free((mem_tag_t)header->tag, header->size);
+	free(header);
+}
+
+mem_budget_tag_stats_t MemBudgetTagStats(mem_tag_t tag) {
+	mem_budget_tag_stats_t ret = {
+		.current_bytes = atomic_load(&counters[tag].current_bytes),
+		.peak_bytes = atomic_load(&counters[tag].peak_bytes),
+		.allocs = atomic_load(&counters[tag].allocs)
+	};
+	return ret;
+}
+
+const char* MemBudgetTagName(mem_tag_t tag) {
+	switch (tag) {
+	case MemTag_EventLoop: return "event_loop";
+	case MemTag_Deque: return "deque";
+	case MemTag_Payload: return "payload";
+	default: return "unknown";
+	}
+}
+
+mem_budget_process_t MemBudgetSampleProcess(void) {
+	mem_budget_process_t ret = {
+		.total_kb = Applications_GetTotalMemoryUsageInKB(),
+		.user_kb = Applications_GetUserModeMemoryUsageInKB(),
+		.peak_user_kb = Applications_GetPeakUserModeMemoryUsageInKB(),
+		.untracked_kb = 0
+	};
+
+	size_t tracked_bytes = 0;
+	for (int tag = 0; tag < MemTag_Count; tag++)
+		tracked_bytes += atomic_load(&counters[tag].current_bytes);
+	const size_t tracked_kb = tracked_bytes / 1024;
+	if (ret.user_kb > tracked_kb)
+		ret.untracked_kb = ret.user_kb - tracked_kb;
+	return ret;
+}
@@ -0,0 +1,43 @@
+/** Persist queued payloads and resume state in mutable storage across a system power down */
+
+#ifndef OUTBOX_STORE_H
+#define OUTBOX_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Largest store OutboxStoreLoad accepts, keep the MutableStorage size in app_manifest.json above it.
+#define OUTBOX_STORE_MAX_BYTES (48 * 1024)
+#define OUTBOX_RESUME_CHANNELS 8
+
+typedef struct {
+	int64_t saved_at; // wall clock second of the save
+	int64_t next_upload; // wall clock second the next upload is due, 0 for none
+	uint32_t sample_count; // samples taken so far, keeps per sample cadences going across power downs
+	uint32_t power_downs;
+	uint32_t alerts_active; // alert rules raised at the save, not raised a second time after the wake
+	// the last reported channel values, so report by exception keeps its reference across the wake
+	uint32_t reported_valid;
+	double reported[OUTBOX_RESUME_CHANNELS];
+	uint32_t reported_sample; // sample_count of the last reported sample
+	uint32_t suppressed; // samples held back so far
+	uint32_t sample_interval_s; // the tuned interval, the wake goes on sampling at it
+	uint32_t alert_count; // the first alert_count payloads are alerts still to send
+} outbox_resume_t;
+
+typedef void (*outbox_payload_fn)(const char* payload, size_t len, int64_t queued_at, void* ctx);
+
+/// Replace the store with resume and the payload strings, each with the wall clock second it was queued. Only the header and the records from the first
+/// byte that differs from the stored ones are written, so saving an unchanged or grown queue spares the flash.
+/// Returns -1 on failure, the store is then unusable.
+int OutboxStoreSave(int fd, const outbox_resume_t* resume, const char* const* payloads, const int64_t* queued_at, size_t count);
+/// Hand every stored payload and its queue time to fn, in the order saved. They are not NUL terminated.
+/// Returns the payload count, or -1 if the store is empty, corrupt or from another layout.
+int OutboxStoreLoad(int fd, outbox_resume_t* resume_out, outbox_payload_fn fn, void* ctx);
+/// How many payloads of up to payload_max_len bytes are sure to fit in one save.
+size_t OutboxStoreCapacity(size_t payload_max_len);
+/// Empty the store so a later boot does not replay it. The records stay behind, marked consumed, for the next
+/// OutboxStoreSave to compare against.
+int OutboxStoreClear(int fd);
+
+#endif
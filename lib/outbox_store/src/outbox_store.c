@@ -0,0 +1,212 @@
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mem_budget.h"
+#include "outbox_store.h"
+
+// bumped whenever the layout below changes, older stores are then ignored
+#define OUTBOX_STORE_MAGIC 0x504d5107U
+// stored records are read back this much at a time to find what a save can leave in place
+#define OUTBOX_STORE_COMPARE_CHUNK 512
+
+// header, then count records of a uint16_t length and an int64_t queue time followed by the payload bytes. Records already on
+// flash are not written again, a save only writes from the first byte that differs plus the header
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t body_bytes;
+	uint32_t body_checksum; // FNV-1a over the records
+	uint32_t consumed; // loaded already, the records are only kept for the next save to compare against
+	outbox_resume_t resume;
+	uint32_t checksum; // FNV-1a over the header up to here
+} store_header_t;
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static uint32_t header_checksum(const store_header_t* header) {
+	return fnv1a(2166136261U, (const uint8_t*)header, offsetof(store_header_t, checksum));
+}
+
+static int write_all(int fd, const uint8_t* data, size_t len, off_t offset) {
+	while (len > 0) {
+		ssize_t ret = pwrite(fd, data, len, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += ret;
+		len -= (size_t)ret;
+		offset += ret;
+	}
+	return 0;
+}
+
+static int read_all(int fd, uint8_t* data, size_t len, off_t offset) {
+	while (len > 0) {
+		ssize_t ret = pread(fd, data, len, offset);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		data += ret;
+		len -= (size_t)ret;
+		offset += ret;
+	}
+	return 0;
+}
+
+// the header as stored, 0 only when it is intact and of this layout
+static int read_header(int fd, store_header_t* header, size_t* file_bytes) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(store_header_t) || st.st_size > OUTBOX_STORE_MAX_BYTES)
+		return -1;
+	*file_bytes = (size_t)st.st_size;
+	if (read_all(fd, (uint8_t*)header, sizeof(*header), 0) != 0)
+		return -1;
+	return header->magic == OUTBOX_STORE_MAGIC && header->checksum == header_checksum(header) ? 0 : -1;
+}
+
+// how many of the first limit bytes of body are already stored after the header
+static size_t stored_prefix(int fd, const uint8_t* body, size_t limit) {
+	uint8_t chunk[OUTBOX_STORE_COMPARE_CHUNK];
+	size_t same = 0;
+	while (same < limit) {
+		const size_t len = limit - same < sizeof(chunk) ? limit - same : sizeof(chunk);
+		if (read_all(fd, chunk, len, (off_t)(sizeof(store_header_t) + same)) != 0)
+			return same;
+		for (size_t i = 0; i < len; i++) {
+			if (chunk[i] != body[same + i])
+				return same + i;
+		}
+		same += len;
+	}
+	return same;
+}
+
+// a record is its length, queue time and payload bytes
+#define RECORD_HEADER_BYTES (sizeof(uint16_t) + sizeof(int64_t))
+
+int OutboxStoreSave(int fd, const outbox_resume_t* resume, const char* const* payloads, const int64_t* queued_at, size_t count) {
+	size_t body_bytes = 0;
+	for (size_t i = 0; i < count; i++) {
+		const size_t len = strlen(payloads[i]);
+		if (len > UINT16_MAX) {
+			errno = EINVAL;
+			return -1;
+		}
+		body_bytes += RECORD_HEADER_BYTES + len;
+	}
+	if (sizeof(store_header_t) + body_bytes > OUTBOX_STORE_MAX_BYTES) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	uint8_t* body = MemBudgetAlloc(MemTag_Payload, body_bytes + 1);
+	if (body == NULL)
+		return -1;
+	uint8_t* p = body;
+	for (size_t i = 0; i < count; i++) {
+		const uint16_t len = (uint16_t)strlen(payloads[i]);
+		memcpy(p, &len, sizeof(len));
+		memcpy(p + sizeof(len), &queued_at[i], sizeof(queued_at[i]));
+		memcpy(p + RECORD_HEADER_BYTES, payloads[i], len);
+		p += RECORD_HEADER_BYTES + len;
+	}
+
+	// zeroed first so the padding the checksum covers is too
+	store_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = OUTBOX_STORE_MAGIC;
+	header.count = (uint32_t)count;
+	header.body_bytes = (uint32_t)body_bytes;
+	header.body_checksum = fnv1a(2166136261U, body, body_bytes);
+	header.resume = *resume;
+	header.checksum = header_checksum(&header);
+
+	// a queue that only grew, or did not change at all, leaves the stored records where they are.
+	// The header goes last, until then a crash leaves a store that fails its checksums
+	struct stat st;
+	const size_t old_bytes = fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(header) ? (size_t)st.st_size - sizeof(header) : 0;
+	const size_t keep = stored_prefix(fd, body, old_bytes < body_bytes ? old_bytes : body_bytes);
+
+	int ret = -1;
+	if (write_all(fd, body + keep, body_bytes - keep, (off_t)(sizeof(header) + keep)) == 0
+		&& write_all(fd, (const uint8_t*)&header, sizeof(header), 0) == 0
+		&& (old_bytes <= body_bytes || ftruncate(fd, (off_t)(sizeof(header) + body_bytes)) == 0))
+		ret = fsync(fd);
+	MemBudgetFree(body);
+	return ret;
+}
+
+int OutboxStoreLoad(int fd, outbox_resume_t* resume_out, outbox_payload_fn fn, void* ctx) {
+	store_header_t header;
+	size_t file_bytes;
+	if (read_header(fd, &header, &file_bytes) != 0 || header.consumed || header.body_bytes > file_bytes - sizeof(header))
+		return -1;
+
+	uint8_t* body = MemBudgetAlloc(MemTag_Payload, header.body_bytes + 1);
+	if (body == NULL)
+		return -1;
+	int ret = -1;
+	if (read_all(fd, body, header.body_bytes, sizeof(header)) != 0 || header.body_checksum != fnv1a(2166136261U, body, header.body_bytes))
+		goto done;
+
+	// validate every record before handing out any, so a bad store is rejected as a whole
+	const uint8_t* end = body + header.body_bytes;
+	const uint8_t* p = body;
+	for (uint32_t i = 0; i < header.count; i++) {
+		uint16_t len;
+		if ((size_t)(end - p) < RECORD_HEADER_BYTES)
+			goto done;
+		memcpy(&len, p, sizeof(len));
+		if ((size_t)(end - p) < RECORD_HEADER_BYTES + len)
+			goto done;
+		p += RECORD_HEADER_BYTES + len;
+	}
+	if (p != end)
+		goto done;
+
+	*resume_out = header.resume;
+	for (p = body; p < end;) {
+		uint16_t len;
+		int64_t queued_at;
+		memcpy(&len, p, sizeof(len));
+		memcpy(&queued_at, p + sizeof(len), sizeof(queued_at));
+		fn((const char*)p + RECORD_HEADER_BYTES, len, queued_at, ctx);
+		p += RECORD_HEADER_BYTES + len;
+	}
+	ret = (int)header.count;
+
+done:
+	MemBudgetFree(body);
+	return ret;
+}
+
+int OutboxStoreClear(int fd) {
+	store_header_t header;
+	size_t file_bytes;
+	if (read_header(fd, &header, &file_bytes) != 0)
+		return ftruncate(fd, 0) == 0 ? fsync(fd) : -1;
+	if (header.consumed)
+		return 0;
+
+	header.consumed = 1;
+	header.checksum = header_checksum(&header);
+	if (write_all(fd, (const uint8_t*)&header, sizeof(header), 0) != 0)
+		return -1;
+	return fsync(fd);
+}
+
+size_t OutboxStoreCapacity(size_t payload_max_len) {
+	return (OUTBOX_STORE_MAX_BYTES - sizeof(store_header_t)) / (RECORD_HEADER_BYTES + payload_max_len);
+}
@@ -0,0 +1,37 @@
+/** Fixed-size slab allocator for telemetry payload buffers */
+
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	uint32_t hits; // allocations served from a pooled slab
+	uint32_t misses; // allocations that fell back to the heap, the pool was empty or the buffer larger than a slab
+	uint32_t in_use; // buffers currently borrowed
+	uint32_t high_water; // most buffers ever borrowed at once
+} slab_pool_stats_t;
+
+typedef struct {
+	uint8_t* _slabs;
+	size_t _slab_size;
+	size_t _slab_count;
+	void* _free_list;
+	slab_pool_stats_t _stats;
+} slab_pool_t;
+
+/// Allocate slab_count buffers of slab_size bytes up front. Returns -1 on allocation failure.
+int SlabPoolInit(slab_pool_t* pool, size_t slab_size, size_t slab_count);
+/// Borrow a slab, falling back to the heap (and counting a miss) when the pool is exhausted.
+void* SlabPoolAlloc(slab_pool_t* pool);
+/// Borrow at least size bytes, a slab when they fit and otherwise a heap buffer counted as a miss.
+void* SlabPoolAllocSize(slab_pool_t* pool, size_t size);
+/// Return a buffer obtained from SlabPoolAlloc or SlabPoolAllocSize. Safe to call with NULL.
+void SlabPoolFree(slab_pool_t* pool, void* slab);
+size_t SlabPoolSlabSize(const slab_pool_t* pool);
+slab_pool_stats_t SlabPoolStats(const slab_pool_t* pool);
+void SlabPoolDestroy(slab_pool_t* pool);
+
+#endif
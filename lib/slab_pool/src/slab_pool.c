@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem_budget.h"
+#include "slab_pool.h"
+
+// free slabs are chained through their first bytes, so no bookkeeping memory is needed
+typedef struct free_slab {
+	struct free_slab* next;
+} free_slab_t;
+
+static bool is_pooled(const slab_pool_t* pool, const void* slab) {
+	const uint8_t* p = (const uint8_t*)slab;
+	return p >= pool->_slabs && p < pool->_slabs + pool->_slab_size * pool->_slab_count;
+}
+
+int SlabPoolInit(slab_pool_t* pool, size_t slab_size, size_t slab_count) {
+	memset(pool, 0, sizeof(*pool));
+	if (slab_size < sizeof(free_slab_t))
+		slab_size = sizeof(free_slab_t);
+	// keep every slab pointer-aligned
+	slab_size = (slab_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+	pool->_slabs = MemBudgetAlloc(MemTag_Payload, slab_size * slab_count);
+	if (pool->_slabs == NULL && slab_count > 0)
+		return -1;
+	pool->_slab_size = slab_size;
+	pool->_slab_count = slab_count;
+
+	for (size_t i = slab_count; i > 0; i--) {
+		free_slab_t* slab = (free_slab_t*)(pool->_slabs + (i - 1) * slab_size);
+		slab->next = pool->_free_list;
+		pool->_free_list = slab;
+	}
+	return 0;
+}
+
+static void* borrowed(slab_pool_t* pool, void* buf) {
+	pool->_stats.in_use++;
+	if (pool->_stats.in_use > pool->_stats.high_water)
+		pool->_stats.high_water = pool->_stats.in_use;
+	return buf;
+}
+
+static void* heap_fallback(slab_pool_t* pool, size_t size) {
+	void* ret = MemBudgetAlloc(MemTag_Payload, size);
+	if (ret == NULL)
+		return NULL;
+	pool->_stats.misses++;
+	return borrowed(pool, ret);
+}
+
+void* SlabPoolAlloc(slab_pool_t* pool) {
+	if (pool->_free_list == NULL)
+		return heap_fallback(pool, pool->_slab_size);
+
+	free_slab_t* slab = (free_slab_t*)pool->_free_list;
+	pool->_free_list = slab->next;
+	pool->_stats.hits++;
+	return borrowed(pool, slab);
+}
+
+void* SlabPoolAllocSize(slab_pool_t* pool, size_t size) {
+	// SlabPoolFree tells the two apart by address, so an oversized buffer needs no marking
+	return size <= pool->_slab_size ? SlabPoolAlloc(pool) : heap_fallback(pool, size);
+}
+
+void SlabPoolFree(slab_pool_t* pool, void* slab) {
+	if (slab == NULL)
+		return;
+
+	pool->_stats.in_use--;
+	if (is_pooled(pool, slab)) {
+		free_slab_t* free_slab = (free_slab_t*)slab;
+		free_slab->next = pool->_free_list;
+		pool->_free_list = free_slab;
+	}
+	else
+		MemBudgetFree(slab);
+}
+
+size_t SlabPoolSlabSize(const slab_pool_t* pool) { return pool->_slab_size; }
+
+slab_pool_stats_t SlabPoolStats(const slab_pool_t* pool) { return pool->_stats; }
+
+void SlabPoolDestroy(slab_pool_t* pool) {
+	MemBudgetFree(pool->_slabs);
+	memset(pool, 0, sizeof(*pool));
+}
@@ -0,0 +1,37 @@
+/** Lock-free single-producer/single-consumer ring of fixed-size records */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPSC_RING_CACHE_LINE 64
+
+typedef struct {
+	// producer side
+	alignas(SPSC_RING_CACHE_LINE) atomic_size_t _tail;
+	uint32_t _drops;
+	// consumer side
+	alignas(SPSC_RING_CACHE_LINE) atomic_size_t _head;
+	// immutable after init
+	alignas(SPSC_RING_CACHE_LINE) uint8_t* _buf;
+	size_t _elem_size;
+	size_t _mask;
+} spsc_ring_t;
+
+/// capacity is rounded up to a power of two. Returns -1 on allocation failure.
+int SpscRingInit(spsc_ring_t* ring, size_t elem_size, size_t capacity);
+/// Producer only. Returns false, and counts a drop, when the ring is full.
+bool SpscRingPush(spsc_ring_t* ring, const void* elem);
+/// Consumer only. Returns false when the ring is empty.
+bool SpscRingPop(spsc_ring_t* ring, void* out);
+size_t SpscRingCount(spsc_ring_t* ring);
+/// Producer only.
+uint32_t SpscRingDrops(const spsc_ring_t* ring);
+void SpscRingDestroy(spsc_ring_t* ring);
+
+#endif
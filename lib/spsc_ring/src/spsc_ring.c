@@ -0,0 +1,58 @@
+#include <string.h>
+
+#include "mem_budget.h"
+#include "spsc_ring.h"
+
+int SpscRingInit(spsc_ring_t* ring, size_t elem_size, size_t capacity) {
+	size_t rounded = 1;
+	while (rounded < capacity)
+		rounded <<= 1;
+
+	ring->_buf = MemBudgetAlloc(MemTag_Deque, elem_size * rounded);
+	if (ring->_buf == NULL)
+		return -1;
+	ring->_elem_size = elem_size;
+	ring->_mask = rounded - 1;
+	ring->_drops = 0;
+	atomic_init(&ring->_head, 0);
+	atomic_init(&ring->_tail, 0);
+	return 0;
+}
+
+bool SpscRingPush(spsc_ring_t* ring, const void* elem) {
+	const size_t tail = atomic_load_explicit(&ring->_tail, memory_order_relaxed);
+	const size_t head = atomic_load_explicit(&ring->_head, memory_order_acquire);
+	if (tail - head > ring->_mask) {
+		ring->_drops++;
+		return false;
+	}
+
+	memcpy(ring->_buf + (tail & ring->_mask) * ring->_elem_size, elem, ring->_elem_size);
+	// publish the record before the consumer can observe the new tail
+	atomic_store_explicit(&ring->_tail, tail + 1, memory_order_release);
+	return true;
+}
+
+bool SpscRingPop(spsc_ring_t* ring, void* out) {
+	const size_t head = atomic_load_explicit(&ring->_head, memory_order_relaxed);
+	const size_t tail = atomic_load_explicit(&ring->_tail, memory_order_acquire);
+	if (head == tail)
+		return false;
+
+	memcpy(out, ring->_buf + (head & ring->_mask) * ring->_elem_size, ring->_elem_size);
+	// hand the slot back to the producer only once it has been copied out
+	atomic_store_explicit(&ring->_head, head + 1, memory_order_release);
+	return true;
+}
+
+size_t SpscRingCount(spsc_ring_t* ring) {
+	return atomic_load_explicit(&ring->_tail, memory_order_acquire)
+		- atomic_load_explicit(&ring->_head, memory_order_acquire);
+}
+
+uint32_t SpscRingDrops(const spsc_ring_t* ring) { return ring->_drops; }
+
+void SpscRingDestroy(spsc_ring_t* ring) {
+	MemBudgetFree(ring->_buf);
+	ring->_buf = NULL;
+}
@@ -0,0 +1,45 @@
+/** Binary trace ring: fixed size records written without formatting, decoded on demand */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_RING_RECORDS 512 // power of two
+
+// X(name, arg0, arg1, arg2), the argument names are only used when dumping
+#define TRACE_IDS(X) \
+	X(None, -, -, -) \
+	X(StateTransition, from, to, -) \
+	X(SampleQueued, time, outbound, bytes) \
+	X(MessageSent, in_flight, outbound, -) \
+	X(SendConfirmed, result, in_flight, -) \
+	X(I2CWriteFail, addr, reg, err) \
+	X(I2CReadFail, addr, reg, err) \
+	X(MailboxDrop, type, -, -) \
+	X(PowerDown, residency_s, persisted, -) \
+	X(AlertQueued, rule, raised, pending) \
+	X(Panic, code, -, -)
+
+#define _TRACE_ENUM(name, a0, a1, a2) TraceId_##name,
+typedef enum {
+	TRACE_IDS(_TRACE_ENUM)
+	TraceId_Count
+} trace_id_t;
+#undef _TRACE_ENUM
+
+typedef struct {
+	uint64_t ts_us; // CLOCK_MONOTONIC
+	uint32_t id;
+	uint32_t args[3];
+} trace_record_t;
+
+/// Safe from any thread, never blocks or allocates.
+void TraceRecord(trace_id_t id, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+/// Copy out up to max records, oldest first. Records written concurrently may be torn.
+size_t TraceSnapshot(trace_record_t* out, size_t max);
+/// Format the ring through Log_Debug, oldest first.
+void TraceDump(void);
+
+#endif
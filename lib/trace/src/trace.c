@@ -0,0 +1,51 @@
+#include <stdatomic.h>
+#include <time.h>
+
+#include <applibs/log.h>
+
+#include "trace.h"
+
+#define _TRACE_NAME(name, a0, a1, a2) { #name, #a0, #a1, #a2 },
+static const char* const trace_names[TraceId_Count][4] = {
+	TRACE_IDS(_TRACE_NAME)
+};
+#undef _TRACE_NAME
+
+static trace_record_t ring[TRACE_RING_RECORDS];
+static atomic_uint_fast32_t next_record = 0;
+
+void TraceRecord(trace_id_t id, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const uint32_t slot = (uint32_t)atomic_fetch_add_explicit(&next_record, 1, memory_order_relaxed) & (TRACE_RING_RECORDS - 1);
+	trace_record_t* record = &ring[slot];
+	record->ts_us = (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+	record->id = id;
+	record->args[0] = arg0;
+	record->args[1] = arg1;
+	record->args[2] = arg2;
+}
+
+size_t TraceSnapshot(trace_record_t* out, size_t max) {
+	const uint32_t end = (uint32_t)atomic_load_explicit(&next_record, memory_order_relaxed);
+	uint32_t count = end < TRACE_RING_RECORDS ? end : TRACE_RING_RECORDS;
+	if (count > max)
+		count = (uint32_t)max;
+	for (uint32_t i = 0; i < count; i++)
+		out[i] = ring[(end - count + i) & (TRACE_RING_RECORDS - 1)];
+	return count;
+}
+
+void TraceDump(void) {
+	const uint32_t end = (uint32_t)atomic_load_explicit(&next_record, memory_order_relaxed);
+	const uint32_t count = end < TRACE_RING_RECORDS ? end : TRACE_RING_RECORDS;
+	Log_Debug("Trace: last %u of %u records\n", count, end);
+	for (uint32_t i = 0; i < count; i++) {
+		const trace_record_t* record = &ring[(end - count + i) & (TRACE_RING_RECORDS - 1)];
+		const uint32_t id = record->id < TraceId_Count ? record->id : TraceId_None;
+		const char* const* names = trace_names[id];
+		Log_Debug("%llu.%06llu %s %s=%u %s=%u %s=%u\n",
+			(unsigned long long)(record->ts_us / 1000000), (unsigned long long)(record->ts_us % 1000000), names[0],
+			names[1], record->args[0], names[2], record->args[1], names[3], record->args[2]);
+	}
+}
@@ -0,0 +1,50 @@
+/** Picks the delay to the next upload from backlog depth, link quality and a latency objective */
+
+#ifndef UPLOAD_PACER_H
+#define UPLOAD_PACER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	uint32_t min_interval_s; // never upload more often than this
+	uint32_t max_interval_s; // idle ceiling
+	uint32_t latency_slo_s; // the oldest queued message must be uploaded within this
+	uint32_t slack_s; // how late the upload timer may fire, taken off the objective
+	size_t batch_max; // messages sent per upload, a deeper backlog drains at min_interval_s
+	uint32_t slow_ack_ms; // acks slower than this stretch the interval to batch more per connection
+} upload_pacer_config_t;
+
+typedef struct {
+	uint32_t interval_s; // last interval chosen
+	uint32_t ack_ewma_ms;
+	uint32_t acks;
+	uint32_t failures; // failed confirmations in total
+	uint32_t slo_misses; // uploads that started after the oldest message was due
+} upload_pacer_stats_t;
+
+typedef struct {
+	upload_pacer_config_t _config;
+	double _ack_ewma_ms;
+	uint32_t _consecutive_failures;
+	upload_pacer_stats_t _stats;
+} upload_pacer_t;
+
+void UploadPacerInit(upload_pacer_t* pacer, const upload_pacer_config_t* config);
+/// Change the configuration keeping the link statistics, the next UploadPacerNextS uses it.
+void UploadPacerSetConfig(upload_pacer_t* pacer, const upload_pacer_config_t* config);
+upload_pacer_config_t UploadPacerConfig(const upload_pacer_t* pacer);
+/// Feed every send confirmation, latency_ms is from the send to the confirmation.
+void UploadPacerAck(upload_pacer_t* pacer, uint32_t latency_ms, bool ok);
+/// Call when an upload starts, to count objective misses.
+void UploadPacerUploadStarted(upload_pacer_t* pacer, uint32_t oldest_age_s);
+/// Seconds to the next upload, given the messages still queued and the age of the oldest (0 when empty).
+/// With nothing queued the interval stretches to max_interval_s, the caller brings the upload in to
+/// UploadPacerDueS once a message is queued.
+uint32_t UploadPacerNextS(upload_pacer_t* pacer, size_t backlog, uint32_t oldest_age_s);
+/// Seconds from now to the upload a message queued age_s ago needs, within the objective unless the link is backing off.
+uint32_t UploadPacerDueS(const upload_pacer_t* pacer, uint32_t age_s);
+upload_pacer_stats_t UploadPacerStats(const upload_pacer_t* pacer);
+
+#endif
@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "upload_pacer.h"
+
+// weight of the newest ack latency, about the last ten acks dominate
+#define ACK_EWMA_ALPHA 0.2
+// consecutive failures past this no longer double the interval
+#define MAX_FAILURE_DOUBLINGS 6
+
+void UploadPacerSetConfig(upload_pacer_t* pacer, const upload_pacer_config_t* config) {
+	pacer->_config = *config;
+	if (pacer->_config.min_interval_s == 0)
+		pacer->_config.min_interval_s = 1;
+	if (pacer->_config.max_interval_s < pacer->_config.min_interval_s)
+		pacer->_config.max_interval_s = pacer->_config.min_interval_s;
+	if (pacer->_config.batch_max == 0)
+		pacer->_config.batch_max = 1;
+}
+
+void UploadPacerInit(upload_pacer_t* pacer, const upload_pacer_config_t* config) {
+	memset(pacer, 0, sizeof(*pacer));
+	UploadPacerSetConfig(pacer, config);
+	pacer->_stats.interval_s = pacer->_config.max_interval_s;
+}
+
+void UploadPacerAck(upload_pacer_t* pacer, uint32_t latency_ms, bool ok) {
+	if (!ok) {
+		pacer->_consecutive_failures++;
+		pacer->_stats.failures++;
+		return;
+	}
+	pacer->_consecutive_failures = 0;
+	if (pacer->_stats.acks == 0)
+		pacer->_ack_ewma_ms = latency_ms;
+	else
+		pacer->_ack_ewma_ms += ACK_EWMA_ALPHA * ((double)latency_ms - pacer->_ack_ewma_ms);
+	pacer->_stats.acks++;
+	pacer->_stats.ack_ewma_ms = (uint32_t)pacer->_ack_ewma_ms;
+}
+
+void UploadPacerUploadStarted(upload_pacer_t* pacer, uint32_t oldest_age_s) {
+	if (oldest_age_s > pacer->_config.latency_slo_s)
+		pacer->_stats.slo_misses++;
+}
+
+static uint32_t next_interval(const upload_pacer_t* pacer, size_t backlog, uint32_t oldest_age_s) {
+	const upload_pacer_config_t* config = &pacer->_config;
+	uint32_t interval = config->max_interval_s;
+
+	// the oldest message must go out within the objective. An empty queue idles up to max_interval_s,
+	// the caller brings the upload in once something is queued
+	if (backlog > 0) {
+		const uint32_t spent = oldest_age_s + config->slack_s;
+		const uint32_t slo_left = spent < config->latency_slo_s ? config->latency_slo_s - spent : 0;
+		if (slo_left < interval)
+			interval = slo_left;
+	}
+
+	// more than a batch left over, keep draining
+	if (backlog > 0 && backlog >= config->batch_max)
+		interval = config->min_interval_s;
+
+	// a slow link makes every upload expensive, so send fewer, larger batches
+	if (config->slow_ack_ms > 0 && pacer->_stats.acks > 0) {
+		const uint64_t stretched = (uint64_t)config->min_interval_s * (1 + (uint64_t)pacer->_ack_ewma_ms / config->slow_ack_ms);
+		if (stretched > interval)
+			interval = stretched < config->max_interval_s ? (uint32_t)stretched : config->max_interval_s;
+	}
+
+	// failing sends back off exponentially, draining into a broken link only requeues everything
+	if (pacer->_consecutive_failures > 0) {
+		const uint32_t doublings = pacer->_consecutive_failures < MAX_FAILURE_DOUBLINGS ? pacer->_consecutive_failures : MAX_FAILURE_DOUBLINGS;
+		const uint64_t backed_off = (uint64_t)config->min_interval_s << doublings;
+		if (backed_off > interval)
+			interval = backed_off < config->max_interval_s ? (uint32_t)backed_off : config->max_interval_s;
+	}
+
+	if (interval < config->min_interval_s)
+		interval = config->min_interval_s;
+	return interval;
+}
+
+uint32_t UploadPacerNextS(upload_pacer_t* pacer, size_t backlog, uint32_t oldest_age_s) {
+	pacer->_stats.interval_s = next_interval(pacer, backlog, oldest_age_s);
+	return pacer->_stats.interval_s;
+}
+
+uint32_t UploadPacerDueS(const upload_pacer_t* pacer, uint32_t age_s) { return next_interval(pacer, 1, age_s); }
+
+upload_pacer_stats_t UploadPacerStats(const upload_pacer_t* pacer) { return pacer->_stats; }
+
+upload_pacer_config_t UploadPacerConfig(const upload_pacer_t* pacer) { return pacer->_config; }
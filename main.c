@@ -2,12 +2,14 @@
 // installation of the device and SDK succeeded, and that you can build, deploy, and debug an app.
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <time.h>
 #include <signal.h>
 #include <sys/eventfd.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include <applibs/log.h>
 #include <applibs/gpio.h>
@@ -16,6 +18,7 @@
 #include <applibs/adc.h>
 #include <applibs/networking.h>
 #include <applibs/eventloop.h>
+#include <applibs/storage.h>
 #include <hw/plant_sk.h>
 
 #include <iothub_client_core_common.h>
@@ -31,28 +34,126 @@
 
 #include "event_loop_event.h"
 #include "event_loop_timer.h"
+#include "event_mailbox.h"
+#include "handler_stats.h"
+#include "coroutine.h"
+#include "adc_window.h"
+#include "flicker.h"
+#include "i2c_metrics.h"
+#include "trace.h"
+#include "logging.h"
 #include "climatesensor.h"
 #include "chirp.h"
 #include "humidity.h"
+#include "slab_pool.h"
+#include "mem_budget.h"
+#include "spsc_ring.h"
+#include "outbox_store.h"
+#include "deep_sleep.h"
+#include "backoff.h"
+#include "idle_backoff.h"
+#include "upload_pacer.h"
+#include "alert_rules.h"
+#include "deadband.h"
+#include "burst_batch.h"
+#include "json_scan.h"
 
 /// Constants
 const char IotHubHostname[] = "plantmonitor.azure-devices.net";
-const char PacketFmt[] = "{\"meta\":{\"time\":%d,\"name\":\"plant0\"},\"data\":{\"lux\":%f,\"climate\":{\"tempurature\":%f,\"pressure\":%f,\"samples\":%d},\"soil\":{\"0x24\":%hu,\"0x26\":%hu},\"humidity\":%f}}";
-const struct timespec UploadInterval = { .tv_sec = 600, .tv_nsec = 0 }; // TODO: every ten minutes
+const char PacketFmt[] = "{\"meta\":{\"time\":%d,\"late_ms\":%d,\"name\":\"plant0\"},\"data\":{\"lux\":%f,\"lux_stats\":{\"med\":%.1f,\"min\":%.1f,\"max\":%.1f,\"n\":%u},\"climate\":{\"tempurature\":%f,\"pressure\":%f,\"samples\":%d},\"soil\":{\"0x24\":%hu,\"0x26\":%hu},\"humidity\":%f}}";
+const char FlickerFmt[] = "{\"meta\":{\"time\":%d,\"name\":\"plant0\"},\"flicker\":{\"lux\":%.1f,\"pct\":%.1f,\"hz\":%.0f,\"ratio\":%.3f,\"fs\":%.0f}}";
+const char AlertFmt[] = "{\"meta\":{\"time\":%d,\"name\":\"plant0\"},\"alert\":{\"rule\":\"%s\",\"channel\":\"%s\",\"state\":\"%s\",\"value\":%f}}";
+const char TuningReportFmt[] = "{\"tuning\":{\"sample_interval_s\":%u,\"upload_min_s\":%u,\"upload_max_s\":%u,\"upload_slo_s\":%u,\"queue_capacity\":%u,\"climate_odr_hz\":%g,\"humidity_hz\":%g,\"soil_dry_below\":%g,\"temperature_below\":%g,\"temperature_above\":%g,\"humidity_below\":%g,\"version\":%lld,\"rejected\":\"%s\"}}";
+const char DeviceName[] = "plant0"; // meta.name, the burst batches are handed it
+const char HealthFmt[] = "{\"meta\":{\"time\":%d,\"name\":\"plant0\"},\"health\":{%s}}";
+// uploads are paced: quick while a backlog drains, stretched out when idle, slow links and failures
+// get fewer larger uploads, and the oldest queued message never waits longer than UploadLatencySlo
+const struct timespec UploadMinInterval = { .tv_sec = 60, .tv_nsec = 0 };
+const struct timespec UploadMaxInterval = { .tv_sec = 1800, .tv_nsec = 0 };
+const struct timespec UploadLatencySlo = { .tv_sec = 900, .tv_nsec = 0 };
+const size_t UploadBatchMax = 16; // messages per upload, keeps the SDK's buffers small after an outage
+const uint32_t UploadSlowAckMs = 5000;
+const struct timespec HealthReportInterval = { .tv_sec = 600, .tv_nsec = 0 };
+// every section of a health report goes out in one message, from the heap as it is larger than a slab
+const size_t HealthReportMaxBytes = 4096;
+const size_t HealthSectionMaxBytes = 320;
+// the intervals, the queue capacity and the sensor rates can be tuned through the device twin, these are the defaults
 const struct timespec SampleInterval = { .tv_sec = 60, .tv_nsec = 0 }; // TODO: every minute
+const time_t MinValidRealtime = 1609459200; // 2021-01-01, the clock reads earlier than this until NTP has synced
 const struct timespec NetPollInterval = { .tv_sec = 5, .tv_nsec = 0 };
-const struct timespec AzureAuthPollInterval = { .tv_sec = 30, .tv_nsec = 0 };
-const struct timespec IoTDoWorkInterval = { .tv_sec = 0, .tv_nsec = 5e7 }; // 50 milliseconds
+// one IoT Hub client lives across reconnects, the SDK retries a dropped connection on its own and a client
+// it gave up on is only replaced after a backoff
+const struct timespec AzureConnectTimeout = { .tv_sec = 120, .tv_nsec = 0 }; // an attempt not authenticated by then has failed
+const size_t AzureSdkRetryTimeoutSeconds = 300;
+const uint32_t AzureBackoffBaseMs = 5000;
+const uint32_t AzureBackoffMaxMs = 600000;
+const struct timespec IoTDoWorkInterval = { .tv_sec = 0, .tv_nsec = 5e7 }; // 50 milliseconds, used while the SDK has work
+const struct timespec IoTDoWorkMaxInterval = { .tv_sec = 8, .tv_nsec = 0 }; // idle backoff ceiling, well inside the MQTT keepalive
 const struct timespec SoonInterval = { .tv_sec = 0, .tv_nsec = 1 };
-const size_t PacketMaxBytes = 256;
-const size_t QueueMaxCapacity = 50;
-const size_t AdcSampleCount = 100;
+// how late each timer may fire so nearby deadlines share a wakeup
+const struct timespec UploadSlack = { .tv_sec = 30, .tv_nsec = 0 };
+const struct timespec SampleSlack = { .tv_sec = 0, .tv_nsec = 1e8 }; // samples land on wall clock boundaries, keep them tight
+const struct timespec NetPollSlack = { .tv_sec = 1, .tv_nsec = 0 };
+const struct timespec AzureAuthPollSlack = { .tv_sec = 5, .tv_nsec = 0 };
+const struct timespec ReconnectSlack = { .tv_sec = 1, .tv_nsec = 0 };
+const size_t PacketMaxBytes = 320;
+const size_t QueueDefaultCapacity = 50;
+const size_t AlertQueueCapacity = 8; // alerts waiting for the link, more than this and the newest are dropped
+const size_t PayloadPoolSlabs = 50; // one upload cadence worth of samples, misses fall back to the heap
+// the light sensor is polled in the background across each sample window and summarised when it closes,
+// LuxPollsPerSample times spread over the sample period but no faster than LuxMinPollInterval
+const uint32_t LuxPollsPerSample = 30;
+const struct timespec LuxMinPollInterval = { .tv_sec = 0, .tv_nsec = 2e8 }; // 5 Hz, a burst second gets 5 polls
+const size_t LuxWindowCapacity = 60; // two periods of polls, headroom for a late or skipped sample
+const uint32_t LuxPollBudgetMs = 50;
+// every FlickerEverySamples samples a burst at FlickerSampleRateHz looks for mains flicker, about 130 ms of polling
+const uint32_t FlickerEverySamples = 10;
+const uint32_t FlickerSampleRateHz = 2000;
+const size_t SampleRingCapacity = 16;
+const struct timespec ChirpConversionTime = { .tv_sec = CHIRP_CONVERSION_MS / 1000, .tv_nsec = (CHIRP_CONVERSION_MS % 1000) * 1000000 };
+const struct timespec ChirpWakeTime = { .tv_sec = 0, .tv_nsec = CHIRP_WAKE_MS * 1000000 };
+const size_t ControlMailboxCapacity = 32;
+const size_t AcquisitionMailboxCapacity = 16; // a twin update posts up to 7 messages at once
+// the start_burst direct method samples at BurstInterval for a while, with the soil sensors left out
+// and the pressure and humidity sensors free running so every sample reads fresh conversions
+const struct timespec BurstInterval = { .tv_sec = 1, .tv_nsec = 0 };
+const struct timespec BurstSettleTime = { .tv_sec = 0, .tv_nsec = 5e8 }; // one SHT31 period at 2 Hz
+const struct timespec BurstDefaultDuration = { .tv_sec = 600, .tv_nsec = 0 };
+const struct timespec BurstMinDuration = { .tv_sec = 10, .tv_nsec = 0 };
+const struct timespec BurstMaxDuration = { .tv_sec = 1800, .tv_nsec = 0 };
+// burst rows are batched in a buffer of their own, a minute of rows per message instead of what fits a payload slab
+const uint32_t BurstBatchMaxRows = 60;
+const size_t BurstBatchMaxBytes = 3072; // a full row with every column is under 50 bytes
+const lps22hh_odr_t BurstClimateRate = LPS22HH_10_Hz;
+const humidity_mode_t BurstHumidityMode = HumidityMode_Periodic_2Hz;
+const uint32_t HandlerStallThresholdMs = 500; // handlers blocking their loop longer than this are logged as stalls
+// how long each handler may block its loop, a run over budget stops the watchdog feeds for a whole WatchdogTimeout
+const uint32_t SampleBudgetMs = 1000; // sensor restarts probe the bus, each probe may hit the I2C timeout
+const uint32_t SampleSequenceBudgetMs = 500;
+const uint32_t UploadBudgetMs = 200;
+const uint32_t AzureAuthBudgetMs = 3000; // client creation does the DPS round trip
+const uint32_t DoWorkBudgetMs = 1000;
+const uint32_t NoNetworkBudgetMs = 100;
+const uint32_t ReconnectBudgetMs = 1000; // destroying a client flushes its pending sends
+const uint32_t ControlBudgetMs = 200;
+// the watchdog kills the app with SIGALRM unless fed, the OS then restarts it
+const struct timespec WatchdogTimeout = { .tv_sec = 150, .tv_nsec = 0 };
+const struct timespec WatchdogFeedInterval = { .tv_sec = 30, .tv_nsec = 0 };
+// the acquisition loop counts as stuck after this many sample intervals without a heartbeat, see acquisition_heartbeat_timeout
+const uint32_t AcquisitionHeartbeatSamples = 2;
+// optional deep sleep: the system powers down between samples and the app boots again ahead of the next one,
+// every wake is a reboot and a fresh Wi-Fi join so it only pays off on battery
+const bool DeepSleepEnabled = false;
+const deep_sleep_config_t DeepSleepConfig = { .wake_lead_s = 10, .min_residency_s = 20, .upload_grace_s = 120 };
+// a planned power down never outlasts one sample interval, a store older than that plus this margin means the sensors may have lost power
+const struct timespec WarmStartMargin = { .tv_sec = 120, .tv_nsec = 0 };
 
 typedef enum {
     State_Entry = 0,
     State_NoNetwork = 1,
-    State_AzureAuth = 2,
-    State_PeriodicUpload = 3
+    State_AzureAuth = 2, // connecting, the client exists and is being authenticated
+    State_PeriodicUpload = 3,
+    State_AzureFailed = 4 // waiting out the backoff before a new client is tried
 } MonitorState_t;
 
 const char* str_monitor_state(MonitorState_t state) {
@@ -61,10 +162,30 @@ const char* str_monitor_state(MonitorState_t state) {
     case State_NoNetwork: return "State_NoNetwork";
     case State_AzureAuth: return "State_AzureAuth";
     case State_PeriodicUpload: return "State_PeriodicUpload";
+    case State_AzureFailed: return "State_AzureFailed";
     default: return "Unknown";
     }
 }
 
+// messages handled on the main loop, posted through control_mailbox
+typedef enum {
+    Msg_StateTransition = 0, // arg.i is the MonitorState_t to enter
+    Msg_SampleReady = 1, // the sample ring has records to queue
+    Msg_DoWorkKick = 2, // run DoWork now instead of waiting out the backoff
+    Msg_AcquisitionExit = 3, // arg.i is the ExitCode the acquisition thread died with
+    Msg_BurstEnded = 4 // the acquisition thread is back at the tuned interval
+} ControlMsg_t;
+
+// posted to the acquisition thread by the device twin handler
+typedef enum {
+    AcqMsg_SetSampleInterval = 0, // arg.u is the interval in seconds
+    AcqMsg_SetClimateRate = 1, // arg.i is the lps22hh_odr_t
+    AcqMsg_SetHumidityMode = 2, // arg.i is the humidity_mode_t
+    AcqMsg_StartBurst = 3, // arg.u is the duration in seconds, a running burst is extended
+    AcqMsg_StopBurst = 4,
+    AcqMsg_SetAlertLimit = 5 // arg.d is the limit, AcqMsg_SetAlertLimit + alert_limit_t says which
+} AcquisitionMsg_t;
+
 typedef enum {
     ExitCode_Success = 0,
 
@@ -72,12 +193,11 @@ typedef enum {
     ExitCode_ConsumeEventLoopTimerEvent = 3,
     ExitCode_ConsumeEventLoopEvent = 4,
     ExitCode_CreateEventLoopEvent_Panic = 5,
-    ExitCode_CreateEventLoopEvent_StateTransition = 5,
     ExitCode_CreateEventLoopDisarmedTimer_NetRdy = 7,
     ExitCode_CreateEventLoopDisarmedTimer_AzureAuth = 8,
     ExitCode_CreateEventLoopDisarmedTimer_Upload = 28,
     ExitCode_CreateEventLoopDisarmedTimer_DoWork = 27,
-    ExitCode_CreateEventLoopPeriodicTimer_Sample = 9,
+    ExitCode_CreateEventLoopDisarmedTimer_Sample = 9,
     ExitCode_UnknownState = 10,
     ExitCode_Networking_GetInterfaceConnectionStatus = 11,
     ExitCode_iothub_security_init = 12,
@@ -88,7 +208,6 @@ typedef enum {
     ExitCode_QueueOverfill = 16,
     ExitCode_QueueingFailed = 17,
     ExitCode_malloc_fail = 18,
-    ExitCode_lock_fail = 19,
 
     ExitCode_I2CMaster_Open_Climate = 20,
     ExitCode_I2CMaster_SetBusSpeed_Climate = 21,
@@ -100,15 +219,39 @@ typedef enum {
     ExitCode_PWM_Open_Status = 25,
     ExitCode_PWM_Open_User = 26,
 
+    ExitCode_SlabPoolInit_Payload = 29,
+    ExitCode_SpscRingInit_Samples = 30,
+    ExitCode_EventLoop_Create_Acquisition = 32,
+    ExitCode_CreateEventLoopEvent_AcquisitionStop = 33,
+    ExitCode_pthread_create_Acquisition = 35,
+    ExitCode_EventLoopFail_Acquisition = 36,
+    ExitCode_CreateEventMailbox_Control = 38,
+    ExitCode_PostEventMailbox_Control = 39,
+    ExitCode_timer_create_Watchdog = 40,
+    ExitCode_CreateEventLoopPeriodicTimer_Watchdog = 41,
+    ExitCode_CoTaskInit_Sample = 42,
+    ExitCode_AdcWindowInit_Lux = 43,
+    ExitCode_CreateEventLoopDisarmedTimer_Reconnect = 44,
+    ExitCode_deque_new_alerts = 45,
+    ExitCode_AlertRulesInit = 46,
+    ExitCode_DeadbandInit = 47,
+    ExitCode_CreateEventMailbox_Acquisition = 48,
+    ExitCode_BurstBatchInit = 49,
+
     ExitCode_SigTerm = 254,
 } ExitCode;
 
-#define DEQUE_PARAMS (deque, deque, QUEUE_MAX, , IOTHUB_MESSAGE_HANDLE)
+#define DEQUE_PARAMS (deque, deque, QUEUE_MAX, , char*)
 C_MACRO_COLLECTIONS_EXTENDED(CMC, DEQUE, DEQUE_PARAMS, )
 
 typedef struct deque deque_t;
 typedef struct deque_iter deque_iter_t;
 
+void* deque_malloc(size_t size) { return MemBudgetAlloc(MemTag_Deque, size); }
+void* deque_calloc(size_t count, size_t size) { return MemBudgetCalloc(MemTag_Deque, count, size); }
+void* deque_realloc(void* ptr, size_t size) { return MemBudgetRealloc(MemTag_Deque, ptr, size); }
+struct cmc_alloc_node deque_allocator = { deque_malloc, deque_calloc, deque_realloc, MemBudgetFree };
+
 typedef struct {
     int adc;
     int i2c_climate;
@@ -129,27 +272,276 @@ typedef struct {
     humidity_data_t humidity_data;
     chirp_data_t soil_1_data;
     chirp_data_t soil_2_data;
-    double lux;
+    double lux; // mean over the window
+    double lux_median;
+    double lux_min;
+    double lux_max;
+    uint32_t lux_samples;
+    uint32_t valid; // CHANNEL_BIT of every channel read successfully
 } sensor_values_t;
 
+// the scalar readings of a sample, indexes into the values alert rules look at
+typedef enum {
+    Channel_Temperature = 0,
+    Channel_Pressure = 1,
+    Channel_Humidity = 2,
+    Channel_Soil1 = 3,
+    Channel_Soil2 = 4,
+    Channel_Lux = 5,
+    Channel_Count
+} channel_t;
+
+#define CHANNEL_BIT(channel) (1U << (channel))
+
+const char* const ChannelNames[Channel_Count] = { "tempurature", "pressure", "humidity", "soil_0x24", "soil_0x26", "lux" };
+const channel_t BurstColumns[] = { Channel_Temperature, Channel_Pressure, Channel_Humidity, Channel_Lux };
+
+// checked on every sample, alerts that are raised or cleared skip the upload pacing
+const alert_rule_t AlertRules[] = {
+    { .name = "soil1_dry", .channel = Channel_Soil1, .kind = AlertKind_Below, .low = 350, .hysteresis = 25 },
+    { .name = "soil2_dry", .channel = Channel_Soil2, .kind = AlertKind_Below, .low = 350, .hysteresis = 25 },
+    { .name = "temperature", .channel = Channel_Temperature, .kind = AlertKind_Outside, .low = 5, .high = 35, .hysteresis = 1 },
+    { .name = "humidity", .channel = Channel_Humidity, .kind = AlertKind_Below, .low = 20, .hysteresis = 5 },
+};
+const size_t AlertRuleCount = sizeof(AlertRules) / sizeof(AlertRules[0]);
+
+// report by exception: a sample is only queued once a channel moves this far from its last reported value,
+// and at least every ReportHeartbeatPeriod so silence still means the device is up
+const double ChannelDeadband[Channel_Count] = {
+    [Channel_Temperature] = 0.5, // degrees C
+    [Channel_Pressure] = 1.0, // hPa
+    [Channel_Humidity] = 2.0, // %RH
+    [Channel_Soil1] = 10,
+    [Channel_Soil2] = 10,
+    [Channel_Lux] = 25
+};
+// light spans decades, in daylight 25 lux is cloud noise and the band widens to a share of the reported value
+const double ChannelRelativeDeadband[Channel_Count] = {
+    [Channel_Lux] = 0.2
+};
+const struct timespec ReportHeartbeatPeriod = { .tv_sec = 15 * 60, .tv_nsec = 0 };
+_Static_assert(Channel_Count <= DEADBAND_MAX_CHANNELS && Channel_Count <= OUTBOX_RESUME_CHANNELS, "too many channels to filter and persist");
+
+typedef struct {
+    double hz;
+    int setting;
+} rate_option_t;
+
+// 0 Hz converts one shot per sample. Continuous rates are averaged over the interval, the LPS22HH FIFO
+// holds 128 samples so fast rates only average the start of it
+const rate_option_t ClimateRates[] = {
+    { 0, LPS22HH_POWER_DOWN }, { 1, LPS22HH_1_Hz }, { 10, LPS22HH_10_Hz }, { 25, LPS22HH_25_Hz },
+    { 50, LPS22HH_50_Hz }, { 75, LPS22HH_75_Hz }, { 100, LPS22HH_100_Hz }, { 200, LPS22HH_200_Hz }
+};
+const rate_option_t HumidityRates[] = {
+    { 0, HumidityMode_SingleShot }, { 0.5, HumidityMode_Periodic_0_5Hz }, { 1, HumidityMode_Periodic_1Hz },
+    { 2, HumidityMode_Periodic_2Hz }, { 4, HumidityMode_Periodic_4Hz }, { 10, HumidityMode_Periodic_10Hz }
+};
+
+// desired properties under "tuning" in the device twin, values outside these limits are rejected
+typedef enum {
+    Tunable_SampleInterval = 0,
+    Tunable_UploadMin = 1,
+    Tunable_UploadMax = 2,
+    Tunable_UploadSlo = 3,
+    Tunable_QueueCapacity = 4,
+    Tunable_ClimateRate = 5,
+    Tunable_HumidityRate = 6,
+    Tunable_SoilDry = 7,
+    Tunable_TemperatureLow = 8,
+    Tunable_TemperatureHigh = 9,
+    Tunable_HumidityLow = 10,
+    Tunable_Count
+} tunable_t;
+
+typedef struct {
+    const char* name;
+    double min;
+    double max;
+    bool integer;
+} tunable_limits_t;
+
+const tunable_limits_t Tunables[Tunable_Count] = {
+    [Tunable_SampleInterval] = { "sample_interval_s", 10, 600, true },
+    [Tunable_UploadMin] = { "upload_min_s", 10, 3600, true },
+    [Tunable_UploadMax] = { "upload_max_s", 10, 86400, true },
+    [Tunable_UploadSlo] = { "upload_slo_s", 60, 86400, true },
+    [Tunable_QueueCapacity] = { "queue_capacity", 10, 150, true },
+    [Tunable_ClimateRate] = { "climate_odr_hz", 0, 200, false },
+    [Tunable_HumidityRate] = { "humidity_hz", 0, 10, false },
+    [Tunable_SoilDry] = { "soil_dry_below", 0, 1000, false },
+    [Tunable_TemperatureLow] = { "temperature_below", -40, 85, false },
+    [Tunable_TemperatureHigh] = { "temperature_above", -40, 85, false },
+    [Tunable_HumidityLow] = { "humidity_below", 0, 100, false }
+};
+
+// the AlertRules limits the twin can move, each applies to every rule on its channels
+typedef enum {
+    AlertLimit_SoilDry = 0,
+    AlertLimit_TemperatureLow = 1,
+    AlertLimit_TemperatureHigh = 2,
+    AlertLimit_HumidityLow = 3,
+    AlertLimit_Count
+} alert_limit_t;
+
+typedef struct {
+    tunable_t tunable;
+    uint32_t channels;
+    bool high;
+} alert_limit_option_t;
+
+const alert_limit_option_t AlertLimits[AlertLimit_Count] = {
+    [AlertLimit_SoilDry] = { Tunable_SoilDry, CHANNEL_BIT(Channel_Soil1) | CHANNEL_BIT(Channel_Soil2), false },
+    [AlertLimit_TemperatureLow] = { Tunable_TemperatureLow, CHANNEL_BIT(Channel_Temperature), false },
+    [AlertLimit_TemperatureHigh] = { Tunable_TemperatureHigh, CHANNEL_BIT(Channel_Temperature), true },
+    [AlertLimit_HumidityLow] = { Tunable_HumidityLow, CHANNEL_BIT(Channel_Humidity), false }
+};
+
 typedef struct {
-    pthread_mutex_t pkt_queues_lock;
+    sensor_values_t values;
+    struct timespec time; // the wall clock boundary the sample belongs to once time is valid
+    int32_t late_ms; // how long after time the sample was actually taken
+    bool report; // passed the deadband, false for a held back sample that only carries its flicker result
+    bool has_flicker;
+    flicker_result_t flicker;
+    uint32_t sample_index; // samples taken up to and including this one, across power downs
+    bool burst; // taken at BurstInterval, without soil moisture and flicker
+    // AlertRules bits raised and cleared by this sample, and all raised after it
+    uint32_t alerts_raised;
+    uint32_t alerts_cleared;
+    uint32_t alerts_active;
+} sample_record_t;
+
+// sensor acquisition runs on its own thread and event loop so slow I2C and ADC work never
+// delays the IoT SDK. Everything in here is only touched by that thread once it is started.
+typedef struct {
+    pthread_t thread;
+    bool thread_started;
+    EventLoop* loop;
+    EventLoopEvent_t* stop_event;
+    EventLoopTimer* sample_timer;
+    adc_window_t lux_window;
+    uint32_t sample_count; // regular samples, bursts are counted by the main thread in burst_t
+    // wall clock second the armed sample_timer aims at, and the one the running sample belongs to, 0 while unsynced
+    time_t next_nominal;
+    time_t sample_nominal;
+    // one sample is a coroutine that yields while the sensors convert, its state lives here
+    co_task_t sample_task;
+    coroutine_t sample_co;
+    sample_record_t record;
+    alert_rules_t alerts;
+    deadband_t deadband;
+    // tuning from the device twin, sensor rates wait for a running sample to finish
+    EventMailbox_t* mailbox;
+    time_t sample_interval_s;
+    bool retune;
+    lps22hh_odr_t climate_odr;
+    humidity_mode_t humidity_mode;
+    time_t burst_until; // CLOCK_MONOTONIC second a burst ends, 0 outside one
+    atomic_uint suppressed; // samples the deadband held back, published for the health report
+    atomic_uint samples_taken; // sample_count, published for power downs and the health report
+    int humidity_init_result;
+    ExitCode exit_code;
+    atomic_uint heartbeat; // bumped after every sample, read by the watchdog on the main thread
+} acquisition_t;
+
+typedef struct {
+    timer_t timer;
+    bool started;
+    EventLoopTimer* feed_timer;
+    uint32_t last_overruns;
+    struct timespec overrun_seen; // when new overruns were last counted, zero before the first
+    unsigned int last_heartbeat;
+    struct timespec heartbeat_seen;
+    uint32_t feeds;
+    uint32_t withheld;
+} watchdog_t;
+
+// settings the device twin can change, owned by the main thread
+typedef struct {
+    uint32_t sample_interval_s;
+    uint32_t upload_min_s;
+    uint32_t upload_max_s;
+    uint32_t upload_slo_s;
+    uint32_t queue_capacity;
+    double climate_odr_hz;
+    double humidity_hz;
+    double alert_limits[AlertLimit_Count];
+    long long version; // of the desired properties last applied
+} tuning_t;
+
+// burst samples are packed into as few payloads as fit, a batch is queued when full and sent while connected
+typedef struct {
+    bool active; // from the start_burst method until the acquisition thread ends it
+    burst_batch_t batch; // rows [seconds after the first, then BurstColumns]
+    uint32_t samples;
+    uint32_t batches;
+    uint32_t dropped; // samples lost to a full queue or an empty pool
+} burst_t;
+
+typedef struct {
+    backoff_t backoff;
+    bool security_ready;
+    bool connecting; // an attempt is running, azure_auth_timer is its timeout
+    struct timespec attempt_started; // CLOCK_MONOTONIC
+    uint32_t attempts;
+    uint32_t connects;
+    uint32_t failures;
+    uint32_t last_connect_ms; // time to authenticated of the last successful attempt
+    uint32_t max_connect_ms;
+} connection_t;
+
+typedef struct {
+    // samples are handed from the sampling side to the upload side without locks, the packet
+    // queues and payload pool below are only ever touched by the upload side
+    spsc_ring_t sample_ring;
+    // queued payloads are a payload_header_t and a JSON string borrowed from payload_pool, messages are only built when sending
+    slab_pool_t payload_pool;
     deque_t* pkt_outbound;
     deque_t* pkt_in_flight;
+    // alerts are sent as soon as they are queued, and ahead of pkt_outbound while the link is down
+    deque_t* pkt_alerts;
+    uint32_t alerts_active; // as of the last drained sample
+    uint32_t alerts_queued;
+    uint32_t alerts_dropped;
+    // the last reported sample as the deadband saw it, persisted across power downs
+    double reported[Channel_Count];
+    uint32_t reported_valid;
+    uint32_t reported_sample;
 
     EventLoop* loop;
     EventLoopEvent_t* sigterm_event;
-    EventLoopEvent_t* state_transition_event;
+    // state transitions and cross-thread notifications, delivered in the order they were posted
+    EventMailbox_t* control_mailbox;
     EventLoopTimer* no_network_timer;
     EventLoopTimer* azure_auth_timer;
     EventLoopTimer* upload_timer;
     EventLoopTimer* dowork_timer;
-    EventLoopTimer* sample_timer;
+    EventLoopTimer* reconnect_timer;
     IOTHUB_DEVICE_CLIENT_LL_HANDLE iothub_handle;
+    connection_t connection;
+    // DoWork runs at IoTDoWorkInterval while the SDK is busy and backs off exponentially when idle
+    idle_backoff_t dowork_backoff;
+    uint32_t dowork_calls;
+
+    acquisition_t acquisition;
+    watchdog_t watchdog;
     sensors_t sensors;
 
+    tuning_t tuning;
+    burst_t burst;
+
     MonitorState_t cur_state;
-    MonitorState_t requested_state;
+    time_t next_upload; // wall clock second the upload timer aims at, 0 until the first upload
+    upload_pacer_t upload_pacer;
+    struct timespec last_send; // CLOCK_MONOTONIC, start of the last upload batch, confirmations are timed against it
+    struct timespec last_health; // CLOCK_MONOTONIC
+
+    // deep sleep persists the outbox here, -1 without the MutableStorage capability
+    int store_fd;
+    bool powering_down;
+    bool warm_start; // this boot resumed from a power down
+    uint32_t power_downs;
 
     ExitCode last_thread_exit_code;
 } application_state_t;
@@ -158,6 +550,15 @@ typedef struct {
 volatile EventLoopEvent_t* sigterm_event = NULL;
 
 // functions
+uint64_t timespec_to_ms(const struct timespec* ts) {
+    return (uint64_t)ts->tv_sec * 1000 + (uint64_t)ts->tv_nsec / 1000000;
+}
+
+struct timespec ms_to_timespec(uint64_t ms) {
+    struct timespec ret = { .tv_sec = (time_t)(ms / 1000), .tv_nsec = (long)(ms % 1000) * 1000000 };
+    return ret;
+}
+
 void clear_fds(fd_t* fds) {
     fds->adc = -1;
     fds->i2c_climate = -1;
@@ -175,7 +576,7 @@ void zero_application_state(application_state_t* app_state) {
 
     app_state->last_thread_exit_code = ExitCode_Success;
     app_state->cur_state = State_Entry;
-    app_state->requested_state = State_Entry;
+    app_state->store_fd = -1;
 
     init_sensors(&app_state->sensors);
 }
@@ -224,43 +625,58 @@ void stop_system_devices(fd_t* fds) {
 
 void start_or_restart_sensors(sensors_t* sensors) {
     if (!ClimateSensorIsOk(&sensors->climate) && ClimateSensorInit(&sensors->climate, sensors->fds.i2c_climate) < 0)
-        Log_Debug("Failed to initialize climate sensor\n");
+        LOG_ERROR("Failed to initialize climate sensor\n");
     if (!ChirpIsOk(&sensors->soil_moisture_1) && ChirpInit(&sensors->soil_moisture_1, sensors->fds.i2c_climate, CHIRP_ADDR_1) < 0)
-        Log_Debug("Failed to initialize soil moisture 1\n");
+        LOG_ERROR("Failed to initialize soil moisture 1\n");
     if (!ChirpIsOk(&sensors->soil_moisture_2) && ChirpInit(&sensors->soil_moisture_2, sensors->fds.i2c_climate, CHIRP_ADDR_2) < 0)
-        Log_Debug("Failed to initialize soil moisture 2\n");
-    if (!HumidityIsOk(&sensors->humidity) && HumidityInit(&sensors->humidity, sensors->fds.i2c_climate) < 0)
-        Log_Debug("Failed to initialize humidity sensor\n");
+        LOG_ERROR("Failed to initialize soil moisture 2\n");
+}
+
+double adc_to_lux(double adc_value) {
+    return (2.5 * adc_value / 4095.0) * 1000000.0 / (3650.0 * 0.1428);
 }
 
-sensor_values_t sample_sensors(sensors_t* sensors) {
+// reads everything, the sensors must have been triggered ChirpConversionTime ago, or BurstSettleTime ago without the soil sensors
+sensor_values_t sample_sensors(sensors_t* sensors, adc_window_t* lux_window, bool with_soil) {
     sensor_values_t ret = { 0 };
-    ClimateSensorMeasure(&sensors->climate, &ret.climate_data);
-    HumidityMeasure(&sensors->humidity, &ret.humidity_data);
-    ChirpMeasure(&sensors->soil_moisture_1, &ret.soil_1_data);
-    ChirpMeasure(&sensors->soil_moisture_2, &ret.soil_2_data);
+    if (ClimateSensorMeasure(&sensors->climate, &ret.climate_data) == 0)
+        ret.valid |= CHANNEL_BIT(Channel_Temperature) | CHANNEL_BIT(Channel_Pressure);
+    if (HumidityMeasure(&sensors->humidity, &ret.humidity_data) == 0)
+        ret.valid |= CHANNEL_BIT(Channel_Humidity);
+    if (with_soil && ChirpRead(&sensors->soil_moisture_1, &ret.soil_1_data) == 0)
+        ret.valid |= CHANNEL_BIT(Channel_Soil1);
+    if (with_soil && ChirpRead(&sensors->soil_moisture_2, &ret.soil_2_data) == 0)
+        ret.valid |= CHANNEL_BIT(Channel_Soil2);
     
-    uint64_t sum = 0;
-    size_t sample_count = 0;
-    for (size_t i = 0; i < AdcSampleCount; i++) {
-        uint32_t adc_value;
-        int err = ADC_Poll(sensors->fds.adc, LIGHT_ADC_CHANNEL, &adc_value);
-        if (!err) {
-            sum += adc_value;
-            sample_count++;
-        }
-    }
-
-    if (sample_count > 0) {
-        const double avg = (double)sum / (double)sample_count;
-        ret.lux = (2.5 * avg / 4095.0) * 1000000.0 / (3650.0 * 0.1428);
+    adc_window_stats_t lux;
+    if (AdcWindowClose(lux_window, &lux) == 0) {
+        ret.valid |= CHANNEL_BIT(Channel_Lux);
+        ret.lux = adc_to_lux(lux.mean);
+        ret.lux_median = adc_to_lux(lux.median);
+        ret.lux_min = adc_to_lux(lux.min);
+        ret.lux_max = adc_to_lux(lux.max);
+        ret.lux_samples = lux.count;
     }
-    else 
-        ret.lux = 0;
+    if (lux.errors > 0)
+        LOG_WARN("%u light sensor polls failed this window\n", lux.errors);
 
     return ret;
 }
 
+void sensor_channels(const sensor_values_t* values, double channels[Channel_Count]) {
+    channels[Channel_Temperature] = values->climate_data.avg_tempurature;
+    channels[Channel_Pressure] = values->climate_data.avg_pressure;
+    channels[Channel_Humidity] = values->humidity_data.humidity;
+    channels[Channel_Soil1] = values->soil_1_data.soil_moisture;
+    channels[Channel_Soil2] = values->soil_2_data.soil_moisture;
+    channels[Channel_Lux] = values->lux;
+}
+
+// samples between forced reports, so a quiet device still reports every ReportHeartbeatPeriod whatever its interval
+uint32_t report_heartbeat_samples(time_t sample_interval_s) {
+    return sample_interval_s >= ReportHeartbeatPeriod.tv_sec ? 1 : (uint32_t)(ReportHeartbeatPeriod.tv_sec / sample_interval_s);
+}
+
 bool sensors_ok(sensors_t* sensors) {
     return ClimateSensorIsOk(&sensors->climate)
         && HumidityIsOk(&sensors->humidity) 
@@ -268,11 +684,74 @@ bool sensors_ok(sensors_t* sensors) {
         && ChirpIsOk(&sensors->soil_moisture_2);
 }
 
-IOTHUB_MESSAGE_HANDLE serialize_sensor_data(const sensor_values_t* values, const struct timespec* time) {
-    char pkt[PacketMaxBytes];
-    int res = snprintf(pkt, PacketMaxBytes, PacketFmt,
-        time->tv_sec,
+// every queued payload starts with this, its JSON text follows. The time it was queued stays with the
+// payload through a send, the requeue of a failed one and a power down
+typedef struct {
+    int64_t queued_at; // wall clock second, 0 if the clock had not synced yet
+    bool alert; // queued in pkt_alerts, a failed send goes back there
+} payload_header_t;
+
+// a payload with room for text_size bytes of text, stamped with the current wall clock second
+char* payload_alloc(slab_pool_t* pool, size_t text_size) {
+    char* payload = SlabPoolAllocSize(pool, sizeof(payload_header_t) + text_size);
+    if (payload == NULL)
+        return NULL;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const payload_header_t header = { .queued_at = now.tv_sec >= MinValidRealtime ? now.tv_sec : 0 };
+    memcpy(payload, &header, sizeof(header));
+    return payload;
+}
+
+// text room of a payload that fits a slab
+size_t payload_slab_text(const slab_pool_t* pool) {
+    return SlabPoolSlabSize(pool) - sizeof(payload_header_t);
+}
+
+char* payload_text(char* payload) {
+    return payload + sizeof(payload_header_t);
+}
+
+int64_t payload_queued_at(const char* payload) {
+    payload_header_t header;
+    memcpy(&header, payload, sizeof(header));
+    return header.queued_at;
+}
+
+void payload_set_queued_at(char* payload, int64_t queued_at) {
+    payload_header_t header;
+    memcpy(&header, payload, sizeof(header));
+    header.queued_at = queued_at;
+    memcpy(payload, &header, sizeof(header));
+}
+
+bool payload_is_alert(const char* payload) {
+    payload_header_t header;
+    memcpy(&header, payload, sizeof(header));
+    return header.alert;
+}
+
+void payload_set_alert(char* payload) {
+    payload_header_t header;
+    memcpy(&header, payload, sizeof(header));
+    header.alert = true;
+    memcpy(payload, &header, sizeof(header));
+}
+
+char* serialize_sensor_data(slab_pool_t* pool, const sample_record_t* record) {
+    char* pkt = payload_alloc(pool, payload_slab_text(pool));
+    if (pkt == NULL)
+        return NULL;
+
+    const sensor_values_t* values = &record->values;
+    int res = snprintf(payload_text(pkt), payload_slab_text(pool), PacketFmt,
+        record->time.tv_sec,
+        record->late_ms,
         values->lux,
+        values->lux_median,
+        values->lux_min,
+        values->lux_max,
+        values->lux_samples,
         values->climate_data.avg_tempurature,
         values->climate_data.avg_pressure,
         values->climate_data.num_samples,
@@ -280,20 +759,104 @@ IOTHUB_MESSAGE_HANDLE serialize_sensor_data(const sensor_values_t* values, const
         values->soil_2_data.soil_moisture,
         values->humidity_data.humidity);
 
-    if (res < 0) {
-        Log_Debug("Failed to serialize sensor readings");
+    if (res < 0 || (size_t)res >= payload_slab_text(pool)) {
+        LOG_ERROR("Failed to serialize sensor readings");
+        SlabPoolFree(pool, pkt);
+        return NULL;
+    }
+
+    return pkt;
+}
+
+char* serialize_flicker(slab_pool_t* pool, const sample_record_t* record) {
+    char* pkt = payload_alloc(pool, payload_slab_text(pool));
+    if (pkt == NULL)
+        return NULL;
+
+    const flicker_result_t* flicker = &record->flicker;
+    int res = snprintf(payload_text(pkt), payload_slab_text(pool), FlickerFmt,
+        record->time.tv_sec,
+        adc_to_lux(flicker->dc),
+        flicker->percent,
+        flicker->dominant_hz,
+        flicker->dominant_ratio,
+        flicker->sample_rate_hz);
+
+    if (res < 0 || (size_t)res >= payload_slab_text(pool)) {
+        LOG_ERROR("Failed to serialize flicker analysis\n");
+        SlabPoolFree(pool, pkt);
+        return NULL;
+    }
+
+    return pkt;
+}
+
+char* serialize_alert(slab_pool_t* pool, const sample_record_t* record, const alert_rule_t* rule, double value, bool raised) {
+    char* pkt = payload_alloc(pool, payload_slab_text(pool));
+    if (pkt == NULL)
+        return NULL;
+
+    int res = snprintf(payload_text(pkt), payload_slab_text(pool), AlertFmt,
+        record->time.tv_sec,
+        rule->name,
+        ChannelNames[rule->channel],
+        raised ? "raised" : "cleared",
+        value);
+
+    if (res < 0 || (size_t)res >= payload_slab_text(pool)) {
+        LOG_ERROR("Failed to serialize alert \"%s\"\n", rule->name);
+        SlabPoolFree(pool, pkt);
+        return NULL;
+    }
+    payload_set_alert(pkt);
+
+    return pkt;
+}
+
+char* serialize_health(slab_pool_t* pool, const char* sections, const struct timespec* time) {
+    const int len = snprintf(NULL, 0, HealthFmt, time->tv_sec, sections);
+    if (len < 0) {
+        LOG_ERROR("Failed to serialize health report\n");
         return NULL;
     }
+    char* pkt = payload_alloc(pool, (size_t)len + 1);
+    if (pkt == NULL)
+        return NULL;
+
+    snprintf(payload_text(pkt), (size_t)len + 1, HealthFmt, time->tv_sec, sections);
+    return pkt;
+}
+
+int format_mem_health(char* buf, size_t len, const slab_pool_t* pool) {
+    int res = snprintf(buf, len, "\"mem\":{");
+    for (mem_tag_t tag = 0; tag < MemTag_Count && res >= 0 && (size_t)res < len; tag++) {
+        mem_budget_tag_stats_t stats = MemBudgetTagStats(tag);
+        res += snprintf(buf + res, len - res, "\"%s\":[%u,%u],",
+            MemBudgetTagName(tag), (unsigned int)stats.current_bytes, (unsigned int)stats.peak_bytes);
+    }
+    if (res < 0 || (size_t)res >= len)
+        return -1;
+
+    mem_budget_process_t proc = MemBudgetSampleProcess();
+    slab_pool_stats_t pool_stats = SlabPoolStats(pool);
+    return res + snprintf(buf + res, len - res, "\"kb\":[%u,%u,%u],\"untracked_kb\":%u,\"pool\":[%u,%u,%u]}",
+        (unsigned int)proc.total_kb, (unsigned int)proc.user_kb, (unsigned int)proc.peak_user_kb, (unsigned int)proc.untracked_kb,
+        pool_stats.hits, pool_stats.misses, pool_stats.high_water);
+}
 
-    return IoTHubMessage_CreateFromString(pkt);
+// warm start after a power down, the sensors kept power and configuration so the probes and resets are skipped.
+// A sensor that did lose its state fails its first transaction and gets a full init on the next sample.
+void resume_sensors(sensors_t* sensors) {
+    if (ClimateSensorResume(&sensors->climate, sensors->fds.i2c_climate) < 0)
+        LOG_WARN("Climate sensor did not resume\n");
+    HumidityResume(&sensors->humidity, sensors->fds.i2c_climate);
+    ChirpResume(&sensors->soil_moisture_1, sensors->fds.i2c_climate, CHIRP_ADDR_1);
+    ChirpResume(&sensors->soil_moisture_2, sensors->fds.i2c_climate, CHIRP_ADDR_2);
 }
 
 ExitCode start_peripherals(application_state_t* app_state) {
-    ExitCode ret = start_system_devices(&app_state->sensors.fds);
-    if (ret != ExitCode_Success)
-        return ret;
-    start_or_restart_sensors(&app_state->sensors);
-    return ExitCode_Success;
+    // the sensors themselves are started by init_application, once it knows whether this is a warm start
+    return start_system_devices(&app_state->sensors.fds);
 }
 
 void set_indicator_color(int PWMfd, unsigned int red, unsigned int green, unsigned int blue) {
@@ -312,60 +875,109 @@ void set_indicator_color(int PWMfd, unsigned int red, unsigned int green, unsign
 }
 
 void app_panic(application_state_t* app, ExitCode code) {
+    TraceRecord(TraceId_Panic, code, 0, 0);
     app->last_thread_exit_code = code;
     EventLoop_Stop(app->loop);
 }
 
+void arm_do_work(application_state_t* app_state, const struct timespec* delay);
+void maybe_power_down(application_state_t* app_state);
+uint32_t oldest_queued_age(deque_t* queue, time_t now);
+void azure_twin_cb_unsafe(DEVICE_TWIN_UPDATE_STATE update, const unsigned char* payload, size_t size, void* ctx);
+int azure_method_cb_unsafe(const char* method_name, const unsigned char* payload, size_t size, unsigned char** response, size_t* response_size, void* ctx);
+
+// safe from any thread, returns false if the mailbox is full
+bool post_control_msg(application_state_t* app, ControlMsg_t type, int64_t arg) {
+    mailbox_msg_t msg = { .type = type, .arg.i = arg };
+    return PostEventMailbox(app->control_mailbox, &msg) == 0;
+}
+
 void _app_request_transition(application_state_t* app, MonitorState_t next_state, int line, const char* func) {
-    // Log_Debug("%s:%i requesting to %s\n", func, line, str_monitor_state(next_state)); Uncomment for debugging, not threadsafe
-    app->requested_state = next_state;
-    PostEventLoopEvent(app->state_transition_event);
+    LOG_TRACE("%s:%i requesting to %s\n", func, line, str_monitor_state(next_state));
+    // every request is queued, so a burst of status callbacks is replayed in order instead of collapsing to the last one
+    if (!post_control_msg(app, Msg_StateTransition, next_state)) {
+        TraceRecord(TraceId_MailboxDrop, Msg_StateTransition, 0, 0);
+        LOG_ERROR("Dropped state transition to %s from %s:%i\n", str_monitor_state(next_state), func, line);
+        app_panic(app, ExitCode_PostEventMailbox_Control);
+    }
 }
 
 #define APP_REQUEST_TRANSITION(APP, NEXT_STATE) _app_request_transition(APP, NEXT_STATE, __LINE__, __func__)
 
-void handle_state_transition(EventLoopEvent_t* event, void* ctx) {
-    application_state_t* app_state = (application_state_t*)ctx;
-    eventfd_t out = 0;
-    int err = ConsumeEventLoopEvent(event, &out);
-    if (err) {
-        app_panic(app_state, ExitCode_ConsumeEventLoopEvent);
-        return;
-    }
+void record_connected(connection_t* conn) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t ms = (int64_t)(now.tv_sec - conn->attempt_started.tv_sec) * 1000 + (now.tv_nsec - conn->attempt_started.tv_nsec) / 1000000;
+    conn->last_connect_ms = ms > 0 ? (uint32_t)ms : 0;
+    if (conn->last_connect_ms > conn->max_connect_ms)
+        conn->max_connect_ms = conn->last_connect_ms;
+    conn->connects++;
+    BackoffReset(&conn->backoff);
+}
 
-    Log_Debug("Got state transition %s with %i requests\n", str_monitor_state(app_state->requested_state), (int)out);
+void enter_state(application_state_t* app_state, MonitorState_t next_state) {
+    TraceRecord(TraceId_StateTransition, app_state->cur_state, next_state, 0);
     
-    if (app_state->cur_state != app_state->requested_state) {
-        Log_Debug("Transitioning from state %s to state %s\n", str_monitor_state(app_state->cur_state), str_monitor_state(app_state->requested_state));
-
+    if (app_state->cur_state != next_state) {
         // cancel all actions from previous states
         DisarmEventLoopTimer(app_state->no_network_timer);
         DisarmEventLoopTimer(app_state->azure_auth_timer);
         DisarmEventLoopTimer(app_state->dowork_timer);
         DisarmEventLoopTimer(app_state->upload_timer);
+        DisarmEventLoopTimer(app_state->reconnect_timer);
+
+        // leaving the connecting state ends the attempt, successfully only when authenticated, and it
+        // counts as one failure however many callbacks and timeouts report it
+        connection_t* conn = &app_state->connection;
+        if (conn->connecting) {
+            conn->connecting = false;
+            if (next_state == State_PeriodicUpload)
+                record_connected(conn);
+            else if (next_state == State_AzureFailed)
+                conn->failures++;
+        }
 
         // TODO: zero length initial timer is hacky
-        switch (app_state->requested_state) {
+        switch (next_state) {
         case State_NoNetwork:
             set_indicator_color(app_state->sensors.fds.user_pwm, 255, 0, 0);
             SetEventLoopTimerPeriod(app_state->no_network_timer, &SoonInterval, &NetPollInterval);
             break;
         case State_AzureAuth:
             set_indicator_color(app_state->sensors.fds.user_pwm, 0, 0, 255);
-            SetEventLoopTimerPeriod(app_state->azure_auth_timer, &SoonInterval, &AzureAuthPollInterval);
-            SetEventLoopTimerPeriod(app_state->dowork_timer, &SoonInterval, &IoTDoWorkInterval);
+            SetEventLoopTimerOneShot(app_state->azure_auth_timer, &SoonInterval);
+            IdleBackoffReset(&app_state->dowork_backoff);
+            arm_do_work(app_state, &SoonInterval);
             break;
-        case State_PeriodicUpload:
+        case State_PeriodicUpload: {
             set_indicator_color(app_state->sensors.fds.user_pwm, 0, 255, 0);
-            SetEventLoopTimerPeriod(app_state->upload_timer, &SoonInterval, &UploadInterval);
-            SetEventLoopTimerPeriod(app_state->dowork_timer, &SoonInterval, &IoTDoWorkInterval);
+            // keep a schedule restored from before a power down, otherwise upload right away,
+            // and right away in any case when alerts waited for the link
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            // and sooner when what was queued meanwhile needs it for the latency objective
+            const uint32_t oldest_age = oldest_queued_age(app_state->pkt_outbound, now.tv_sec);
+            const bool queue_due = !deque_empty(app_state->pkt_outbound)
+                && app_state->next_upload > now.tv_sec + (time_t)UploadPacerDueS(&app_state->upload_pacer, oldest_age);
+            const struct timespec until_due = { .tv_sec = app_state->next_upload - now.tv_sec, .tv_nsec = 0 };
+            const bool keep_schedule = app_state->next_upload > now.tv_sec && deque_empty(app_state->pkt_alerts) && !queue_due;
+            SetEventLoopTimerOneShot(app_state->upload_timer, keep_schedule ? &until_due : &SoonInterval);
+            IdleBackoffReset(&app_state->dowork_backoff);
+            arm_do_work(app_state, &SoonInterval);
             break;
+        }
+        case State_AzureFailed: {
+            set_indicator_color(app_state->sensors.fds.user_pwm, 255, 0, 255);
+            const struct timespec delay = ms_to_timespec(BackoffNextMs(&conn->backoff));
+            SetEventLoopTimerOneShot(app_state->reconnect_timer, &delay);
+            break;
+        }
         default:
             app_panic(app_state, ExitCode_UnknownState);
             return;
         }
 
-        app_state->cur_state = app_state->requested_state;
+        app_state->cur_state = next_state;
     }
 }
 
@@ -391,15 +1003,54 @@ void azure_status_cb_unsafe(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIEN
 {
     application_state_t* app_state = (application_state_t*)ctx;
     if (result == IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED) {
-        if (reason == IOTHUB_CLIENT_CONNECTION_NO_NETWORK)
+        switch (reason) {
+        case IOTHUB_CLIENT_CONNECTION_NO_NETWORK:
             APP_REQUEST_TRANSITION(app_state, State_NoNetwork);
-        else 
+            break;
+        // the client is unusable, it is replaced after a backoff
+        case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
+        case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
+        case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
+        case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
+            APP_REQUEST_TRANSITION(app_state, State_AzureFailed);
+            break;
+        // the SDK reconnects the same client under its own retry policy
+        default:
             APP_REQUEST_TRANSITION(app_state, State_AzureAuth);
+            break;
+        }
     }
     if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
         APP_REQUEST_TRANSITION(app_state, State_PeriodicUpload);
 }
 
+int create_iothub_client(application_state_t* app_state) {
+    app_state->iothub_handle =
+        IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(IotHubHostname, MQTT_Protocol);
+    if (app_state->iothub_handle == NULL) {
+        LOG_ERROR("IoTHubDeviceClient_LL_CreateFromDeviceAuth returned NULL.\n");
+        return -1;
+    }
+
+    int device_id_for_daa = 1;
+    if (IoTHubDeviceClient_LL_SetOption(app_state->iothub_handle, "SetDeviceId", &device_id_for_daa)  != IOTHUB_CLIENT_OK)
+        LOG_ERROR("Failure setting Azure IoT Hub client option \"SetDeviceId\".\n");
+    //bool url_encode_on = true;
+    //if (IoTHubDeviceClient_LL_SetOption(app_state->iothub_handle, OPTION_AUTO_URL_ENCODE_DECODE, &url_encode_on) != IOTHUB_CLIENT_OK)
+    //    Log_Debug("Failure setting Azure IoT Hub client option \"OPTION_AUTO_URL_ENCODE_DECODE\".\n");
+    if (IoTHubDeviceClient_LL_SetRetryPolicy(app_state->iothub_handle, IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER, AzureSdkRetryTimeoutSeconds) != IOTHUB_CLIENT_OK)
+        LOG_ERROR("Failure setting Azure IoT Hub client retry policy.\n");
+    if (IoTHubDeviceClient_LL_SetConnectionStatusCallback(app_state->iothub_handle, azure_status_cb_unsafe, app_state) != IOTHUB_CLIENT_OK)
+        LOG_ERROR("Failure setting Azure IoT Hub client connection status callback.\n");
+    if (IoTHubDeviceClient_LL_SetDeviceTwinCallback(app_state->iothub_handle, azure_twin_cb_unsafe, app_state) != IOTHUB_CLIENT_OK)
+        LOG_ERROR("Failure setting Azure IoT Hub client device twin callback.\n");
+    if (IoTHubDeviceClient_LL_SetDeviceMethodCallback(app_state->iothub_handle, azure_method_cb_unsafe, app_state) != IOTHUB_CLIENT_OK)
+        LOG_ERROR("Failure setting Azure IoT Hub client direct method callback.\n");
+    return 0;
+}
+
+// The first run of a connection attempt creates the client if there is none, and re-arms itself as the
+// attempt's timeout. The status callback normally ends the attempt before then.
 void handle_azure_auth(EventLoopTimer* timer, void* ctx) {
     application_state_t* app_state = (application_state_t*)ctx;
     if (ConsumeEventLoopTimerEvent(timer) != 0) {
@@ -407,15 +1058,19 @@ void handle_azure_auth(EventLoopTimer* timer, void* ctx) {
         return;
     }
 
-    if (app_state->iothub_handle != NULL) {
-        IoTHubDeviceClient_LL_Destroy(app_state->iothub_handle);
-        app_state->iothub_handle = NULL;
+    connection_t* conn = &app_state->connection;
+    if (conn->connecting) {
+        LOG_WARN("Not authenticated within %u s\n", (unsigned int)AzureConnectTimeout.tv_sec);
+        APP_REQUEST_TRANSITION(app_state, State_AzureFailed);
+        return;
     }
 
     Networking_InterfaceConnectionStatus status;
     if (Networking_GetInterfaceConnectionStatus("wlan0", &status) != 0) {
         if (errno != EAGAIN)
             app_panic(app_state, ExitCode_Networking_GetInterfaceConnectionStatus);
+        else
+            SetEventLoopTimerOneShot(timer, &NetPollInterval);
         return;
     }
     if (!(status & Networking_InterfaceConnectionStatus_ConnectedToInternet)) {
@@ -423,155 +1078,1408 @@ void handle_azure_auth(EventLoopTimer* timer, void* ctx) {
         return;
     }
 
-    if (iothub_security_init(IOTHUB_SECURITY_TYPE_X509) != 0) {
-        app_panic(app_state, ExitCode_iothub_security_init);
-        return;
+    // the security context is process wide, it is set up once and only torn down at exit
+    if (!conn->security_ready) {
+        if (iothub_security_init(IOTHUB_SECURITY_TYPE_X509) != 0) {
+            app_panic(app_state, ExitCode_iothub_security_init);
+            return;
+        }
+        conn->security_ready = true;
     }
-    app_state->iothub_handle =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(IotHubHostname, MQTT_Protocol);
-    if (app_state->iothub_handle == NULL) {
-        /// not going to panic here, instead retry
-        Log_Debug("IoTHubDeviceClient_LL_CreateFromDeviceAuth returned NULL.\n");
+
+    conn->connecting = true;
+    conn->attempts++;
+    clock_gettime(CLOCK_MONOTONIC, &conn->attempt_started);
+    if (app_state->iothub_handle == NULL && create_iothub_client(app_state) != 0) {
+        APP_REQUEST_TRANSITION(app_state, State_AzureFailed);
+        return;
     }
-    else {
-        int device_id_for_daa = 1;
-        if (IoTHubDeviceClient_LL_SetOption(app_state->iothub_handle, "SetDeviceId", &device_id_for_daa)  != IOTHUB_CLIENT_OK)
-            Log_Debug("Failure setting Azure IoT Hub client option \"SetDeviceId\".\n");
-        //bool url_encode_on = true;
-        //if (IoTHubDeviceClient_LL_SetOption(app_state->iothub_handle, OPTION_AUTO_URL_ENCODE_DECODE, &url_encode_on) != IOTHUB_CLIENT_OK)
-        //    Log_Debug("Failure setting Azure IoT Hub client option \"OPTION_AUTO_URL_ENCODE_DECODE\".\n");
-        if (IoTHubDeviceClient_LL_SetRetryPolicy(app_state->iothub_handle, IOTHUB_CLIENT_RETRY_INTERVAL, 30) != IOTHUB_CLIENT_OK)
-            Log_Debug("Failure setting Azure IoT Hub client retry policy.\n");
-        if (IoTHubDeviceClient_LL_SetConnectionStatusCallback(app_state->iothub_handle, azure_status_cb_unsafe, app_state) != IOTHUB_CLIENT_OK)
-            Log_Debug("Failure setting Azure IoT Hub client connection status callback.\n");
-    }
-
-    // asynchronously wait for azure status callback, or retry b/c it took too long
+    SetEventLoopTimerOneShot(timer, &AzureConnectTimeout);
+
+    // DoWork drives the handshake from here, the status callback reports the outcome
     IoTHubDeviceClient_LL_DoWork(app_state->iothub_handle);
+}
+
+// the backoff is over, a client the SDK gave up on is replaced by a fresh one
+void handle_reconnect(EventLoopTimer* timer, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        app_panic(app_state, ExitCode_ConsumeEventLoopTimerEvent);
+        return;
+    }
 
-    // cleanup
-    iothub_security_deinit();
+    if (app_state->iothub_handle != NULL) {
+        IoTHubDeviceClient_LL_Destroy(app_state->iothub_handle);
+        app_state->iothub_handle = NULL;
+    }
+    APP_REQUEST_TRANSITION(app_state, State_AzureAuth);
 }
 
 void azure_send_cb_unsafe(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* context)
 {
     application_state_t* app_state = (application_state_t*)context;
-    
-    if (pthread_mutex_lock(&app_state->pkt_queues_lock)) {
-        app_panic(app_state, ExitCode_lock_fail);
-        return;
-    }
 
-    IOTHUB_MESSAGE_HANDLE maybe_sent = deque_front(app_state->pkt_in_flight);
+    char* maybe_sent = deque_front(app_state->pkt_in_flight);
     deque_pop_front(app_state->pkt_in_flight);
-
-    if (result != IOTHUB_CLIENT_CONFIRMATION_OK) {
-        if (deque_count(app_state->pkt_outbound) >= QueueMaxCapacity) {
+    TraceRecord(TraceId_SendConfirmed, result, (uint32_t)deque_count(app_state->pkt_in_flight), 0);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t latency_ms = (int64_t)(now.tv_sec - app_state->last_send.tv_sec) * 1000 + (now.tv_nsec - app_state->last_send.tv_nsec) / 1000000;
+    UploadPacerAck(&app_state->upload_pacer, latency_ms > 0 ? (uint32_t)latency_ms : 0, result == IOTHUB_CLIENT_CONFIRMATION_OK);
+
+    if (result != IOTHUB_CLIENT_CONFIRMATION_OK && payload_is_alert(maybe_sent)) {
+        // back to the front of its own lane, it keeps its priority and never counts against the bulk queue
+        if (deque_count(app_state->pkt_alerts) >= AlertQueueCapacity) {
+            SlabPoolFree(&app_state->payload_pool, deque_back(app_state->pkt_alerts));
+            deque_pop_back(app_state->pkt_alerts);
+            app_state->alerts_dropped++;
+        }
+        if (!deque_push_front(app_state->pkt_alerts, maybe_sent)) {
+            app_panic(app_state, ExitCode_QueueingFailed);
+            SlabPoolFree(&app_state->payload_pool, maybe_sent);
+        }
+    }
+    else if (result != IOTHUB_CLIENT_CONFIRMATION_OK) {
+        if (deque_count(app_state->pkt_outbound) >= app_state->tuning.queue_capacity) {
             app_panic(app_state, ExitCode_QueueOverfill);
-            IoTHubMessage_Destroy(maybe_sent);
+            SlabPoolFree(&app_state->payload_pool, maybe_sent);
         }
         else if (!deque_push_back(app_state->pkt_outbound, maybe_sent)) {
             app_panic(app_state, ExitCode_QueueingFailed);
-            IoTHubMessage_Destroy(maybe_sent);
+            SlabPoolFree(&app_state->payload_pool, maybe_sent);
         }
     }
     else
-        IoTHubMessage_Destroy(maybe_sent);
+        SlabPoolFree(&app_state->payload_pool, maybe_sent);
+    maybe_power_down(app_state);
+}
 
-    pthread_mutex_unlock(&app_state->pkt_queues_lock);
+// per device: transactions, bytes written, bytes read, bus ms, p50 us, p99 us, nacks, timeouts, other errors
+int format_i2c_health(char* buf, size_t len) {
+    int res = snprintf(buf, len, "\"i2c\":{");
+    i2c_device_stats_t stats;
+    for (size_t i = 0; I2CMetricsGet(i, &stats) == 0 && res >= 0 && (size_t)res < len; i++) {
+        res += snprintf(buf + res, len - res, "%s\"0x%02x\":[%u,%u,%u,%llu,%u,%u,%u,%u,%u]", i == 0 ? "" : ",",
+            (unsigned int)stats.address, stats.transactions, stats.bytes_written, stats.bytes_read, (unsigned long long)(stats.bus_time_us / 1000),
+            stats.p50_us, stats.p99_us, stats.nacks, stats.timeouts, stats.errors);
+    }
+    if (res < 0 || (size_t)res >= len)
+        return -1;
+    return res + snprintf(buf + res, len - res, "}");
 }
 
-void handle_upload(EventLoopTimer* timer, void* ctx) {
-    application_state_t* app_state = (application_state_t*)ctx;
-    if (ConsumeEventLoopTimerEvent(timer) != 0) {
-        app_panic(app_state, ExitCode_ConsumeEventLoopTimerEvent);
-        return;
+// the sections of a health report are collected in buf, a part that does not fit is left out
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t used;
+    size_t handlers; // rows in the handlers array so far
+    uint32_t left_out;
+} health_report_t;
+
+// appends sep and part, keeping reserve bytes free for whatever still has to close the report
+bool health_append(health_report_t* report, const char* sep, const char* part, int part_len, size_t reserve) {
+    const size_t sep_len = strlen(sep);
+    if (part_len < 0 || (size_t)part_len >= HealthSectionMaxBytes || report->used + sep_len + (size_t)part_len + reserve >= report->len) {
+        report->left_out++;
+        return false;
     }
+    memcpy(report->buf + report->used, sep, sep_len);
+    memcpy(report->buf + report->used + sep_len, part, (size_t)part_len);
+    report->used += sep_len + (size_t)part_len;
+    report->buf[report->used] = '\0';
+    return true;
+}
+
+void health_section(health_report_t* report, const char* section, int section_len) {
+    health_append(report, report->used == 0 ? "" : ",", section, section_len, 0);
+}
+
+void health_handler_row(const handler_stats_t* stats, void* ctx) {
+    health_report_t* report = (health_report_t*)ctx;
+    char row[HealthSectionMaxBytes];
+    const int res = HandlerStatsFormat(stats, row, sizeof(row));
+    // the closing bracket always has room
+    if (health_append(report, report->handlers == 0 ? "" : ",", row, res, 1))
+        report->handlers++;
+}
+
+// health is the first to give way when the link falls behind, the last quarter of the queue is kept for samples
+bool outbound_nearly_full(const application_state_t* app_state) {
+    return deque_count(app_state->pkt_outbound) * 4 >= (size_t)app_state->tuning.queue_capacity * 3;
+}
+
+// one message per report, so health costs a single queue slot however many sections it has
+void queue_health_report(application_state_t* app_state) {
+    if (outbound_nearly_full(app_state))
+        return;
+    struct timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
 
-    if (pthread_mutex_lock(&app_state->pkt_queues_lock)) {
-        app_panic(app_state, ExitCode_lock_fail);
+    health_report_t report = { .buf = MemBudgetAlloc(MemTag_Payload, HealthReportMaxBytes), .len = HealthReportMaxBytes };
+    if (report.buf == NULL)
         return;
+    report.buf[0] = '\0';
+
+    char section[HealthSectionMaxBytes];
+    int res = format_mem_health(section, sizeof(section), &app_state->payload_pool);
+    health_section(&report, section, res);
+
+    // posted, dropped when full, doorbell writes, draining wakeups and largest batch
+    event_mailbox_stats_t mbox = EventMailboxStats(app_state->control_mailbox);
+    // plus connection attempts, successes, failures, and the last and worst time to authenticated
+    const connection_t* conn = &app_state->connection;
+    res = snprintf(section, sizeof(section), "\"net\":{\"dowork\":%u,\"dowork_ms\":%u,\"mbox\":[%u,%u,%u,%u,%u],\"conn\":[%u,%u,%u,%u,%u]}",
+        app_state->dowork_calls, IdleBackoffIntervalMs(&app_state->dowork_backoff),
+        mbox.posted, mbox.dropped, mbox.doorbells, mbox.batches, mbox.max_batch,
+        conn->attempts, conn->connects, conn->failures, conn->last_connect_ms, conn->max_connect_ms);
+    health_section(&report, section, res);
+
+    // wakeups, handlers run and wakeups that served several timers, per event loop
+    event_loop_timer_stats_t main_stats = { 0 }, acq_stats = { 0 };
+    GetEventLoopTimerStats(app_state->loop, &main_stats);
+    GetEventLoopTimerStats(app_state->acquisition.loop, &acq_stats);
+    // plus watchdog feeds, feeds withheld and handler budget overruns
+    res = snprintf(section, sizeof(section), "\"timers\":{\"main\":[%u,%u,%u],\"acq\":[%u,%u,%u],\"wdt\":[%u,%u,%u]}",
+        main_stats.wakeups, main_stats.expirations, main_stats.coalesced,
+        acq_stats.wakeups, acq_stats.expirations, acq_stats.coalesced,
+        app_state->watchdog.feeds, app_state->watchdog.withheld, HandlerStatsOverruns());
+    health_section(&report, section, res);
+
+    res = format_i2c_health(section, sizeof(section));
+    health_section(&report, section, res);
+
+    // chosen interval, ack latency average, acks, failed confirmations, objective misses and backlog
+    upload_pacer_stats_t pacer = UploadPacerStats(&app_state->upload_pacer);
+    res = snprintf(section, sizeof(section), "\"upload\":{\"int_s\":%u,\"ack_ms\":%u,\"acks\":%u,\"fail\":%u,\"slo_miss\":%u,\"backlog\":%u}",
+        pacer.interval_s, pacer.ack_ewma_ms, pacer.acks, pacer.failures, pacer.slo_misses, (unsigned int)deque_count(app_state->pkt_outbound));
+    health_section(&report, section, res);
+
+    // regular samples taken and held back by the deadband, both across power downs
+    // and burst samples, batches and lost burst samples
+    res = snprintf(section, sizeof(section), "\"report\":{\"samples\":%u,\"suppressed\":%u,\"burst\":[%u,%u,%u]}",
+        atomic_load_explicit(&app_state->acquisition.samples_taken, memory_order_relaxed),
+        atomic_load_explicit(&app_state->acquisition.suppressed, memory_order_relaxed),
+        app_state->burst.samples, app_state->burst.batches, app_state->burst.dropped);
+    health_section(&report, section, res);
+
+    // raised rules as bits, alerts queued and dropped so far, alerts waiting for the link
+    res = snprintf(section, sizeof(section), "\"alerts\":{\"active\":%u,\"queued\":%u,\"dropped\":%u,\"pending\":%u}",
+        app_state->alerts_active, app_state->alerts_queued, app_state->alerts_dropped, (unsigned int)deque_count(app_state->pkt_alerts));
+    health_section(&report, section, res);
+
+    // estimated awake time per million for each sensor, read while the acquisition thread drives them,
+    // and system power downs so far
+    sensors_t* sensors = &app_state->sensors;
+    res = snprintf(section, sizeof(section), "\"power\":{\"climate\":%u,\"humid\":%u,\"soil1\":%u,\"soil2\":%u,\"sleeps\":%u}",
+        DutyCyclePpm(ClimateSensorDutyCycle(&sensors->climate)), DutyCyclePpm(HumidityDutyCycle(&sensors->humidity)),
+        DutyCyclePpm(ChirpDutyCycle(&sensors->soil_moisture_1)), DutyCyclePpm(ChirpDutyCycle(&sensors->soil_moisture_2)),
+        app_state->power_downs);
+    health_section(&report, section, res);
+
+    // run time and lateness histograms for both event loops, one row per named handler
+    static const char handlers_open[] = "\"handlers\":[";
+    if (health_append(&report, report.used == 0 ? "" : ",", handlers_open, (int)strlen(handlers_open), 1)) {
+        HandlerStatsForEach(health_handler_row, &report);
+        health_append(&report, "", "]", 1, 0);
     }
+    if (report.left_out > 0)
+        LOG_WARN("%u health report parts did not fit\n", report.left_out);
 
-    while (!deque_empty(app_state->pkt_outbound) && deque_count(app_state->pkt_in_flight) < QueueMaxCapacity) {
-        IOTHUB_MESSAGE_HANDLE to_send = deque_front(app_state->pkt_outbound);
+    char* payload = serialize_health(&app_state->payload_pool, report.buf, &time);
+    MemBudgetFree(report.buf);
+    if (payload != NULL && !deque_push_back(app_state->pkt_outbound, payload))
+        SlabPoolFree(&app_state->payload_pool, payload);
+}
+
+// hand up to max messages from queue to the SDK, returns how many went or -1 once sending failed
+int send_outbound_batch(application_state_t* app_state, deque_t* queue, size_t max) {
+    int sent = 0;
+    clock_gettime(CLOCK_MONOTONIC, &app_state->last_send);
+    while (!deque_empty(queue) && deque_count(app_state->pkt_in_flight) < app_state->tuning.queue_capacity && (size_t)sent < max) {
+        char* to_send = deque_front(queue);
+        IOTHUB_MESSAGE_HANDLE msg = IoTHubMessage_CreateFromString(payload_text(to_send));
+        if (msg == NULL) {
+            LOG_ERROR("Failed to create IoTHub message\n");
+            return -1;
+        }
+        // the SDK clones the message on send, so the handle only has to live for this call
         IOTHUB_CLIENT_RESULT res = IoTHubDeviceClient_LL_SendEventAsync(
-            app_state->iothub_handle, to_send, azure_send_cb_unsafe, app_state);
+            app_state->iothub_handle, msg, azure_send_cb_unsafe, app_state);
+        IoTHubMessage_Destroy(msg);
         if (res != IOTHUB_CLIENT_OK) {
-            Log_Debug("Requesting IoTHub send failed with error %i\n", res);
+            LOG_ERROR("Requesting IoTHub send failed with error %i\n", res);
             APP_REQUEST_TRANSITION(app_state, State_NoNetwork);
-            goto cleanup;
+            return -1;
         }
 
-        Log_Debug("Sent message\n");
+        TraceRecord(TraceId_MessageSent, (uint32_t)deque_count(app_state->pkt_in_flight), (uint32_t)deque_count(queue), 0);
 
-        deque_pop_front(app_state->pkt_outbound);
+        deque_pop_front(queue);
         if (!deque_push_back(app_state->pkt_in_flight, to_send)) {
             app_panic(app_state, ExitCode_QueueingFailed);
-            IoTHubMessage_Destroy(to_send);
-            goto cleanup;
+            SlabPoolFree(&app_state->payload_pool, to_send);
+            return -1;
         }
+        sent++;
     }
+    return sent;
+}
 
-    IoTHubDeviceClient_LL_DoWork(app_state->iothub_handle);
+// seconds since the oldest payload in queue was queued. A failed send goes back to the end of the queue,
+// so the front is not always the oldest and the whole queue is looked at, rotating it once
+uint32_t oldest_queued_age(deque_t* queue, time_t now) {
+    uint32_t oldest = 0;
+    const size_t count = deque_count(queue);
+    for (size_t i = 0; i < count; i++) {
+        char* payload = deque_front(queue);
+        deque_pop_front(queue);
+        deque_push_back(queue, payload);
+        const int64_t queued_at = payload_queued_at(payload);
+        if (queued_at != 0 && now > queued_at && (uint64_t)(now - queued_at) > oldest)
+            oldest = (uint32_t)(now - queued_at);
+    }
+    return oldest;
+}
 
-cleanup:
-    pthread_mutex_unlock(&app_state->pkt_queues_lock);
+// an empty queue lets the upload idle out to upload_max_s, a payload queued meanwhile brings it in
+void upload_for_queued(application_state_t* app_state) {
+    if (app_state->cur_state != State_PeriodicUpload || app_state->powering_down)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec < MinValidRealtime)
+        return;
+    const struct timespec delay = { .tv_sec = UploadPacerDueS(&app_state->upload_pacer, 0), .tv_nsec = 0 };
+    if (app_state->next_upload != 0 && app_state->next_upload <= now.tv_sec + delay.tv_sec)
+        return;
+    SetEventLoopTimerOneShot(app_state->upload_timer, &delay);
+    app_state->next_upload = now.tv_sec + delay.tv_sec;
 }
 
-void handle_do_work(EventLoopTimer* timer, void* ctx) {
+void handle_upload(EventLoopTimer* timer, void* ctx) {
     application_state_t* app_state = (application_state_t*)ctx;
     if (ConsumeEventLoopTimerEvent(timer) != 0) {
         app_panic(app_state, ExitCode_ConsumeEventLoopTimerEvent);
         return;
     }
 
+    // the outbox is already persisted, sending it now would upload it twice
+    if (app_state->powering_down)
+        return;
+    struct timespec now, mono;
+    clock_gettime(CLOCK_REALTIME, &now);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    const bool time_valid = now.tv_sec >= MinValidRealtime;
+    UploadPacerUploadStarted(&app_state->upload_pacer, time_valid ? oldest_queued_age(app_state->pkt_outbound, now.tv_sec) : 0);
+
+    // health rides along with an upload at most every HealthReportInterval, draining must not flood the queue with it
+    if (app_state->last_health.tv_sec == 0 || mono.tv_sec - app_state->last_health.tv_sec >= HealthReportInterval.tv_sec) {
+        app_state->last_health = mono;
+        queue_health_report(app_state);
+    }
+
+    // alerts that waited for the link go first
+    const int alerts = send_outbound_batch(app_state, app_state->pkt_alerts, AlertQueueCapacity);
+    const int sent = alerts < 0 ? -1 : send_outbound_batch(app_state, app_state->pkt_outbound, UploadBatchMax);
+
+    const size_t backlog = deque_count(app_state->pkt_outbound);
+    const uint32_t oldest_age = time_valid ? oldest_queued_age(app_state->pkt_outbound, now.tv_sec) : 0;
+    const struct timespec next = { .tv_sec = UploadPacerNextS(&app_state->upload_pacer, backlog, oldest_age), .tv_nsec = 0 };
+    SetEventLoopTimerOneShot(app_state->upload_timer, &next);
+    if (time_valid)
+        app_state->next_upload = now.tv_sec + next.tv_sec;
+
+    if (alerts > 0 || sent > 0)
+        post_control_msg(app_state, Msg_DoWorkKick, 0);
+}
+
+// DoWork tolerates a quarter of its interval in lateness, which lets the idle backoff ride along with other timers
+void arm_do_work(application_state_t* app_state, const struct timespec* delay) {
+    const struct timespec slack = ms_to_timespec(timespec_to_ms(delay) / 4);
+    SetEventLoopTimerSlack(app_state->dowork_timer, &slack);
+    SetEventLoopTimerOneShot(app_state->dowork_timer, delay);
+}
+
+bool iothub_busy(application_state_t* app_state) {
+    return app_state->cur_state == State_AzureAuth || !deque_empty(app_state->pkt_in_flight);
+}
+
+// run DoWork now and pick the next interval: fast while connecting or waiting on confirmations,
+// doubling up to IoTDoWorkMaxInterval once the SDK goes quiet
+void do_work_and_reschedule(application_state_t* app_state) {
     IoTHubDeviceClient_LL_DoWork(app_state->iothub_handle);
+    app_state->dowork_calls++;
+
+    const struct timespec delay = ms_to_timespec(IdleBackoffNextMs(&app_state->dowork_backoff, iothub_busy(app_state)));
+    arm_do_work(app_state, &delay);
 }
 
-void handle_sample(EventLoopTimer* timer, void* ctx) {
+void handle_do_work(EventLoopTimer* timer, void* ctx) {
     application_state_t* app_state = (application_state_t*)ctx;
     if (ConsumeEventLoopTimerEvent(timer) != 0) {
         app_panic(app_state, ExitCode_ConsumeEventLoopTimerEvent);
         return;
     }
 
-    start_or_restart_sensors(&app_state->sensors);
+    if (app_state->cur_state != State_AzureAuth && app_state->cur_state != State_PeriodicUpload)
+        return;
+    do_work_and_reschedule(app_state);
+}
+
+// posted by the send path so freshly queued messages go out without waiting for the backoff
+void kick_do_work(application_state_t* app_state) {
+    if (app_state->cur_state != State_AzureAuth && app_state->cur_state != State_PeriodicUpload)
+        return;
+    IdleBackoffReset(&app_state->dowork_backoff);
+    do_work_and_reschedule(app_state);
+}
+
+// persist the outbox and power the whole system down until just before the next sample deadline
+// rotate the queue once to collect the texts and queue times in order without taking anything out
+size_t collect_queue(deque_t* queue, const char** texts, int64_t* queued_at) {
+    const size_t count = deque_count(queue);
+    for (size_t i = 0; i < count; i++) {
+        char* payload = deque_front(queue);
+        deque_pop_front(queue);
+        deque_push_back(queue, payload);
+        texts[i] = payload_text(payload);
+        queued_at[i] = payload_queued_at(payload);
+    }
+    return count;
+}
+
+void power_down(application_state_t* app_state, time_t now, time_t wake) {
+    // pending alerts are stored ahead of the bulk queue and counted, the wake puts them back in pkt_alerts.
+    // An empty outbox still saves the resume state, with no payloads to collect
+    const size_t queued = deque_count(app_state->pkt_alerts) + deque_count(app_state->pkt_outbound);
+    const char** payloads = NULL;
+    int64_t* queued_at = NULL;
+    size_t count = 0;
+    if (queued > 0) {
+        payloads = MemBudgetAlloc(MemTag_Deque, queued * (sizeof(char*) + sizeof(int64_t)));
+        if (payloads == NULL)
+            return;
+        queued_at = (int64_t*)(payloads + queued);
+        count = collect_queue(app_state->pkt_alerts, payloads, queued_at);
+        count += collect_queue(app_state->pkt_outbound, payloads + count, queued_at + count);
+    }
 
-    if (pthread_mutex_lock(&app_state->pkt_queues_lock)) {
-        app_panic(app_state, ExitCode_lock_fail);
+    outbox_resume_t resume = {
+        .saved_at = now,
+        .next_upload = app_state->next_upload,
+        .sample_count = atomic_load_explicit(&app_state->acquisition.samples_taken, memory_order_relaxed),
+        .power_downs = app_state->power_downs + 1,
+        .alerts_active = app_state->alerts_active,
+        .reported_valid = app_state->reported_valid,
+        .reported_sample = app_state->reported_sample,
+        .suppressed = atomic_load_explicit(&app_state->acquisition.suppressed, memory_order_relaxed),
+        .alert_count = (uint32_t)deque_count(app_state->pkt_alerts),
+        .sample_interval_s = app_state->tuning.sample_interval_s
+    };
+    memcpy(resume.reported, app_state->reported, sizeof(app_state->reported));
+    const int res = DeepSleepPowerDown(app_state->store_fd, &resume, payloads, queued_at, count, wake);
+    MemBudgetFree(payloads);
+    if (res != 0)
+        return;
+    // the OS sends SIGTERM shortly, until then nothing may leave the queue
+    TraceRecord(TraceId_PowerDown, (uint32_t)(wake - now), (uint32_t)count, 0);
+    app_state->powering_down = true;
+    app_state->power_downs++;
+}
+
+// Called whenever the main loop may have gone idle: after a sample is queued and after the last confirmation.
+// Sleeps once nothing is in flight and the next sample is far enough away, while a due upload keeps the
+// system up for the upload grace to give the network a chance.
+void maybe_power_down(application_state_t* app_state) {
+    if (!DeepSleepEnabled || app_state->store_fd < 0 || app_state->powering_down || !deque_empty(app_state->pkt_in_flight))
+        return;
+    // connected with alerts still to send, they are about to go out
+    if (app_state->cur_state == State_PeriodicUpload && !deque_empty(app_state->pkt_alerts))
         return;
+    if (app_state->burst.active)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec < MinValidRealtime)
+        return;
+
+    int64_t next_upload = app_state->next_upload;
+    const int64_t wake = DeepSleepWakeAt(&DeepSleepConfig, now.tv_sec, app_state->tuning.sample_interval_s, &next_upload,
+        UploadPacerStats(&app_state->upload_pacer).interval_s);
+    app_state->next_upload = (time_t)next_upload;
+    if (wake != 0)
+        power_down(app_state, now.tv_sec, (time_t)wake);
+}
+
+// power_down stores the alerts ahead of the bulk queue, the first resume->alert_count payloads go back to pkt_alerts
+typedef struct {
+    application_state_t* app_state;
+    const outbox_resume_t* resume;
+    uint32_t loaded;
+    uint32_t dropped_alerts;
+    uint32_t dropped;
+} outbox_restore_t;
+
+void restore_payload(const char* payload, size_t len, int64_t queued_at, void* ctx) {
+    outbox_restore_t* restore = (outbox_restore_t*)ctx;
+    application_state_t* app_state = restore->app_state;
+    const bool alert = restore->loaded++ < restore->resume->alert_count;
+    deque_t* queue = alert ? app_state->pkt_alerts : app_state->pkt_outbound;
+    const size_t capacity = alert ? AlertQueueCapacity : app_state->tuning.queue_capacity;
+
+    char* pkt = deque_count(queue) < capacity ? payload_alloc(&app_state->payload_pool, len + 1) : NULL;
+    if (pkt != NULL) {
+        payload_set_queued_at(pkt, queued_at);
+        if (alert)
+            payload_set_alert(pkt);
+        memcpy(payload_text(pkt), payload, len);
+        payload_text(pkt)[len] = '\0';
+        if (deque_push_back(queue, pkt))
+            return;
+        SlabPoolFree(&app_state->payload_pool, pkt);
     }
+    if (alert)
+        restore->dropped_alerts++;
+    else
+        restore->dropped++;
+}
 
-    if (deque_count(app_state->pkt_outbound) >= QueueMaxCapacity) {
-        app_panic(app_state, ExitCode_QueueOverfill);
-        goto cleanup;
+// pick up an outbox persisted by power_down, a missing capability or an empty store just means a cold start
+void restore_outbox(application_state_t* state) {
+    state->store_fd = Storage_OpenMutableFile();
+    if (state->store_fd < 0) {
+        if (DeepSleepEnabled)
+            LOG_WARN("No mutable storage, deep sleep disabled: %s\n", strerror(errno));
+        return;
     }
 
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    sensor_values_t sample = sample_sensors(&app_state->sensors);
-    IOTHUB_MESSAGE_HANDLE handle = serialize_sensor_data(&sample, &time);
+    outbox_resume_t resume;
+    outbox_restore_t restore = { .app_state = state, .resume = &resume };
+    const int restored = OutboxStoreLoad(state->store_fd, &resume, restore_payload, &restore);
+    if (restored < 0)
+        return;
+    // consumed, a crash from here on must not replay it
+    OutboxStoreClear(state->store_fd);
+    if (restore.dropped_alerts > 0 || restore.dropped > 0)
+        LOG_WARN("Stored payloads did not fit, dropped %u alerts and %u payloads\n", restore.dropped_alerts, restore.dropped);
+    state->alerts_dropped += restore.dropped_alerts;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    state->next_upload = (time_t)resume.next_upload;
+    state->power_downs = resume.power_downs;
+    state->alerts_active = resume.alerts_active;
+    memcpy(state->reported, resume.reported, sizeof(state->reported));
+    state->reported_valid = resume.reported_valid;
+    state->reported_sample = resume.reported_sample;
+    atomic_store_explicit(&state->acquisition.suppressed, resume.suppressed, memory_order_relaxed);
+    state->acquisition.sample_count = resume.sample_count;
+    atomic_store_explicit(&state->acquisition.samples_taken, resume.sample_count, memory_order_relaxed);
+    // the wake lands on the grid the device was tuned to, the twin confirms it once connected
+    if (resume.sample_interval_s >= Tunables[Tunable_SampleInterval].min && resume.sample_interval_s <= Tunables[Tunable_SampleInterval].max) {
+        state->tuning.sample_interval_s = resume.sample_interval_s;
+        state->acquisition.sample_interval_s = resume.sample_interval_s;
+    }
+    state->warm_start = DeepSleepWarmStart(now.tv_sec, resume.saved_at, state->tuning.sample_interval_s, (uint32_t)WarmStartMargin.tv_sec);
+    LOG_INFO("Restored %i queued payloads, %s start\n", restored, state->warm_start ? "warm" : "cold");
+}
+
+upload_pacer_config_t pacer_config(const tuning_t* tuning) {
+    return (upload_pacer_config_t) {
+        .min_interval_s = tuning->upload_min_s,
+        .max_interval_s = tuning->upload_max_s,
+        .latency_slo_s = tuning->upload_slo_s,
+        .slack_s = (uint32_t)UploadSlack.tv_sec,
+        .batch_max = UploadBatchMax,
+        .slow_ack_ms = UploadSlowAckMs
+    };
+}
+
+int rate_setting(const rate_option_t* options, size_t count, double hz, int* setting_out) {
+    for (size_t i = 0; i < count; i++) {
+        if (options[i].hz == hz) {
+            *setting_out = options[i].setting;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+bool post_acquisition_msg(application_state_t* app, AcquisitionMsg_t type, int64_t arg) {
+    mailbox_msg_t msg = { .type = type, .arg.i = arg };
+    return PostEventMailbox(app->acquisition.mailbox, &msg) == 0;
+}
+
+bool post_alert_limit(application_state_t* app, alert_limit_t which, double limit) {
+    mailbox_msg_t msg = { .type = AcqMsg_SetAlertLimit + which, .arg.d = limit };
+    return PostEventMailbox(app->acquisition.mailbox, &msg) == 0;
+}
+
+// the limit a rule starts from, the first rule on the limit's channels has it
+double default_alert_limit(alert_limit_t which) {
+    for (size_t i = 0; i < AlertRuleCount; i++) {
+        if ((AlertLimits[which].channels & CHANNEL_BIT(AlertRules[i].channel)) != 0)
+            return AlertLimits[which].high ? AlertRules[i].high : AlertRules[i].low;
+    }
+    return 0;
+}
+
+void set_alert_limit(alert_rules_t* alerts, alert_limit_t which, double limit) {
+    for (size_t i = 0; i < AlertRulesCount(alerts); i++) {
+        if ((AlertLimits[which].channels & CHANNEL_BIT(AlertRulesGet(alerts, i)->channel)) != 0)
+            AlertRulesSetLimit(alerts, i, AlertLimits[which].high, limit);
+    }
+}
+
+// true when which is present and valid, a present but invalid value is marked in rejected
+bool read_tunable(json_span_t tuning, tunable_t which, double* value_out, uint32_t* rejected) {
+    const tunable_limits_t* limits = &Tunables[which];
+    json_span_t value;
+    if (JsonScanMember(tuning, limits->name, &value) != 0)
+        return false;
+    double parsed;
+    if (JsonScanNumber(value, &parsed) != 0 || parsed < limits->min || parsed > limits->max
+        || (limits->integer && parsed != (double)(uint32_t)parsed)) {
+        *rejected |= 1U << which;
+        return false;
+    }
+    *value_out = parsed;
+    return true;
+}
+
+// a shrunk queue keeps its newest payloads
+void trim_outbound(application_state_t* app_state) {
+    size_t dropped = 0;
+    while (deque_count(app_state->pkt_outbound) > app_state->tuning.queue_capacity) {
+        SlabPoolFree(&app_state->payload_pool, deque_front(app_state->pkt_outbound));
+        deque_pop_front(app_state->pkt_outbound);
+        dropped++;
+    }
+    if (dropped > 0)
+        LOG_WARN("Queue capacity lowered, dropped the %zu oldest payloads\n", dropped);
+}
+
+// apply what changed, returns the tunables that could not be handed on
+uint32_t apply_tuning(application_state_t* app_state, const tuning_t* next) {
+    tuning_t* cur = &app_state->tuning;
+    uint32_t rejected = 0;
+    int setting;
+
+    if (next->sample_interval_s != cur->sample_interval_s) {
+        if (post_acquisition_msg(app_state, AcqMsg_SetSampleInterval, next->sample_interval_s)) {
+            cur->sample_interval_s = next->sample_interval_s;
+            // the heartbeat timeout follows the new interval, the acquisition gets a full one to move to its new grid
+            clock_gettime(CLOCK_MONOTONIC, &app_state->watchdog.heartbeat_seen);
+        }
+        else
+            rejected |= 1U << Tunable_SampleInterval;
+    }
+    if (next->climate_odr_hz != cur->climate_odr_hz && rate_setting(ClimateRates, sizeof(ClimateRates) / sizeof(ClimateRates[0]), next->climate_odr_hz, &setting) == 0) {
+        if (post_acquisition_msg(app_state, AcqMsg_SetClimateRate, setting))
+            cur->climate_odr_hz = next->climate_odr_hz;
+        else
+            rejected |= 1U << Tunable_ClimateRate;
+    }
+    if (next->humidity_hz != cur->humidity_hz && rate_setting(HumidityRates, sizeof(HumidityRates) / sizeof(HumidityRates[0]), next->humidity_hz, &setting) == 0) {
+        if (post_acquisition_msg(app_state, AcqMsg_SetHumidityMode, setting))
+            cur->humidity_hz = next->humidity_hz;
+        else
+            rejected |= 1U << Tunable_HumidityRate;
+    }
 
-    if (handle == NULL) {
-        // TODO: should panic here or not?
-        Log_Debug("Failed to serialize sensor readings\n");
-        goto cleanup;
+    for (size_t i = 0; i < AlertLimit_Count; i++) {
+        if (next->alert_limits[i] == cur->alert_limits[i])
+            continue;
+        if (post_alert_limit(app_state, (alert_limit_t)i, next->alert_limits[i]))
+            cur->alert_limits[i] = next->alert_limits[i];
+        else
+            rejected |= 1U << AlertLimits[i].tunable;
     }
 
-    Log_Debug("Queueing message with body \"%s\"\n", IoTHubMessage_GetString(handle));
-    if (!deque_push_back(app_state->pkt_outbound, handle)) {
-        app_panic(app_state, ExitCode_QueueingFailed);
-        IoTHubMessage_Destroy(handle);
+    if (next->queue_capacity != cur->queue_capacity) {
+        cur->queue_capacity = next->queue_capacity;
+        trim_outbound(app_state);
     }
 
+    if (next->upload_min_s != cur->upload_min_s || next->upload_max_s != cur->upload_max_s || next->upload_slo_s != cur->upload_slo_s) {
+        cur->upload_min_s = next->upload_min_s;
+        cur->upload_max_s = next->upload_max_s;
+        cur->upload_slo_s = next->upload_slo_s;
+        const upload_pacer_config_t config = pacer_config(cur);
+        UploadPacerSetConfig(&app_state->upload_pacer, &config);
+        // an upload scheduled further out than the new ceiling is brought in
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (app_state->cur_state == State_PeriodicUpload && now.tv_sec >= MinValidRealtime
+            && app_state->next_upload > now.tv_sec + (time_t)cur->upload_max_s) {
+            const struct timespec delay = { .tv_sec = cur->upload_max_s, .tv_nsec = 0 };
+            SetEventLoopTimerOneShot(app_state->upload_timer, &delay);
+            app_state->next_upload = now.tv_sec + delay.tv_sec;
+        }
+    }
+    return rejected;
+}
+
+void azure_reported_cb_unsafe(int status_code, void* ctx) {
+    if (status_code < 200 || status_code >= 300)
+        LOG_WARN("Device twin reported properties were refused with status %i\n", status_code);
+}
+
+// the applied settings go back as reported properties, along with the desired version and what was rejected
+void report_tuning(application_state_t* app_state, uint32_t rejected) {
+    char names[192] = "";
+    size_t used = 0;
+    for (size_t i = 0; i < Tunable_Count; i++) {
+        if ((rejected & (1U << i)) != 0)
+            used += snprintf(names + used, used < sizeof(names) ? sizeof(names) - used : 0, "%s%s", used == 0 ? "" : ",", Tunables[i].name);
+    }
+
+    const tuning_t* tuning = &app_state->tuning;
+    char report[PacketMaxBytes + sizeof(names)];
+    int res = snprintf(report, sizeof(report), TuningReportFmt,
+        tuning->sample_interval_s, tuning->upload_min_s, tuning->upload_max_s, tuning->upload_slo_s, tuning->queue_capacity,
+        tuning->climate_odr_hz, tuning->humidity_hz, tuning->alert_limits[AlertLimit_SoilDry], tuning->alert_limits[AlertLimit_TemperatureLow],
+        tuning->alert_limits[AlertLimit_TemperatureHigh], tuning->alert_limits[AlertLimit_HumidityLow], tuning->version, used < sizeof(names) ? names : "");
+    if (res < 0 || (size_t)res >= sizeof(report)) {
+        LOG_ERROR("Failed to serialize the tuning report\n");
+        return;
+    }
+    if (IoTHubDeviceClient_LL_SendReportedState(app_state->iothub_handle, (const unsigned char*)report, (size_t)res, azure_reported_cb_unsafe, app_state) != IOTHUB_CLIENT_OK)
+        LOG_WARN("Requesting the device twin report failed\n");
+}
+
+// Desired properties under "tuning", validated one by one: an invalid value is rejected and the current one kept.
+// Settings left out keep their current value, a reboot starts over from the defaults until the twin arrives again.
+void apply_desired(application_state_t* app_state, json_span_t desired) {
+    json_span_t value, tuning_json;
+    double version = 0;
+    if (JsonScanMember(desired, "$version", &value) == 0)
+        JsonScanNumber(value, &version);
+
+    tuning_t next = app_state->tuning;
+    uint32_t rejected = 0;
+    if (JsonScanMember(desired, "tuning", &tuning_json) == 0) {
+        double v;
+        int setting;
+        if (read_tunable(tuning_json, Tunable_SampleInterval, &v, &rejected))
+            next.sample_interval_s = (uint32_t)v;
+        if (read_tunable(tuning_json, Tunable_UploadMin, &v, &rejected))
+            next.upload_min_s = (uint32_t)v;
+        if (read_tunable(tuning_json, Tunable_UploadMax, &v, &rejected))
+            next.upload_max_s = (uint32_t)v;
+        if (read_tunable(tuning_json, Tunable_UploadSlo, &v, &rejected))
+            next.upload_slo_s = (uint32_t)v;
+        if (read_tunable(tuning_json, Tunable_QueueCapacity, &v, &rejected)) {
+            // a deep sleep stores the whole queue, alerts included, a queue the store cannot hold would keep the device up
+            if (!DeepSleepEnabled || (size_t)v + AlertQueueCapacity <= OutboxStoreCapacity(PacketMaxBytes))
+                next.queue_capacity = (uint32_t)v;
+            else
+                rejected |= 1U << Tunable_QueueCapacity;
+        }
+        if (read_tunable(tuning_json, Tunable_ClimateRate, &v, &rejected)) {
+            if (rate_setting(ClimateRates, sizeof(ClimateRates) / sizeof(ClimateRates[0]), v, &setting) == 0)
+                next.climate_odr_hz = v;
+            else
+                rejected |= 1U << Tunable_ClimateRate;
+        }
+        if (read_tunable(tuning_json, Tunable_HumidityRate, &v, &rejected)) {
+            if (rate_setting(HumidityRates, sizeof(HumidityRates) / sizeof(HumidityRates[0]), v, &setting) == 0)
+                next.humidity_hz = v;
+            else
+                rejected |= 1U << Tunable_HumidityRate;
+        }
+        for (size_t i = 0; i < AlertLimit_Count; i++) {
+            if (read_tunable(tuning_json, AlertLimits[i].tunable, &v, &rejected))
+                next.alert_limits[i] = v;
+        }
+        if (next.alert_limits[AlertLimit_TemperatureHigh] <= next.alert_limits[AlertLimit_TemperatureLow]) {
+            rejected |= (1U << Tunable_TemperatureLow) | (1U << Tunable_TemperatureHigh);
+            next.alert_limits[AlertLimit_TemperatureLow] = app_state->tuning.alert_limits[AlertLimit_TemperatureLow];
+            next.alert_limits[AlertLimit_TemperatureHigh] = app_state->tuning.alert_limits[AlertLimit_TemperatureHigh];
+        }
+        if (next.upload_max_s < next.upload_min_s) {
+            rejected |= (1U << Tunable_UploadMin) | (1U << Tunable_UploadMax);
+            next.upload_min_s = app_state->tuning.upload_min_s;
+            next.upload_max_s = app_state->tuning.upload_max_s;
+        }
+    }
+
+    rejected |= apply_tuning(app_state, &next);
+    app_state->tuning.version = (long long)version;
+    if (rejected != 0)
+        LOG_WARN("Device twin version %lld had rejected settings\n", app_state->tuning.version);
+    report_tuning(app_state, rejected);
+}
+
+// runs inside DoWork on the main thread, with the whole twin on connect and with each desired properties patch
+void azure_twin_cb_unsafe(DEVICE_TWIN_UPDATE_STATE update, const unsigned char* payload, size_t size, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    json_span_t desired = { .ptr = (const char*)payload, .len = size };
+    if (update == DEVICE_TWIN_UPDATE_COMPLETE && JsonScanMember(desired, "desired", &desired) != 0) {
+        LOG_WARN("Device twin without desired properties\n");
+        return;
+    }
+    apply_desired(app_state, desired);
+}
+
+// {"duration_s": n} is optional, a running burst is extended
+int start_burst(application_state_t* app_state, json_span_t payload, char* body, size_t len) {
+    double duration = (double)BurstDefaultDuration.tv_sec;
+    json_span_t value;
+    if (JsonScanMember(payload, "duration_s", &value) == 0
+        && (JsonScanNumber(value, &duration) != 0 || duration < BurstMinDuration.tv_sec || duration > BurstMaxDuration.tv_sec)) {
+        snprintf(body, len, "{\"error\":\"duration_s must be %d to %d\"}", (int)BurstMinDuration.tv_sec, (int)BurstMaxDuration.tv_sec);
+        return 400;
+    }
+    if (!post_acquisition_msg(app_state, AcqMsg_StartBurst, (int64_t)duration)) {
+        snprintf(body, len, "{\"error\":\"busy\"}");
+        return 503;
+    }
+    app_state->burst.active = true;
+    snprintf(body, len, "{\"duration_s\":%d}", (int)duration);
+    return 200;
+}
+
+int stop_burst(application_state_t* app_state, char* body, size_t len) {
+    if (!app_state->burst.active) {
+        snprintf(body, len, "{\"error\":\"no burst running\"}");
+        return 409;
+    }
+    if (!post_acquisition_msg(app_state, AcqMsg_StopBurst, 0)) {
+        snprintf(body, len, "{\"error\":\"busy\"}");
+        return 503;
+    }
+    snprintf(body, len, "{}");
+    return 200;
+}
+
+// runs inside DoWork on the main thread, the SDK releases the response with free()
+int azure_method_cb_unsafe(const char* method_name, const unsigned char* payload, size_t size, unsigned char** response, size_t* response_size, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    char body[96];
+    int status;
+    if (strcmp(method_name, "start_burst") == 0)
+        status = start_burst(app_state, (json_span_t){ .ptr = (const char*)payload, .len = size }, body, sizeof(body));
+    else if (strcmp(method_name, "stop_burst") == 0)
+        status = stop_burst(app_state, body, sizeof(body));
+    else {
+        snprintf(body, sizeof(body), "{\"error\":\"unknown method\"}");
+        status = 404;
+    }
+
+    *response_size = strlen(body);
+    *response = malloc(*response_size);
+    if (*response == NULL) {
+        *response_size = 0;
+        return 500;
+    }
+    memcpy(*response, body, *response_size);
+    return status;
+}
+
+void acquisition_panic(application_state_t* app, ExitCode code) {
+    app->acquisition.exit_code = code;
+    EventLoop_Stop(app->acquisition.loop);
+}
+
+// switching a sensor rate between its trigger and its read would spoil that sample, so a running sample applies it when done
+void apply_sensor_tuning(application_state_t* app_state) {
+    acquisition_t* acq = &app_state->acquisition;
+    if (!acq->retune)
+        return;
+    acq->retune = false;
+    const bool burst = acq->burst_until != 0;
+    if (ClimateSensorSetDataRate(&app_state->sensors.climate, burst ? BurstClimateRate : acq->climate_odr) < 0)
+        LOG_WARN("Could not set the pressure sensor data rate, it applies on restart\n");
+    if (HumiditySetMode(&app_state->sensors.humidity, burst ? BurstHumidityMode : acq->humidity_mode) < 0)
+        LOG_WARN("Could not set the humidity sensor mode, it applies on restart\n");
+}
+
+co_status_t sample_sequence(co_task_t* task, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    acquisition_t* acq = &app_state->acquisition;
+    sensors_t* sensors = &app_state->sensors;
+    CO_BEGIN(&acq->sample_co);
+
+    start_or_restart_sensors(sensors);
+    if (!HumidityIsOk(&sensors->humidity)) {
+        CO_AWAIT(&acq->sample_co, HumidityInit(&sensors->humidity, task, sensors->fds.i2c_climate, &acq->humidity_init_result));
+        if (acq->humidity_init_result < 0)
+            LOG_ERROR("Failed to initialize humidity sensor\n");
+    }
+
+    // the chirps sleep between samples, the other sensors convert one shot and power down on their own.
+    // A burst leaves the chirps asleep, their conversion alone takes longer than BurstInterval
+    acq->record.burst = acq->burst_until != 0;
+    if (!acq->record.burst) {
+        ChirpWake(&sensors->soil_moisture_1);
+        ChirpWake(&sensors->soil_moisture_2);
+        CO_SLEEP(&acq->sample_co, task, &ChirpWakeTime);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (acq->sample_nominal != 0) {
+        acq->record.time.tv_sec = acq->sample_nominal;
+        acq->record.time.tv_nsec = 0;
+        acq->record.late_ms = (int32_t)((now.tv_sec - acq->sample_nominal) * 1000 + now.tv_nsec / 1000000);
+    }
+    else {
+        acq->record.time = now;
+        acq->record.late_ms = 0;
+    }
+    // every sensor converts at once and the loop stays free while they do
+    if (!acq->record.burst) {
+        ChirpTrigger(&sensors->soil_moisture_1);
+        ChirpTrigger(&sensors->soil_moisture_2);
+    }
+    ClimateSensorTrigger(&sensors->climate);
+    HumidityTrigger(&sensors->humidity);
+    CO_SLEEP(&acq->sample_co, task, acq->record.burst ? &BurstSettleTime : &ChirpConversionTime);
+    acq->record.values = sample_sensors(sensors, &acq->lux_window, !acq->record.burst);
+    double channels[Channel_Count];
+    sensor_channels(&acq->record.values, channels);
+    acq->record.alerts_raised = AlertRulesEvaluate(&acq->alerts, channels, acq->record.values.valid, &acq->record.alerts_cleared);
+    acq->record.alerts_active = AlertRulesActive(&acq->alerts);
+    if (!acq->record.burst) {
+        ChirpSleep(&sensors->soil_moisture_1);
+        ChirpSleep(&sensors->soil_moisture_2);
+    }
+    // burst samples would shift the flicker cadence and the count a power down resumes from, they are not counted here
+    const bool flicker_due = !acq->record.burst && acq->sample_count++ % FlickerEverySamples == 0;
+    atomic_store_explicit(&acq->samples_taken, acq->sample_count, memory_order_relaxed);
+    acq->record.has_flicker = flicker_due
+        && FlickerMeasure(sensors->fds.adc, LIGHT_ADC_CHANNEL, FlickerSampleRateHz, &acq->record.flicker) == 0;
+    acq->record.sample_index = acq->sample_count;
+
+    // samples within the deadband never leave this thread, alerts and bursts always do. A flicker result
+    // leaves on its own, the sample it was taken with stays held back
+    const bool force = acq->record.alerts_raised != 0 || acq->record.alerts_cleared != 0 || acq->record.burst;
+    acq->record.report = DeadbandCheck(&acq->deadband, channels, acq->record.values.valid, force);
+    // the reference only moves once the sample is in the ring, a dropped one is reported by the next sample
+    if (acq->record.report || acq->record.has_flicker) {
+        if (SpscRingPush(&app_state->sample_ring, &acq->record)) {
+            if (acq->record.report)
+                DeadbandCommit(&acq->deadband, channels, acq->record.values.valid);
+        }
+        else
+            LOG_WARN("Sample ring full, %u samples dropped so far\n", SpscRingDrops(&app_state->sample_ring));
+    }
+    if (!acq->record.report)
+        atomic_store_explicit(&acq->suppressed, DeadbandSuppressed(&acq->deadband), memory_order_relaxed);
+    // posted for held back samples too, the main side decides about powering down after every sample.
+    // A lost notification only delays the record until the next one drains the ring
+    if (!post_control_msg(app_state, Msg_SampleReady, 0))
+        TraceRecord(TraceId_MailboxDrop, Msg_SampleReady, 0, 0);
+
     if (sensors_ok(&app_state->sensors))
         set_indicator_color(app_state->sensors.fds.user_pwm, 0, 255, 0);
     else
         set_indicator_color(app_state->sensors.fds.user_pwm, 255, 128, 0);
 
-cleanup:
-    pthread_mutex_unlock(&app_state->pkt_queues_lock);
+    atomic_fetch_add_explicit(&acq->heartbeat, 1, memory_order_relaxed);
+    apply_sensor_tuning(app_state);
+    CO_END(&acq->sample_co);
+}
+
+time_t sample_period(const acquisition_t* acq) {
+    return acq->burst_until != 0 ? BurstInterval.tv_sec : acq->sample_interval_s;
+}
+
+struct timespec lux_poll_interval(time_t sample_period_s) {
+    const int64_t interval_ms = (int64_t)sample_period_s * 1000 / LuxPollsPerSample;
+    const int64_t min_ms = LuxMinPollInterval.tv_sec * 1000 + LuxMinPollInterval.tv_nsec / 1000000;
+    const int64_t ms = interval_ms > min_ms ? interval_ms : min_ms;
+    return (struct timespec) { .tv_sec = (time_t)(ms / 1000), .tv_nsec = (long)(ms % 1000) * 1000000 };
+}
+
+// the light sensor wakes the core on every poll, so it is paced to the period instead of polled flat out
+void pace_lux_window(acquisition_t* acq) {
+    const struct timespec interval = lux_poll_interval(sample_period(acq));
+    if (AdcWindowSetInterval(&acq->lux_window, &interval) < 0)
+        LOG_WARN("Failed to pace the lux polling: %s\n", strerror(errno));
+}
+
+// Once the wall clock is valid samples are taken on multiples of the sample interval since the epoch,
+// so every device samples at the same instants. The delay is recomputed from the wall clock for
+// each sample, which also cancels any drift between the monotonic and real time clocks.
+int arm_next_sample(acquisition_t* acq) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const time_t period = sample_period(acq);
+    if (now.tv_sec < MinValidRealtime) {
+        acq->next_nominal = 0;
+        const struct timespec interval = { .tv_sec = period, .tv_nsec = 0 };
+        return SetEventLoopTimerOneShot(acq->sample_timer, &interval);
+    }
+
+    time_t next = (now.tv_sec / period + 1) * period;
+    // a timer firing a hair before its boundary must not schedule that boundary again. A boundary
+    // a period or more ahead means the clock stepped back, the grid is then taken up again from now
+    const int64_t ahead_ms = (int64_t)(acq->next_nominal - now.tv_sec) * 1000 - now.tv_nsec / 1000000;
+    if (acq->next_nominal != 0 && next <= acq->next_nominal && ahead_ms < (int64_t)period * 1000)
+        next = acq->next_nominal + period;
+    acq->next_nominal = next;
+
+    struct timespec delay = { .tv_sec = next - now.tv_sec - 1, .tv_nsec = 1000000000L - now.tv_nsec };
+    if (delay.tv_nsec >= 1000000000L) {
+        delay.tv_sec++;
+        delay.tv_nsec -= 1000000000L;
+    }
+    return SetEventLoopTimerOneShot(acq->sample_timer, &delay);
+}
+
+// back to the tuned interval and rates, the main thread then queues the last batch
+void end_burst(application_state_t* app_state) {
+    acquisition_t* acq = &app_state->acquisition;
+    if (acq->burst_until != 0) {
+        acq->burst_until = 0;
+        acq->retune = true;
+        acq->next_nominal = 0;
+        arm_next_sample(acq);
+        pace_lux_window(acq);
+        if (!CoTaskRunning(&acq->sample_task))
+            apply_sensor_tuning(app_state);
+        LOG_INFO("Burst sampling ended\n");
+    }
+    if (!post_control_msg(app_state, Msg_BurstEnded, 0))
+        TraceRecord(TraceId_MailboxDrop, Msg_BurstEnded, 0, 0);
+}
+
+void handle_sample(EventLoopTimer* timer, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        acquisition_panic(app_state, ExitCode_ConsumeEventLoopTimerEvent);
+        return;
+    }
+
+    acquisition_t* acq = &app_state->acquisition;
+    const time_t nominal = acq->next_nominal;
+    struct timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    if (acq->burst_until != 0 && mono.tv_sec >= acq->burst_until)
+        end_burst(app_state);
+    else
+        arm_next_sample(acq);
+
+    if (CoTaskRunning(&acq->sample_task)) {
+        LOG_WARN("Previous sample still running, skipping this one\n");
+        return;
+    }
+    acq->sample_nominal = nominal;
+    CoTaskStart(&acq->sample_task);
+}
+
+// one message per rule that changed state on this sample
+void queue_alerts(application_state_t* app_state, const sample_record_t* record) {
+    double channels[Channel_Count];
+    sensor_channels(&record->values, channels);
+    for (size_t i = 0; i < AlertRuleCount; i++) {
+        const uint32_t bit = 1U << i;
+        if (((record->alerts_raised | record->alerts_cleared) & bit) == 0)
+            continue;
+        const alert_rule_t* rule = &AlertRules[i];
+        const bool raised = (record->alerts_raised & bit) != 0;
+        LOG_INFO("Alert %s on %s %s at %.1f\n", rule->name, ChannelNames[rule->channel], raised ? "raised" : "cleared", channels[rule->channel]);
+        if (deque_count(app_state->pkt_alerts) >= AlertQueueCapacity) {
+            app_state->alerts_dropped++;
+            continue;
+        }
+
+        char* payload = serialize_alert(&app_state->payload_pool, record, rule, channels[rule->channel], raised);
+        if (payload == NULL || !deque_push_back(app_state->pkt_alerts, payload)) {
+            SlabPoolFree(&app_state->payload_pool, payload);
+            app_state->alerts_dropped++;
+            continue;
+        }
+        app_state->alerts_queued++;
+        TraceRecord(TraceId_AlertQueued, (uint32_t)i, raised, (uint32_t)deque_count(app_state->pkt_alerts));
+    }
+}
+
+// while connected alerts go out right away instead of waiting for the paced upload
+void send_alerts(application_state_t* app_state) {
+    if (app_state->cur_state != State_PeriodicUpload || app_state->powering_down || deque_empty(app_state->pkt_alerts))
+        return;
+    if (send_outbound_batch(app_state, app_state->pkt_alerts, AlertQueueCapacity) > 0)
+        kick_do_work(app_state);
+}
+
+// close the batch and queue it, sending right away while connected
+void flush_burst(application_state_t* app_state) {
+    burst_t* burst = &app_state->burst;
+    const time_t batch_time = (time_t)BurstBatchTime(&burst->batch);
+    const uint32_t rows = BurstBatchRows(&burst->batch);
+    size_t len;
+    const char* text = BurstBatchFinish(&burst->batch, &len);
+    if (text == NULL)
+        return;
+
+    // best effort like flicker results, a full queue drops the batch instead of panicking.
+    // A batch is larger than a slab, so it is always one of the pool's heap buffers
+    char* payload = deque_count(app_state->pkt_outbound) < app_state->tuning.queue_capacity ? payload_alloc(&app_state->payload_pool, len + 1) : NULL;
+    if (payload == NULL || !deque_push_back(app_state->pkt_outbound, payload)) {
+        SlabPoolFree(&app_state->payload_pool, payload);
+        burst->dropped += rows;
+        return;
+    }
+    // it waited for the upload since its first row
+    if (batch_time >= MinValidRealtime)
+        payload_set_queued_at(payload, batch_time);
+    memcpy(payload_text(payload), text, len + 1);
+    burst->batches++;
+
+    if (app_state->cur_state != State_PeriodicUpload || app_state->powering_down)
+        return;
+    const int sent = send_outbound_batch(app_state, app_state->pkt_outbound, UploadBatchMax);
+    if (!deque_empty(app_state->pkt_outbound))
+        upload_for_queued(app_state);
+    if (sent > 0)
+        kick_do_work(app_state);
+}
+
+void append_burst(application_state_t* app_state, const sample_record_t* record) {
+    burst_t* burst = &app_state->burst;
+    double channels[Channel_Count];
+    sensor_channels(&record->values, channels);
+    double columns[sizeof(BurstColumns) / sizeof(BurstColumns[0])];
+    uint32_t valid = 0;
+    for (size_t i = 0; i < sizeof(BurstColumns) / sizeof(BurstColumns[0]); i++) {
+        columns[i] = channels[BurstColumns[i]];
+        if (record->values.valid & CHANNEL_BIT(BurstColumns[i]))
+            valid |= 1U << i;
+    }
+
+    // a full batch goes out and the row starts the next one
+    if (BurstBatchAppend(&burst->batch, record->time.tv_sec, columns, valid, sizeof(columns) / sizeof(columns[0])) != 0) {
+        flush_burst(app_state);
+        if (BurstBatchAppend(&burst->batch, record->time.tv_sec, columns, valid, sizeof(columns) / sizeof(columns[0])) != 0) {
+            LOG_ERROR("Failed to serialize burst sample\n");
+            burst->dropped++;
+            return;
+        }
+    }
+    burst->samples++;
+}
+
+void handle_burst_ended(application_state_t* app_state) {
+    flush_burst(app_state);
+    app_state->burst.active = false;
+    maybe_power_down(app_state);
+}
+
+// flicker results are a best effort extra, never worth overfilling the queue for
+void queue_flicker(application_state_t* app_state, const sample_record_t* record) {
+    if (!record->has_flicker || deque_count(app_state->pkt_outbound) >= app_state->tuning.queue_capacity)
+        return;
+    char* flicker = serialize_flicker(&app_state->payload_pool, record);
+    if (flicker == NULL)
+        return;
+    if (!deque_push_back(app_state->pkt_outbound, flicker)) {
+        SlabPoolFree(&app_state->payload_pool, flicker);
+        return;
+    }
+    upload_for_queued(app_state);
+}
+
+void drain_sample_ring(application_state_t* app_state) {
+    sample_record_t record;
+    while (SpscRingPop(&app_state->sample_ring, &record)) {
+        app_state->alerts_active = record.alerts_active;
+        if (record.alerts_raised != 0 || record.alerts_cleared != 0)
+            queue_alerts(app_state, &record);
+        if (!record.report) {
+            queue_flicker(app_state, &record);
+            continue;
+        }
+
+        // every other record in the ring was reported, mirror the deadband's reference for a power down
+        double channels[Channel_Count];
+        sensor_channels(&record.values, channels);
+        for (size_t i = 0; i < Channel_Count; i++) {
+            if (record.values.valid & CHANNEL_BIT(i))
+                app_state->reported[i] = channels[i];
+        }
+        app_state->reported_valid = record.values.valid;
+        app_state->reported_sample = record.sample_index;
+
+        if (record.burst) {
+            append_burst(app_state, &record);
+            continue;
+        }
+        // a lost Msg_BurstEnded is made up for by the first regular sample
+        if (!BurstBatchEmpty(&app_state->burst.batch)) {
+            flush_burst(app_state);
+            app_state->burst.active = false;
+        }
+
+        if (deque_count(app_state->pkt_outbound) >= app_state->tuning.queue_capacity) {
+            app_panic(app_state, ExitCode_QueueOverfill);
+            return;
+        }
+
+        char* payload = serialize_sensor_data(&app_state->payload_pool, &record);
+        if (payload == NULL) {
+            // TODO: should panic here or not?
+            LOG_ERROR("Failed to serialize sensor readings\n");
+            continue;
+        }
+
+        TraceRecord(TraceId_SampleQueued, (uint32_t)record.time.tv_sec, (uint32_t)deque_count(app_state->pkt_outbound), (uint32_t)strlen(payload_text(payload)));
+        if (!deque_push_back(app_state->pkt_outbound, payload)) {
+            app_panic(app_state, ExitCode_QueueingFailed);
+            SlabPoolFree(&app_state->payload_pool, payload);
+            return;
+        }
+
+        upload_for_queued(app_state);
+        queue_flicker(app_state, &record);
+    }
+    send_alerts(app_state);
+    maybe_power_down(app_state);
+}
+
+void handle_acquisition_msg(EventMailbox_t* mailbox, const mailbox_msg_t* msg, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    acquisition_t* acq = &app_state->acquisition;
+    switch ((AcquisitionMsg_t)msg->type) {
+    case AcqMsg_SetSampleInterval:
+        // a new grid, the old boundary may not be on it
+        acq->sample_interval_s = (time_t)msg->arg.u;
+        acq->next_nominal = 0;
+        arm_next_sample(acq);
+        // the lux mean keeps covering the whole new period, a burst re-paces it when it ends
+        if (acq->burst_until == 0)
+            pace_lux_window(acq);
+        DeadbandSetHeartbeat(&acq->deadband, report_heartbeat_samples(acq->sample_interval_s));
+        break;
+    case AcqMsg_SetClimateRate:
+        acq->climate_odr = (lps22hh_odr_t)msg->arg.i;
+        acq->retune = true;
+        break;
+    case AcqMsg_SetHumidityMode:
+        acq->humidity_mode = (humidity_mode_t)msg->arg.i;
+        acq->retune = true;
+        break;
+    case AcqMsg_StartBurst: {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const bool starting = acq->burst_until == 0;
+        acq->burst_until = now.tv_sec + (time_t)msg->arg.u;
+        if (starting) {
+            acq->retune = true;
+            acq->next_nominal = 0;
+            arm_next_sample(acq);
+            pace_lux_window(acq);
+        }
+        LOG_INFO("Burst sampling for %u s\n", (unsigned int)msg->arg.u);
+        break;
+    }
+    case AcqMsg_StopBurst:
+        end_burst(app_state);
+        break;
+    default:
+        if (msg->type >= AcqMsg_SetAlertLimit && msg->type < AcqMsg_SetAlertLimit + AlertLimit_Count) {
+            // a raised alert clears against the new limit on the next sample
+            set_alert_limit(&acq->alerts, (alert_limit_t)(msg->type - AcqMsg_SetAlertLimit), msg->arg.d);
+            break;
+        }
+        LOG_WARN("Unknown acquisition message %u\n", msg->type);
+        break;
+    }
+    if (!CoTaskRunning(&acq->sample_task))
+        apply_sensor_tuning(app_state);
+}
+
+void handle_acquisition_stop(EventLoopEvent_t* event, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    eventfd_t out = 0;
+    ConsumeEventLoopEvent(event, &out);
+
+    app_state->acquisition.exit_code = ExitCode_SigTerm;
+    EventLoop_Stop(app_state->acquisition.loop);
+}
+
+void handle_control_msg(EventMailbox_t* mailbox, const mailbox_msg_t* msg, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    switch ((ControlMsg_t)msg->type) {
+    case Msg_StateTransition:
+        enter_state(app_state, (MonitorState_t)msg->arg.i);
+        break;
+    case Msg_SampleReady:
+        drain_sample_ring(app_state);
+        break;
+    case Msg_DoWorkKick:
+        kick_do_work(app_state);
+        break;
+    case Msg_BurstEnded:
+        handle_burst_ended(app_state);
+        break;
+    case Msg_AcquisitionExit:
+        // the acquisition thread has died on its own
+        LOG_ERROR("Acquisition thread exited with code %i\n", (int)msg->arg.i);
+        app_panic(app_state, (ExitCode)msg->arg.i);
+        break;
+    default:
+        LOG_WARN("Unknown control message %u\n", msg->type);
+        break;
+    }
+}
+
+void* run_acquisition(void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    acquisition_t* acq = &app_state->acquisition;
+    while (acq->exit_code == ExitCode_Success) {
+        EventLoop_Run_Result result = EventLoop_Run(acq->loop, -1, false);
+        if (result == EventLoop_Run_Failed && errno != EINTR)
+            acq->exit_code = ExitCode_EventLoopFail_Acquisition;
+    }
+
+    if (acq->exit_code != ExitCode_SigTerm && !post_control_msg(app_state, Msg_AcquisitionExit, acq->exit_code))
+        LOG_ERROR("Control mailbox full, acquisition exit with code %i not delivered\n", acq->exit_code);
+    return NULL;
+}
+
+ExitCode init_acquisition(application_state_t* state) {
+    acquisition_t* acq = &state->acquisition;
+    acq->exit_code = ExitCode_Success;
+
+    acq->loop = EventLoop_Create();
+    if (acq->loop == NULL)
+        return ExitCode_EventLoop_Create_Acquisition;
+    acq->stop_event = CreateEventLoopEvent(acq->loop, handle_acquisition_stop, state);
+    if (acq->stop_event == NULL)
+        return ExitCode_CreateEventLoopEvent_AcquisitionStop;
+    acq->mailbox = CreateEventMailbox(acq->loop, AcquisitionMailboxCapacity, handle_acquisition_msg, state);
+    if (acq->mailbox == NULL)
+        return ExitCode_CreateEventMailbox_Acquisition;
+    acq->sample_timer = CreateEventLoopDisarmedTimer(acq->loop, handle_sample, state);
+    if (acq->sample_timer == NULL)
+        return ExitCode_CreateEventLoopDisarmedTimer_Sample;
+    SetEventLoopTimerSlack(acq->sample_timer, &SampleSlack);
+    arm_next_sample(acq);
+    if (CoTaskInit(&acq->sample_task, acq->loop, sample_sequence, state) < 0)
+        return ExitCode_CoTaskInit_Sample;
+    const struct timespec lux_interval = lux_poll_interval(sample_period(acq));
+    if (AdcWindowInit(&acq->lux_window, acq->loop, state->sensors.fds.adc, LIGHT_ADC_CHANNEL, &lux_interval, LuxWindowCapacity) < 0)
+        return ExitCode_AdcWindowInit_Lux;
+    if (AlertRulesInit(&acq->alerts, AlertRules, AlertRuleCount) < 0)
+        return ExitCode_AlertRulesInit;
+    // alerts raised before a power down stay raised
+    AlertRulesRestore(&acq->alerts, state->alerts_active);
+    if (DeadbandInit(&acq->deadband, ChannelDeadband, Channel_Count, report_heartbeat_samples(acq->sample_interval_s)) < 0)
+        return ExitCode_DeadbandInit;
+    for (size_t i = 0; i < Channel_Count; i++)
+        DeadbandSetRelative(&acq->deadband, i, ChannelRelativeDeadband[i]);
+    // and held back samples keep counting towards the heartbeat
+    if (state->reported_valid != 0)
+        DeadbandRestore(&acq->deadband, state->reported, state->reported_valid, acq->sample_count - state->reported_sample,
+            atomic_load_explicit(&acq->suppressed, memory_order_relaxed));
+    // instrumentation only, a failed name just leaves the handler out of the report
+    SetEventLoopEventName(acq->stop_event, "acq_stop");
+    SetEventLoopTimerName(acq->sample_timer, "sample");
+    SetEventMailboxName(acq->mailbox, "acq_tuning");
+    CoTaskSetName(&acq->sample_task, "sample_seq");
+    AdcWindowSetName(&acq->lux_window, "lux_adc");
+
+    // the loop and its timers were built on this thread, from here on only the new thread touches them
+    if (pthread_create(&acq->thread, NULL, run_acquisition, state) != 0)
+        return ExitCode_pthread_create_Acquisition;
+    acq->thread_started = true;
+    return ExitCode_Success;
+}
+
+void destroy_acquisition(acquisition_t* acq) {
+    if (acq->thread_started) {
+        PostEventLoopEvent(acq->stop_event);
+        pthread_join(acq->thread, NULL);
+        acq->thread_started = false;
+    }
+    if (acq->stop_event)
+        DisposeEventLoopEvent(acq->stop_event);
+    if (acq->mailbox)
+        DisposeEventMailbox(acq->mailbox);
+    if (acq->sample_timer)
+        DisposeEventLoopTimer(acq->sample_timer);
+    CoTaskDestroy(&acq->sample_task);
+    AdcWindowDestroy(&acq->lux_window);
+    if (acq->loop)
+        EventLoop_Close(acq->loop);
+}
+
+// AcquisitionHeartbeatSamples intervals and the conversion wait of the last sample. The watchdog itself keeps
+// its period, the feeds only stop once this runs out
+time_t acquisition_heartbeat_timeout(uint32_t sample_interval_s) {
+    return (time_t)AcquisitionHeartbeatSamples * sample_interval_s + ChirpConversionTime.tv_sec + 1;
+}
+
+int feed_watchdog(watchdog_t* wd) {
+    struct itimerspec expiry = { .it_value = WatchdogTimeout, .it_interval = WatchdogTimeout };
+    return timer_settime(wd->timer, 0, &expiry, NULL);
+}
+
+// the feed timer proves the main loop is turning, the heartbeat proves the acquisition loop is,
+// and a new budget overrun anywhere holds the feed back until handlers behave again
+void handle_watchdog_feed(EventLoopTimer* timer, void* ctx) {
+    application_state_t* app_state = (application_state_t*)ctx;
+    if (ConsumeEventLoopTimerEvent(timer) != 0) {
+        app_panic(app_state, ExitCode_ConsumeEventLoopTimerEvent);
+        return;
+    }
+
+    watchdog_t* wd = &app_state->watchdog;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    const unsigned int heartbeat = atomic_load_explicit(&app_state->acquisition.heartbeat, memory_order_relaxed);
+    if (heartbeat != wd->last_heartbeat) {
+        wd->last_heartbeat = heartbeat;
+        wd->heartbeat_seen = now;
+    }
+    const bool acquisition_alive = now.tv_sec - wd->heartbeat_seen.tv_sec <= acquisition_heartbeat_timeout(app_state->tuning.sample_interval_s);
+
+    // withholding a single feed would go unnoticed inside the timeout, so after an overrun no feed goes out
+    // until a whole watchdog window passed without another one. The watchdog fires first, an overrun counts as a hang
+    const uint32_t overruns = HandlerStatsOverruns();
+    if (overruns != wd->last_overruns) {
+        wd->last_overruns = overruns;
+        wd->overrun_seen = now;
+    }
+    const bool within_budget = wd->overrun_seen.tv_sec == 0 || now.tv_sec - wd->overrun_seen.tv_sec >= WatchdogTimeout.tv_sec;
+
+    if (acquisition_alive && within_budget && feed_watchdog(wd) == 0)
+        wd->feeds++;
+    else {
+        wd->withheld++;
+        LOG_WARN("Withholding watchdog feed, acquisition %s, %u overruns\n", acquisition_alive ? "alive" : "silent", overruns);
+    }
+}
+
+ExitCode init_watchdog(application_state_t* state) {
+    watchdog_t* wd = &state->watchdog;
+    struct sigevent alarm_event = { .sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGALRM };
+    if (timer_create(CLOCK_MONOTONIC, &alarm_event, &wd->timer) == -1)
+        return ExitCode_timer_create_Watchdog;
+    wd->started = true;
+    clock_gettime(CLOCK_MONOTONIC, &wd->heartbeat_seen);
+    wd->last_overruns = HandlerStatsOverruns();
+    feed_watchdog(wd);
+
+    wd->feed_timer = CreateEventLoopPeriodicTimer(state->loop, handle_watchdog_feed, state, &WatchdogFeedInterval);
+    if (wd->feed_timer == NULL)
+        return ExitCode_CreateEventLoopPeriodicTimer_Watchdog;
+    SetEventLoopTimerSlack(wd->feed_timer, &NetPollSlack);
+    SetEventLoopTimerName(wd->feed_timer, "watchdog");
+    return ExitCode_Success;
+}
+
+void destroy_watchdog(watchdog_t* wd) {
+    if (wd->feed_timer)
+        DisposeEventLoopTimer(wd->feed_timer);
+    if (wd->started)
+        timer_delete(wd->timer);
 }
 
 void sigterm_handler(int signalNumber) {
@@ -584,8 +2492,8 @@ void handle_sigterm_event(EventLoopEvent_t* event, void* ctx) {
     eventfd_t out = 0;
     ConsumeEventLoopEvent(event, &out);
 
-    Log_Debug("Got SIGTERM, aborting...\n");
-    EventLoop_Stop(app_state->loop);
+    LOG_INFO("Got SIGTERM, aborting...\n");
+    app_panic(app_state, ExitCode_SigTerm);
 }
 
 ExitCode init_application(application_state_t* state) {
@@ -594,13 +2502,52 @@ ExitCode init_application(application_state_t* state) {
     action.sa_handler = sigterm_handler;
     sigaction(SIGTERM, &action, NULL);
 
-    pthread_mutex_init(&state->pkt_queues_lock, NULL);
-    state->pkt_outbound = deque_new(QueueMaxCapacity, &(struct deque_fval){ 0 });
+    HandlerStatsSetStallThreshold(HandlerStallThresholdMs);
+    HandlerStatsSetBudget("sample", SampleBudgetMs);
+    HandlerStatsSetBudget("sample_seq", SampleSequenceBudgetMs);
+    HandlerStatsSetBudget("lux_adc", LuxPollBudgetMs);
+    HandlerStatsSetBudget("upload", UploadBudgetMs);
+    HandlerStatsSetBudget("azure_auth", AzureAuthBudgetMs);
+    HandlerStatsSetBudget("do_work", DoWorkBudgetMs);
+    HandlerStatsSetBudget("no_network", NoNetworkBudgetMs);
+    HandlerStatsSetBudget("reconnect", ReconnectBudgetMs);
+    HandlerStatsSetBudget("control", ControlBudgetMs);
+
+    state->tuning = (tuning_t) {
+        .sample_interval_s = (uint32_t)SampleInterval.tv_sec,
+        .upload_min_s = (uint32_t)UploadMinInterval.tv_sec,
+        .upload_max_s = (uint32_t)UploadMaxInterval.tv_sec,
+        .upload_slo_s = (uint32_t)UploadLatencySlo.tv_sec,
+        .queue_capacity = (uint32_t)QueueDefaultCapacity
+    };
+    for (size_t i = 0; i < AlertLimit_Count; i++)
+        state->tuning.alert_limits[i] = default_alert_limit((alert_limit_t)i);
+    state->acquisition.sample_interval_s = SampleInterval.tv_sec;
+    const upload_pacer_config_t config = pacer_config(&state->tuning);
+    UploadPacerInit(&state->upload_pacer, &config);
+
+    if (SpscRingInit(&state->sample_ring, sizeof(sample_record_t), SampleRingCapacity) < 0)
+        return ExitCode_SpscRingInit_Samples;
+    if (SlabPoolInit(&state->payload_pool, PacketMaxBytes, PayloadPoolSlabs) < 0)
+        return ExitCode_SlabPoolInit_Payload;
+    if (BurstBatchInit(&state->burst.batch, DeviceName, BurstBatchMaxBytes, BurstBatchMaxRows) < 0)
+        return ExitCode_BurstBatchInit;
+    state->pkt_outbound = deque_new_custom(QueueDefaultCapacity, &(struct deque_fval){ 0 }, &deque_allocator, NULL);
     if (state->pkt_outbound == NULL)
         return ExitCode_deque_new_outbound;
-    state->pkt_in_flight = deque_new(QueueMaxCapacity, &(struct deque_fval){ 0 });
+    state->pkt_in_flight = deque_new_custom(QueueDefaultCapacity, &(struct deque_fval){ 0 }, &deque_allocator, NULL);
     if (state->pkt_in_flight == NULL)
         return ExitCode_deque_new_in_flight;
+    state->pkt_alerts = deque_new_custom(AlertQueueCapacity, &(struct deque_fval){ 0 }, &deque_allocator, NULL);
+    if (state->pkt_alerts == NULL)
+        return ExitCode_deque_new_alerts;
+
+    // before the acquisition thread exists, the restored sample count is its own
+    restore_outbox(state);
+    if (state->warm_start)
+        resume_sensors(&state->sensors);
+    else
+        start_or_restart_sensors(&state->sensors);
 
     state->loop = EventLoop_Create();
     if (state->loop == NULL)
@@ -612,30 +2559,50 @@ ExitCode init_application(application_state_t* state) {
         return ExitCode_CreateEventLoopEvent_Panic;
     sigterm_event = state->sigterm_event;
     
-    state->state_transition_event = CreateEventLoopEvent(state->loop, handle_state_transition, state);
-    if (state->state_transition_event == NULL)
-        return ExitCode_CreateEventLoopEvent_StateTransition;
+    state->control_mailbox = CreateEventMailbox(state->loop, ControlMailboxCapacity, handle_control_msg, state);
+    if (state->control_mailbox == NULL)
+        return ExitCode_CreateEventMailbox_Control;
 
     state->no_network_timer = CreateEventLoopDisarmedTimer(state->loop, handle_no_network, state);
     if (state->no_network_timer == NULL)
         return ExitCode_CreateEventLoopDisarmedTimer_NetRdy;
+    SetEventLoopTimerSlack(state->no_network_timer, &NetPollSlack);
     state->azure_auth_timer = CreateEventLoopDisarmedTimer(state->loop, handle_azure_auth, state);
     if (state->azure_auth_timer == NULL)
         return ExitCode_CreateEventLoopDisarmedTimer_AzureAuth;
+    SetEventLoopTimerSlack(state->azure_auth_timer, &AzureAuthPollSlack);
     state->upload_timer = CreateEventLoopDisarmedTimer(state->loop, handle_upload, state);
     if (state->upload_timer == NULL)
         return ExitCode_CreateEventLoopDisarmedTimer_Upload;
+    SetEventLoopTimerSlack(state->upload_timer, &UploadSlack);
     state->dowork_timer = CreateEventLoopDisarmedTimer(state->loop, handle_do_work, state);
     if (state->dowork_timer == NULL)
         return ExitCode_CreateEventLoopDisarmedTimer_DoWork;
-
-    state->sample_timer = CreateEventLoopPeriodicTimer(state->loop, handle_sample, state, &SampleInterval);
-    if (state->sample_timer == NULL)
-        return ExitCode_CreateEventLoopPeriodicTimer_Sample;
+    state->reconnect_timer = CreateEventLoopDisarmedTimer(state->loop, handle_reconnect, state);
+    if (state->reconnect_timer == NULL)
+        return ExitCode_CreateEventLoopDisarmedTimer_Reconnect;
+    SetEventLoopTimerSlack(state->reconnect_timer, &ReconnectSlack);
+    // seeded from the boot timing so devices that lost the hub together retry apart
+    struct timespec seed;
+    clock_gettime(CLOCK_MONOTONIC, &seed);
+    BackoffInit(&state->connection.backoff, AzureBackoffBaseMs, AzureBackoffMaxMs, (uint32_t)seed.tv_nsec ^ (uint32_t)seed.tv_sec);
+    IdleBackoffInit(&state->dowork_backoff, (uint32_t)timespec_to_ms(&IoTDoWorkInterval), (uint32_t)timespec_to_ms(&IoTDoWorkMaxInterval));
+
+    // instrumentation only, a failed name just leaves the handler out of the report
+    SetEventLoopEventName(state->sigterm_event, "sigterm");
+    SetEventMailboxName(state->control_mailbox, "control");
+    SetEventLoopTimerName(state->no_network_timer, "no_network");
+    SetEventLoopTimerName(state->azure_auth_timer, "azure_auth");
+    SetEventLoopTimerName(state->upload_timer, "upload");
+    SetEventLoopTimerName(state->dowork_timer, "do_work");
+    SetEventLoopTimerName(state->reconnect_timer, "reconnect");
 
     APP_REQUEST_TRANSITION(state, State_NoNetwork);
 
-    return ExitCode_Success;
+    ExitCode ret = init_acquisition(state);
+    if (ret != ExitCode_Success)
+        return ret;
+    return init_watchdog(state);
 }
 
 ExitCode run_application(application_state_t* state) {
@@ -650,17 +2617,21 @@ ExitCode run_application(application_state_t* state) {
     return state->last_thread_exit_code;
 }
 
-void destroy_pkt_deque(deque_t* pkt_d) {
+void destroy_pkt_deque(deque_t* pkt_d, slab_pool_t* pool) {
     while (!deque_empty(pkt_d)) {
-        IoTHubMessage_Destroy(deque_front(pkt_d));
+        SlabPoolFree(pool, deque_front(pkt_d));
         deque_pop_front(pkt_d);
     }
     deque_free(pkt_d);
 }
 
 void destroy_application(application_state_t* state) {
-    if (state->state_transition_event)
-        DisposeEventLoopEvent(state->state_transition_event);
+    // stop the producer first so nothing is posted to the main loop while it is torn down
+    destroy_acquisition(&state->acquisition);
+    destroy_watchdog(&state->watchdog);
+
+    if (state->control_mailbox)
+        DisposeEventMailbox(state->control_mailbox);
     if (state->sigterm_event) {
         DisposeEventLoopEvent(state->sigterm_event);
         sigterm_event = NULL;
@@ -673,18 +2644,26 @@ void destroy_application(application_state_t* state) {
         DisposeEventLoopTimer(state->upload_timer);
     if (state->dowork_timer)
         DisposeEventLoopTimer(state->dowork_timer);
-    if (state->sample_timer)
-        DisposeEventLoopTimer(state->sample_timer);
+    if (state->reconnect_timer)
+        DisposeEventLoopTimer(state->reconnect_timer);
     if (state->loop)
         EventLoop_Close(state->loop);
     if (state->iothub_handle)
         IoTHubDeviceClient_LL_Destroy(state->iothub_handle);
+    if (state->connection.security_ready)
+        iothub_security_deinit();
 
     if (state->pkt_outbound)
-        destroy_pkt_deque(state->pkt_outbound);
+        destroy_pkt_deque(state->pkt_outbound, &state->payload_pool);
     if (state->pkt_in_flight)
-        destroy_pkt_deque(state->pkt_in_flight);
-    pthread_mutex_destroy(&state->pkt_queues_lock);
+        destroy_pkt_deque(state->pkt_in_flight, &state->payload_pool);
+    if (state->pkt_alerts)
+        destroy_pkt_deque(state->pkt_alerts, &state->payload_pool);
+    BurstBatchDestroy(&state->burst.batch);
+    SlabPoolDestroy(&state->payload_pool);
+    SpscRingDestroy(&state->sample_ring);
+    if (state->store_fd >= 0)
+        close(state->store_fd);
 
     stop_system_devices(&state->sensors.fds);
     zero_application_state(state);
@@ -695,25 +2674,26 @@ int main(void)
     application_state_t app_state;
     zero_application_state(&app_state);
     
-    Log_Debug("Booting up!\n");
+    LOG_INFO("Booting up!\n");
 
-    Log_Debug("Initializing peripherals...");
+    LOG_INFO("Initializing peripherals...");
     ExitCode exit = start_peripherals(&app_state);
     if (exit != ExitCode_Success)
         goto fail;
-    Log_Debug("done\n");
+    LOG_INFO("done\n");
 
-    Log_Debug("Starting application handlers...");
+    LOG_INFO("Starting application handlers...");
     exit = init_application(&app_state);
     if (exit != ExitCode_Success)
         goto fail;
-    Log_Debug("done\n");
+    LOG_INFO("done\n");
 
-    Log_Debug("Welcome azure sphere plant monitor!\n");
+    LOG_INFO("Welcome azure sphere plant monitor!\n");
     exit = run_application(&app_state);
 
 fail:
-    Log_Debug("\nRunning failed with exit code %i and errno %s\n", exit, strerror(errno));
+    LOG_ERROR("\nRunning failed with exit code %i and errno %s\n", exit, strerror(errno));
+    TraceDump();
     destroy_application(&app_state);
     return exit;
 }
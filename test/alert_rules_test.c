@@ -0,0 +1,119 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "test.h"
+#include "alert_rules.h"
+
+// a soil moisture channel and a temperature channel, as main.c watches them
+static const alert_rule_t rules[] = {
+	{ .name = "soil_dry", .channel = 0, .kind = AlertKind_Below, .low = 350, .hysteresis = 25 },
+	{ .name = "temperature", .channel = 1, .kind = AlertKind_Outside, .low = 5, .high = 35, .hysteresis = 1 },
+	{ .name = "hot", .channel = 1, .kind = AlertKind_Above, .high = 40, .hysteresis = 2 }
+};
+#define RULE_COUNT (sizeof(rules) / sizeof(rules[0]))
+#define ALL_VALID 0x3U
+
+static uint32_t evaluate(alert_rules_t* set, double soil, double temperature, uint32_t* cleared) {
+	const double values[] = { soil, temperature };
+	return AlertRulesEvaluate(set, values, ALL_VALID, cleared);
+}
+
+static void crossing_a_limit_raises_once(void) {
+	alert_rules_t set;
+	CHECK_EQ(AlertRulesInit(&set, rules, RULE_COUNT), 0);
+	uint32_t cleared;
+	CHECK_EQ(evaluate(&set, 400, 20, &cleared), 0);
+	CHECK_EQ(evaluate(&set, 340, 20, &cleared), 0x1U);
+	CHECK_EQ(cleared, 0);
+	// still dry, nothing new to say
+	CHECK_EQ(evaluate(&set, 300, 20, &cleared), 0);
+	CHECK_EQ(AlertRulesActive(&set), 0x1U);
+
+	// both temperature rules trip on the same sample
+	CHECK_EQ(evaluate(&set, 300, 41, &cleared), 0x6U);
+	CHECK_EQ(AlertRulesActive(&set), 0x7U);
+}
+
+static void clearing_waits_for_the_hysteresis(void) {
+	alert_rules_t set;
+	CHECK_EQ(AlertRulesInit(&set, rules, RULE_COUNT), 0);
+	uint32_t cleared;
+	CHECK_EQ(evaluate(&set, 340, 4, &cleared), 0x3U);
+
+	// back over the limit but inside the band, a value sitting on the limit does not flap
+	CHECK_EQ(evaluate(&set, 360, 5.5, &cleared), 0);
+	CHECK_EQ(cleared, 0);
+	CHECK_EQ(evaluate(&set, 349, 4.9, &cleared), 0);
+	CHECK_EQ(cleared, 0);
+	CHECK_EQ(AlertRulesActive(&set), 0x3U);
+
+	CHECK_EQ(evaluate(&set, 375, 6, &cleared), 0);
+	CHECK_EQ(cleared, 0x3U);
+	CHECK_EQ(AlertRulesActive(&set), 0);
+	// and raises again on the next crossing
+	CHECK_EQ(evaluate(&set, 349, 20, &cleared), 0x1U);
+}
+
+static void an_unread_channel_keeps_its_state(void) {
+	alert_rules_t set;
+	CHECK_EQ(AlertRulesInit(&set, rules, RULE_COUNT), 0);
+	uint32_t cleared;
+	const double dry[] = { 300, 20 };
+	CHECK_EQ(AlertRulesEvaluate(&set, dry, ALL_VALID, &cleared), 0x1U);
+	// a failed soil read is not a recovery
+	const double unread[] = { 0, 20 };
+	CHECK_EQ(AlertRulesEvaluate(&set, unread, 0x2U, &cleared), 0);
+	CHECK_EQ(cleared, 0);
+	CHECK_EQ(AlertRulesActive(&set), 0x1U);
+}
+
+static void restored_alerts_are_not_raised_again(void) {
+	alert_rules_t set;
+	CHECK_EQ(AlertRulesInit(&set, rules, RULE_COUNT), 0);
+	// bits past the rule count are dropped
+	AlertRulesRestore(&set, 0x1U | 0x80U);
+	CHECK_EQ(AlertRulesActive(&set), 0x1U);
+	uint32_t cleared;
+	CHECK_EQ(evaluate(&set, 300, 20, &cleared), 0);
+	CHECK_EQ(evaluate(&set, 400, 20, &cleared), 0);
+	CHECK_EQ(cleared, 0x1U);
+}
+
+static void tuned_limits_apply_to_the_copy(void) {
+	alert_rules_t set;
+	CHECK_EQ(AlertRulesInit(&set, rules, RULE_COUNT), 0);
+	uint32_t cleared;
+	CHECK_EQ(evaluate(&set, 340, 20, &cleared), 0x1U);
+
+	// a lower limit clears the raised alert once the value is its hysteresis above it
+	CHECK_EQ(AlertRulesSetLimit(&set, 0, false, 300), 0);
+	CHECK_EQ(evaluate(&set, 340, 20, &cleared), 0);
+	CHECK_EQ(cleared, 0x1U);
+	CHECK_EQ(evaluate(&set, 310, 20, &cleared), 0);
+	CHECK_EQ(evaluate(&set, 290, 20, &cleared), 0x1U);
+
+	CHECK_EQ(AlertRulesSetLimit(&set, 1, true, 25), 0);
+	CHECK_EQ(evaluate(&set, 290, 26, &cleared), 0x2U);
+	CHECK_EQ(AlertRulesSetLimit(&set, RULE_COUNT, true, 25), -1);
+	// the caller's table is untouched
+	CHECK(rules[0].low == 350);
+	CHECK(AlertRulesGet(&set, 1)->high == 25);
+}
+
+static void too_many_rules_are_refused(void) {
+	static alert_rule_t many[ALERT_RULES_MAX + 1];
+	alert_rules_t set;
+	CHECK_EQ(AlertRulesInit(&set, many, ALERT_RULES_MAX + 1), -1);
+	CHECK_EQ(AlertRulesInit(&set, many, ALERT_RULES_MAX), 0);
+	CHECK_EQ(AlertRulesCount(&set), ALERT_RULES_MAX);
+}
+
+int main(void) {
+	RUN_TEST(crossing_a_limit_raises_once);
+	RUN_TEST(clearing_waits_for_the_hysteresis);
+	RUN_TEST(an_unread_channel_keeps_its_state);
+	RUN_TEST(restored_alerts_are_not_raised_again);
+	RUN_TEST(tuned_limits_apply_to_the_copy);
+	RUN_TEST(too_many_rules_are_refused);
+	return TEST_EXIT();
+}
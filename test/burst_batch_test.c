@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+#include "burst_batch.h"
+
+static const double columns[] = { 21.5, 1013.25, 45.0, 350.25 };
+#define ALL_VALID 0xfU
+
+static void rows_are_framed_in_one_payload(void) {
+	burst_batch_t batch;
+	CHECK_EQ(BurstBatchInit(&batch, "plant0", 1024, 60), 0);
+	CHECK(BurstBatchEmpty(&batch));
+	size_t len = 0;
+	CHECK(BurstBatchFinish(&batch, &len) == NULL);
+
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000000, columns, ALL_VALID, 4), 0);
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000001, columns, 0x5U, 4), 0);
+	CHECK_EQ(BurstBatchRows(&batch), 2);
+	CHECK_EQ(BurstBatchTime(&batch), 1700000000);
+
+	const char* text = BurstBatchFinish(&batch, &len);
+	static const char expected[] = "{\"meta\":{\"time\":1700000000,\"name\":\"plant0\"},\"burst\":{\"rows\":["
+		"[0,21.50,1013.25,45.00,350.25],[1,21.50,null,45.00,null]]}}";
+	CHECK(text != NULL && strcmp(text, expected) == 0);
+	CHECK_EQ(len, strlen(expected));
+	CHECK(BurstBatchEmpty(&batch));
+
+	// the next batch starts over with its own time
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000060, columns, ALL_VALID, 1), 0);
+	text = BurstBatchFinish(&batch, &len);
+	CHECK(text != NULL && strcmp(text, "{\"meta\":{\"time\":1700000060,\"name\":\"plant0\"},\"burst\":{\"rows\":[[0,21.50]]}}") == 0);
+	BurstBatchDestroy(&batch);
+}
+
+static void a_minute_of_rows_fits_one_payload(void) {
+	burst_batch_t batch;
+	CHECK_EQ(BurstBatchInit(&batch, "plant0", 3072, 60), 0);
+	static const double wide[] = { -40.25, 1260.75, 100.0, 120000.5 };
+	for (int i = 0; i < 60; i++)
+		CHECK_EQ(BurstBatchAppend(&batch, 1700000000 + i, wide, ALL_VALID, 4), 0);
+	// the row limit closes the batch
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000060, wide, ALL_VALID, 4), -1);
+	CHECK_EQ(BurstBatchRows(&batch), 60);
+	size_t len;
+	const char* text = BurstBatchFinish(&batch, &len);
+	CHECK(text != NULL && len < 3072 && strcmp(text + len - 13, "120000.50]]}}") == 0);
+	BurstBatchDestroy(&batch);
+}
+
+static void a_full_buffer_refuses_the_row_whole(void) {
+	burst_batch_t batch;
+	// room for the head and a little more than one row
+	CHECK_EQ(BurstBatchInit(&batch, "plant0", 110, 60), 0);
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000000, columns, ALL_VALID, 4), 0);
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000001, columns, ALL_VALID, 4), -1);
+	CHECK_EQ(BurstBatchRows(&batch), 1);
+
+	// the refused row left nothing behind, and starts the next batch
+	size_t len;
+	const char* text = BurstBatchFinish(&batch, &len);
+	CHECK(text != NULL && strcmp(text + len - 10, "350.25]]}}") == 0);
+	CHECK_EQ(BurstBatchAppend(&batch, 1700000001, columns, ALL_VALID, 4), 0);
+	CHECK_EQ(BurstBatchTime(&batch), 1700000001);
+
+	// and a row that can never fit is refused without writing past the buffer
+	burst_batch_t tiny;
+	CHECK_EQ(BurstBatchInit(&tiny, "plant0", 40, 60), 0);
+	CHECK_EQ(BurstBatchAppend(&tiny, 1700000000, columns, ALL_VALID, 4), -1);
+	CHECK(BurstBatchEmpty(&tiny));
+	BurstBatchDestroy(&tiny);
+	BurstBatchDestroy(&batch);
+}
+
+int main(void) {
+	RUN_TEST(rows_are_framed_in_one_payload);
+	RUN_TEST(a_minute_of_rows_fits_one_payload);
+	RUN_TEST(a_full_buffer_refuses_the_row_whole);
+	return TEST_EXIT();
+}
@@ -0,0 +1,234 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "burst_batch.h"
+#include "slab_pool.h"
+#include "upload_pacer.h"
+
+// the burst path as main.c configures it: a row a second into a batch of up to a minute of rows, the
+// full batch copied into a payload from the pool and queued, sent right away while connected
+#define BURST_MAX_ROWS 60
+#define BURST_MAX_BYTES 3072
+#define PACKET_MAX_BYTES 320
+#define POOL_SLABS 50
+#define QUEUE_CAPACITY 50
+#define BATCH_MAX 16
+#define PAYLOAD_HEADER_BYTES 16 // payload_header_t, the queue time and the alert flag
+#define START_TIME 1700000000
+
+static const upload_pacer_config_t config = {
+	.min_interval_s = 60,
+	.max_interval_s = 1800,
+	.latency_slo_s = 900,
+	.slack_s = 30,
+	.batch_max = BATCH_MAX,
+	.slow_ack_ms = 5000
+};
+
+typedef struct {
+	uint32_t duration_s;
+	bool connected; // during the burst, the link is up in any case once it ends
+	uint32_t preload; // regular sample payloads already queued when the burst starts
+} sim_config_t;
+
+typedef struct {
+	uint32_t rows;
+	uint32_t rows_dropped;
+	uint32_t batches;
+	uint32_t max_queued;
+	uint32_t max_in_flight;
+	uint32_t uploads_to_drain; // after the burst
+	// the most a single 1 s tick did
+	uint32_t max_tick_rows; // formatted into the batch
+	size_t max_tick_bytes; // copied into payloads
+	uint32_t max_tick_allocs;
+	uint32_t max_tick_sends;
+	slab_pool_stats_t pool;
+} sim_result_t;
+
+typedef struct {
+	slab_pool_t pool;
+	burst_batch_t batch;
+	upload_pacer_t pacer;
+	char* queue[QUEUE_CAPACITY];
+	size_t queued;
+	char* in_flight[QUEUE_CAPACITY];
+	size_t in_flight_count;
+	uint32_t tick_rows;
+	size_t tick_bytes;
+	uint32_t tick_allocs;
+	uint32_t tick_sends;
+	sim_result_t result;
+} sim_t;
+
+static void track(sim_t* sim) {
+	if (sim->queued > sim->result.max_queued)
+		sim->result.max_queued = (uint32_t)sim->queued;
+	if (sim->in_flight_count > sim->result.max_in_flight)
+		sim->result.max_in_flight = (uint32_t)sim->in_flight_count;
+}
+
+// send_outbound_batch, the confirmations arrive before the next tick
+static void send(sim_t* sim) {
+	while (sim->queued > 0 && sim->in_flight_count < QUEUE_CAPACITY && sim->tick_sends < BATCH_MAX) {
+		sim->in_flight[sim->in_flight_count++] = sim->queue[0];
+		memmove(sim->queue, sim->queue + 1, --sim->queued * sizeof(char*));
+		sim->tick_sends++;
+	}
+	track(sim);
+}
+
+static void confirm(sim_t* sim) {
+	for (size_t i = 0; i < sim->in_flight_count; i++) {
+		SlabPoolFree(&sim->pool, sim->in_flight[i]);
+		UploadPacerAck(&sim->pacer, 800, true);
+	}
+	sim->in_flight_count = 0;
+}
+
+// flush_burst: best effort, a full queue drops the batch
+static void flush(sim_t* sim, bool connected) {
+	const uint32_t rows = BurstBatchRows(&sim->batch);
+	size_t len;
+	const char* text = BurstBatchFinish(&sim->batch, &len);
+	if (text == NULL)
+		return;
+	char* payload = sim->queued < QUEUE_CAPACITY ? SlabPoolAllocSize(&sim->pool, PAYLOAD_HEADER_BYTES + len + 1) : NULL;
+	if (payload == NULL) {
+		sim->result.rows_dropped += rows;
+		return;
+	}
+	sim->tick_allocs++;
+	memcpy(payload + PAYLOAD_HEADER_BYTES, text, len + 1);
+	sim->tick_bytes += len + 1;
+	sim->queue[sim->queued++] = payload;
+	sim->result.batches++;
+	track(sim);
+	if (connected)
+		send(sim);
+}
+
+// append_burst, with columns that move a little every second
+static void append(sim_t* sim, uint32_t t, bool connected) {
+	const double columns[] = { 21.5 + (t % 50) * 0.01, 1013.25 - (t % 7) * 0.25, 45.0 + (t % 13) * 0.5, 350.0 + (t % 400) * 30.25 };
+	const uint32_t valid = t % 97 == 0 ? 0x7U : 0xfU; // the odd failed lux poll
+	sim->tick_rows++;
+	if (BurstBatchAppend(&sim->batch, START_TIME + t, columns, valid, 4) != 0) {
+		flush(sim, connected);
+		sim->tick_rows++;
+		if (BurstBatchAppend(&sim->batch, START_TIME + t, columns, valid, 4) != 0) {
+			sim->result.rows_dropped++;
+			return;
+		}
+	}
+	sim->result.rows++;
+}
+
+static void end_tick(sim_t* sim) {
+	if (sim->tick_rows > sim->result.max_tick_rows)
+		sim->result.max_tick_rows = sim->tick_rows;
+	if (sim->tick_bytes > sim->result.max_tick_bytes)
+		sim->result.max_tick_bytes = sim->tick_bytes;
+	if (sim->tick_allocs > sim->result.max_tick_allocs)
+		sim->result.max_tick_allocs = sim->tick_allocs;
+	if (sim->tick_sends > sim->result.max_tick_sends)
+		sim->result.max_tick_sends = sim->tick_sends;
+	sim->tick_rows = 0;
+	sim->tick_bytes = 0;
+	sim->tick_allocs = 0;
+	sim->tick_sends = 0;
+	confirm(sim);
+}
+
+static sim_result_t simulate(const sim_config_t* cfg) {
+	static sim_t sim;
+	memset(&sim, 0, sizeof(sim));
+	CHECK_EQ(SlabPoolInit(&sim.pool, PACKET_MAX_BYTES, POOL_SLABS), 0);
+	CHECK_EQ(BurstBatchInit(&sim.batch, "plant0", BURST_MAX_BYTES, BURST_MAX_ROWS), 0);
+	UploadPacerInit(&sim.pacer, &config);
+	for (uint32_t i = 0; i < cfg->preload; i++) {
+		char* payload = SlabPoolAllocSize(&sim.pool, PACKET_MAX_BYTES);
+		CHECK(payload != NULL);
+		sim.queue[sim.queued++] = payload;
+	}
+
+	for (uint32_t t = 0; t < cfg->duration_s; t++) {
+		append(&sim, t, cfg->connected);
+		end_tick(&sim);
+	}
+	// handle_burst_ended queues the partial batch
+	flush(&sim, cfg->connected);
+	end_tick(&sim);
+
+	// the link is up from here, each upload sends a batch and the pacer picks the next
+	while (sim.queued > 0 && sim.result.uploads_to_drain < 100) {
+		sim.result.uploads_to_drain++;
+		UploadPacerUploadStarted(&sim.pacer, 0);
+		send(&sim);
+		end_tick(&sim);
+		UploadPacerNextS(&sim.pacer, sim.queued, 0);
+	}
+	sim.result.pool = SlabPoolStats(&sim.pool);
+	BurstBatchDestroy(&sim.batch);
+	SlabPoolDestroy(&sim.pool);
+	return sim.result;
+}
+
+static void report(const char* name, const sim_result_t* result) {
+	fprintf(stderr, "  %s: %u rows in %u batches, %u dropped, queue peak %u of %u, %u uploads to drain, per tick at most %u rows, %zu bytes copied, %u allocations, %u sends\n",
+		name, result->rows, result->batches, result->rows_dropped, result->max_queued, QUEUE_CAPACITY, result->uploads_to_drain,
+		result->max_tick_rows, result->max_tick_bytes, result->max_tick_allocs, result->max_tick_sends);
+}
+
+static void check_bounded(const sim_result_t* result, uint32_t duration_s, uint32_t preload) {
+	CHECK_EQ(result->rows, duration_s);
+	CHECK_EQ(result->rows_dropped, 0);
+	CHECK_EQ(result->batches, (duration_s + BURST_MAX_ROWS - 1) / BURST_MAX_ROWS);
+	CHECK(result->max_queued < QUEUE_CAPACITY);
+	// a tick formats its row, a second time when it closed the batch, and copies at most one batch
+	CHECK(result->max_tick_rows <= 2);
+	CHECK(result->max_tick_bytes <= BURST_MAX_BYTES);
+	CHECK(result->max_tick_allocs <= 1);
+	CHECK(result->max_tick_sends <= BATCH_MAX);
+	// the batches are larger than a slab and come from the heap, the regular payloads keep the slabs
+	CHECK_EQ(result->pool.misses, result->batches);
+	CHECK_EQ(result->pool.hits, preload);
+	CHECK_EQ(result->pool.in_use, 0);
+}
+
+static void connected_burst_goes_out_a_minute_at_a_time(void) {
+	const sim_config_t cfg = { .duration_s = 600, .connected = true };
+	const sim_result_t result = simulate(&cfg);
+	report("connected", &result);
+	check_bounded(&result, cfg.duration_s, 0);
+	CHECK(result.max_queued <= 1);
+	CHECK_EQ(result.uploads_to_drain, 0);
+}
+
+static void offline_burst_waits_in_the_queue(void) {
+	// ten minutes without a link, on top of a quarter hour of regular samples
+	const sim_config_t cfg = { .duration_s = 600, .connected = false, .preload = 15 };
+	const sim_result_t result = simulate(&cfg);
+	report("offline", &result);
+	check_bounded(&result, cfg.duration_s, cfg.preload);
+	CHECK_EQ(result.max_queued, cfg.preload + 10);
+	CHECK_EQ(result.uploads_to_drain, 2);
+}
+
+static void longest_offline_burst_still_fits(void) {
+	const sim_config_t cfg = { .duration_s = 1800, .connected = false, .preload = 15 };
+	const sim_result_t result = simulate(&cfg);
+	report("offline, longest", &result);
+	check_bounded(&result, cfg.duration_s, cfg.preload);
+	CHECK_EQ(result.uploads_to_drain, 3);
+}
+
+int main(void) {
+	RUN_TEST(connected_burst_goes_out_a_minute_at_a_time);
+	RUN_TEST(offline_burst_waits_in_the_queue);
+	RUN_TEST(longest_offline_burst_still_fits);
+	return TEST_EXIT();
+}
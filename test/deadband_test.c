@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "test.h"
+#include "deadband.h"
+
+static const double tolerance[] = { 0.5, 2.0 };
+#define ALL_VALID 0x3U
+
+static void changes_outside_the_band_are_reported(void) {
+	deadband_t deadband;
+	CHECK_EQ(DeadbandInit(&deadband, tolerance, 2, 0), 0);
+	const double first[] = { 20.0, 50.0 };
+	CHECK(DeadbandCheck(&deadband, first, ALL_VALID, false));
+	DeadbandCommit(&deadband, first, ALL_VALID);
+
+	const double close[] = { 20.4, 51.5 };
+	CHECK(!DeadbandCheck(&deadband, close, ALL_VALID, false));
+	const double moved[] = { 20.6, 50.0 };
+	CHECK(DeadbandCheck(&deadband, moved, ALL_VALID, false));
+	CHECK_EQ(DeadbandSuppressed(&deadband), 1);
+
+	// a channel that stopped reading is news too
+	CHECK(DeadbandCheck(&deadband, first, 0x1U, false));
+}
+
+static void uncommitted_reports_leave_the_reference(void) {
+	deadband_t deadband;
+	CHECK_EQ(DeadbandInit(&deadband, tolerance, 2, 0), 0);
+	const double first[] = { 20.0, 50.0 };
+	CHECK(DeadbandCheck(&deadband, first, ALL_VALID, false));
+	DeadbandCommit(&deadband, first, ALL_VALID);
+
+	// the change could not be handed on, so the next sample near it still has to go out
+	const double moved[] = { 21.0, 50.0 };
+	CHECK(DeadbandCheck(&deadband, moved, ALL_VALID, false));
+	const double still_moved[] = { 21.1, 50.0 };
+	CHECK(DeadbandCheck(&deadband, still_moved, ALL_VALID, false));
+	DeadbandCommit(&deadband, still_moved, ALL_VALID);
+	CHECK(!DeadbandCheck(&deadband, moved, ALL_VALID, false));
+	CHECK_EQ(DeadbandSuppressed(&deadband), 1);
+}
+
+static void heartbeat_and_force_report_quiet_samples(void) {
+	deadband_t deadband;
+	CHECK_EQ(DeadbandInit(&deadband, tolerance, 2, 3), 0);
+	const double steady[] = { 20.0, 50.0 };
+	CHECK(DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	DeadbandCommit(&deadband, steady, ALL_VALID);
+	CHECK(!DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	CHECK(!DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	CHECK(DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	// the heartbeat stays due until one is committed
+	CHECK(DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	DeadbandCommit(&deadband, steady, ALL_VALID);
+	CHECK(!DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	CHECK(DeadbandCheck(&deadband, steady, ALL_VALID, true));
+
+	// a longer sample interval needs fewer samples between heartbeats, the count so far carries over
+	DeadbandCommit(&deadband, steady, ALL_VALID);
+	CHECK(!DeadbandCheck(&deadband, steady, ALL_VALID, false));
+	DeadbandSetHeartbeat(&deadband, 2);
+	CHECK(DeadbandCheck(&deadband, steady, ALL_VALID, false));
+}
+
+static void relative_band_follows_the_reported_value(void) {
+	deadband_t deadband;
+	CHECK_EQ(DeadbandInit(&deadband, tolerance, 2, 0), 0);
+	CHECK_EQ(DeadbandSetRelative(&deadband, 1, 0.2), 0);
+	CHECK_EQ(DeadbandSetRelative(&deadband, 2, 0.2), -1);
+	const double dark[] = { 20.0, 5.0 };
+	CHECK(DeadbandCheck(&deadband, dark, ALL_VALID, false));
+	DeadbandCommit(&deadband, dark, ALL_VALID);
+	// near the floor the fixed band holds
+	const double dawn[] = { 20.0, 7.5 };
+	CHECK(DeadbandCheck(&deadband, dawn, ALL_VALID, false));
+
+	const double day[] = { 20.0, 10000.0 };
+	DeadbandCommit(&deadband, day, ALL_VALID);
+	const double cloud[] = { 20.0, 8100.0 };
+	CHECK(!DeadbandCheck(&deadband, cloud, ALL_VALID, false));
+	const double storm[] = { 20.0, 7900.0 };
+	CHECK(DeadbandCheck(&deadband, storm, ALL_VALID, false));
+}
+
+// a day of minute samples shaped like a greenhouse bench: temperature, pressure and humidity on a daily
+// swing, two slowly drying soil probes and daylight with drifting cloud, each with its sensor's noise
+enum { Trace_Temperature, Trace_Pressure, Trace_Humidity, Trace_Soil1, Trace_Soil2, Trace_Lux, Trace_Channels };
+static const double trace_tolerance[Trace_Channels] = { 0.5, 1.0, 2.0, 10, 10, 25 }; // ChannelDeadband in main.c
+#define TRACE_SAMPLES (24 * 60)
+#define TRACE_HEARTBEAT 15 // ReportHeartbeatPeriod at a minute
+#define TRACE_FLICKER_EVERY 10
+
+static uint32_t trace_rng = 12345;
+static double noise(double amplitude) {
+	trace_rng = trace_rng * 1664525U + 1013904223U;
+	return amplitude * ((double)(trace_rng >> 8) / (double)(1U << 24) * 2.0 - 1.0);
+}
+
+static void trace_sample(uint32_t minute, double* cloud, double* values) {
+	const double pi = 3.14159265358979;
+	const double hour = minute / 60.0;
+	values[Trace_Temperature] = 20.0 + 6.0 * sin(2 * pi * (hour - 9.0) / 24.0) + noise(0.1);
+	values[Trace_Pressure] = 1013.0 + 2.0 * sin(2 * pi * hour / 36.0) + noise(0.1);
+	values[Trace_Humidity] = 55.0 - 15.0 * sin(2 * pi * (hour - 9.0) / 24.0) + noise(0.5);
+	values[Trace_Soil1] = 600.0 - 100.0 * hour / 24.0 + noise(3.0);
+	values[Trace_Soil2] = 550.0 - 80.0 * hour / 24.0 + noise(3.0);
+	// the cloud cover wanders between full sun and a third of it
+	*cloud += noise(0.03);
+	*cloud = *cloud > 1.0 ? 1.0 : *cloud < 0.35 ? 0.35 : *cloud;
+	const double sun = hour > 6.0 && hour < 20.0 ? pow(sin(pi * (hour - 6.0) / 14.0), 2) : 0.0;
+	values[Trace_Lux] = 2.0 + 20000.0 * sun * *cloud * (1.0 + noise(0.05)) + noise(1.0);
+}
+
+// reported samples out of the day, with flicker results forcing their sample as before or leaving on their own
+static uint32_t trace_reports(double lux_relative, bool flicker_forces) {
+	deadband_t deadband;
+	CHECK_EQ(DeadbandInit(&deadband, trace_tolerance, Trace_Channels, TRACE_HEARTBEAT), 0);
+	DeadbandSetRelative(&deadband, Trace_Lux, lux_relative);
+	trace_rng = 12345;
+	double cloud = 0.8;
+	uint32_t reports = 0;
+	for (uint32_t minute = 0; minute < TRACE_SAMPLES; minute++) {
+		double values[Trace_Channels];
+		trace_sample(minute, &cloud, values);
+		const bool flicker = minute % TRACE_FLICKER_EVERY == 0;
+		if (DeadbandCheck(&deadband, values, (1U << Trace_Channels) - 1, flicker_forces && flicker)) {
+			DeadbandCommit(&deadband, values, (1U << Trace_Channels) - 1);
+			reports++;
+		}
+	}
+	return reports;
+}
+
+static void realistic_day_is_mostly_held_back(void) {
+	const uint32_t before = trace_reports(0, true);
+	const uint32_t fixed_band = trace_reports(0, false);
+	const uint32_t after = trace_reports(0.2, false);
+	fprintf(stderr, "  %u minute samples: %u reported with flicker forcing and a 25 lux band, %u without the forcing, %u with a 20%% lux band (%.0f%% held back)\n",
+		TRACE_SAMPLES, before, fixed_band, after, 100.0 * (TRACE_SAMPLES - after) / TRACE_SAMPLES);
+	CHECK(after < fixed_band && fixed_band < before);
+	// about 80% of the samples stay on the device, the heartbeat alone would report one in TRACE_HEARTBEAT
+	CHECK((TRACE_SAMPLES - after) * 100 >= 75 * TRACE_SAMPLES);
+	CHECK(after >= TRACE_SAMPLES / TRACE_HEARTBEAT);
+}
+
+int main(void) {
+	RUN_TEST(changes_outside_the_band_are_reported);
+	RUN_TEST(uncommitted_reports_leave_the_reference);
+	RUN_TEST(heartbeat_and_force_report_quiet_samples);
+	RUN_TEST(relative_band_follows_the_reported_value);
+	RUN_TEST(realistic_day_is_mostly_held_back);
+	return TEST_EXIT();
+}
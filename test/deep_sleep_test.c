@@ -0,0 +1,194 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "deep_sleep.h"
+
+// as main.c configures it, sampling every minute
+static const deep_sleep_config_t config = { .wake_lead_s = 10, .min_residency_s = 20, .upload_grace_s = 120 };
+#define SAMPLE_INTERVAL_S 60
+#define UPLOAD_INTERVAL_S 900
+#define WARM_START_MARGIN_S 120
+#define MINUTE 1700000040 // on the sample grid
+
+int Log_Debug(const char* fmt, ...) {
+	(void)fmt;
+	return 0;
+}
+
+// the power down the application asked for, and whether the OS grants it
+static int power_downs = 0;
+static unsigned int residency_s = 0;
+static int refuse_errno = 0;
+
+int PowerManagement_ForceSystemPowerDown(unsigned int maximum_residency_in_seconds) {
+	if (refuse_errno != 0) {
+		errno = refuse_errno;
+		return -1;
+	}
+	power_downs++;
+	residency_s = maximum_residency_in_seconds;
+	return 0;
+}
+
+// stands in for Storage_OpenMutableFile, the same file across the simulated reboot
+static int open_store(void) {
+	char path[] = "/tmp/deep_sleep_testXXXXXX";
+	const int fd = mkstemp(path);
+	unlink(path);
+	return fd;
+}
+
+// restore_payload in main.c: the first alert_count payloads go back to the alert queue
+typedef struct {
+	const outbox_resume_t* resume;
+	char alerts[4][32];
+	char outbound[4][32];
+	int64_t outbound_queued_at[4];
+	size_t alerts_loaded;
+	size_t outbound_loaded;
+} restored_t;
+
+static void restore_payload(const char* payload, size_t len, int64_t queued_at, void* ctx) {
+	restored_t* restored = (restored_t*)ctx;
+	const bool alert = restored->alerts_loaded < restored->resume->alert_count;
+	char* into = alert ? restored->alerts[restored->alerts_loaded++] : restored->outbound[restored->outbound_loaded];
+	if (!alert)
+		restored->outbound_queued_at[restored->outbound_loaded++] = queued_at;
+	memcpy(into, payload, len);
+	into[len] = '\0';
+}
+
+static int boot(int fd, outbox_resume_t* resume, restored_t* restored) {
+	memset(restored, 0, sizeof(*restored));
+	restored->resume = resume;
+	const int loaded = OutboxStoreLoad(fd, resume, restore_payload, restored);
+	if (loaded >= 0)
+		OutboxStoreClear(fd);
+	return loaded;
+}
+
+static void a_due_upload_keeps_the_system_up_for_the_grace(void) {
+	// a cold boot has never uploaded, it stays up to join the network
+	int64_t next_upload = 0;
+	CHECK_EQ(DeepSleepWakeAt(&config, MINUTE + 5, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), 0);
+	CHECK_EQ(next_upload, MINUTE + 5);
+	CHECK_EQ(DeepSleepWakeAt(&config, MINUTE + 5 + 119, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), 0);
+	// no network in time, the round is skipped and the system sleeps to the next deadline
+	const int64_t now = MINUTE + 5 + 120 + 60;
+	CHECK_EQ(DeepSleepWakeAt(&config, now, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), MINUTE + 4 * 60 - 10);
+	CHECK_EQ(next_upload, now + UPLOAD_INTERVAL_S);
+}
+
+static void short_power_downs_are_skipped(void) {
+	int64_t next_upload = MINUTE + 3600;
+	CHECK_EQ(DeepSleepWakeAt(&config, MINUTE + 1, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), MINUTE + 50);
+	CHECK_EQ(DeepSleepWakeAt(&config, MINUTE + 30, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), MINUTE + 50);
+	// 19 s of residency, and past the wake point altogether
+	CHECK_EQ(DeepSleepWakeAt(&config, MINUTE + 31, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), 0);
+	CHECK_EQ(DeepSleepWakeAt(&config, MINUTE + 55, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S), 0);
+	CHECK_EQ(next_upload, MINUTE + 3600);
+}
+
+static void outbox_survives_the_power_down(void) {
+	const int fd = open_store();
+	const int64_t now = MINUTE + 2;
+	int64_t next_upload = MINUTE + 600;
+	const int64_t wake = DeepSleepWakeAt(&config, now, SAMPLE_INTERVAL_S, &next_upload, UPLOAD_INTERVAL_S);
+	CHECK_EQ(wake, MINUTE + 50);
+
+	// power_down: the alerts ahead of the bulk queue, counted in the resume state
+	const char* payloads[] = { "{\"alert\":\"soil1_dry\"}", "{\"t\":20.5}", "{\"t\":20.9}" };
+	const int64_t queued_at[] = { MINUTE - 30, MINUTE - 120, MINUTE - 60 };
+	const outbox_resume_t saved = { .saved_at = now, .next_upload = next_upload, .sample_count = 42, .power_downs = 3,
+		.alerts_active = 0x1U, .sample_interval_s = SAMPLE_INTERVAL_S, .alert_count = 1 };
+	power_downs = 0;
+	CHECK_EQ(DeepSleepPowerDown(fd, &saved, payloads, queued_at, 3, wake), 0);
+	CHECK_EQ(power_downs, 1);
+	CHECK_EQ(residency_s, wake - now);
+
+	// the wake: restore_outbox on the next boot, in time for the sample
+	outbox_resume_t resume;
+	restored_t restored;
+	CHECK_EQ(boot(fd, &resume, &restored), 3);
+	CHECK_EQ(resume.sample_count, 42);
+	CHECK_EQ(resume.power_downs, 3);
+	CHECK_EQ(resume.next_upload, next_upload);
+	CHECK_EQ(resume.alerts_active, 0x1U);
+	CHECK_EQ(restored.alerts_loaded, 1);
+	CHECK(strcmp(restored.alerts[0], payloads[0]) == 0);
+	CHECK_EQ(restored.outbound_loaded, 2);
+	CHECK(strcmp(restored.outbound[0], payloads[1]) == 0 && strcmp(restored.outbound[1], payloads[2]) == 0);
+	CHECK_EQ(restored.outbound_queued_at[0], MINUTE - 120);
+	CHECK(DeepSleepWarmStart(wake + 5, resume.saved_at, resume.sample_interval_s, WARM_START_MARGIN_S));
+
+	// consumed, a crash after the wake does not replay it
+	CHECK_EQ(boot(fd, &resume, &restored), -1);
+	close(fd);
+}
+
+static void empty_outbox_still_keeps_the_resume_state(void) {
+	const int fd = open_store();
+	const outbox_resume_t saved = { .saved_at = MINUTE + 2, .sample_count = 7, .sample_interval_s = SAMPLE_INTERVAL_S };
+	CHECK_EQ(DeepSleepPowerDown(fd, &saved, NULL, NULL, 0, MINUTE + 50), 0);
+	outbox_resume_t resume;
+	restored_t restored;
+	CHECK_EQ(boot(fd, &resume, &restored), 0);
+	CHECK_EQ(resume.sample_count, 7);
+	close(fd);
+}
+
+static void refused_power_down_leaves_nothing_to_replay(void) {
+	const int fd = open_store();
+	const char* payloads[] = { "{\"t\":20.5}" };
+	const int64_t queued_at[] = { MINUTE };
+	const outbox_resume_t saved = { .saved_at = MINUTE + 2 };
+	power_downs = 0;
+	refuse_errno = EPERM;
+	CHECK_EQ(DeepSleepPowerDown(fd, &saved, payloads, queued_at, 1, MINUTE + 50), -1);
+	CHECK_EQ(errno, EPERM);
+	refuse_errno = 0;
+	CHECK_EQ(power_downs, 0);
+	// the payload is still queued in memory, a later boot must not send it a second time
+	outbox_resume_t resume;
+	restored_t restored;
+	CHECK_EQ(boot(fd, &resume, &restored), -1);
+	close(fd);
+}
+
+static void outbox_too_large_to_store_stays_up(void) {
+	const int fd = open_store();
+	static char big[OUTBOX_STORE_MAX_BYTES];
+	memset(big, 'x', sizeof(big) - 1);
+	const char* payloads[] = { big };
+	const int64_t queued_at[] = { MINUTE };
+	const outbox_resume_t saved = { .saved_at = MINUTE + 2 };
+	power_downs = 0;
+	CHECK_EQ(DeepSleepPowerDown(fd, &saved, payloads, queued_at, 1, MINUTE + 50), -1);
+	CHECK_EQ(errno, ENOSPC);
+	CHECK_EQ(power_downs, 0);
+	close(fd);
+}
+
+static void late_wakes_start_cold(void) {
+	CHECK(DeepSleepWarmStart(MINUTE + 60, MINUTE, SAMPLE_INTERVAL_S, WARM_START_MARGIN_S));
+	CHECK(DeepSleepWarmStart(MINUTE + 180, MINUTE, SAMPLE_INTERVAL_S, WARM_START_MARGIN_S));
+	CHECK(!DeepSleepWarmStart(MINUTE + 181, MINUTE, SAMPLE_INTERVAL_S, WARM_START_MARGIN_S));
+	// a clock that went back is not trusted either
+	CHECK(!DeepSleepWarmStart(MINUTE - 1, MINUTE, SAMPLE_INTERVAL_S, WARM_START_MARGIN_S));
+}
+
+int main(void) {
+	RUN_TEST(a_due_upload_keeps_the_system_up_for_the_grace);
+	RUN_TEST(short_power_downs_are_skipped);
+	RUN_TEST(outbox_survives_the_power_down);
+	RUN_TEST(empty_outbox_still_keeps_the_resume_state);
+	RUN_TEST(refused_power_down_leaves_nothing_to_replay);
+	RUN_TEST(outbox_too_large_to_store_stays_up);
+	RUN_TEST(late_wakes_start_cold);
+	return TEST_EXIT();
+}
@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "test.h"
+#include "idle_backoff.h"
+
+// the DoWork pacing as main.c configures it
+#define MIN_MS 50
+#define MAX_MS 8000
+#define DAY_MS (24U * 3600U * 1000U)
+
+static void doubles_to_the_ceiling_and_snaps_back(void) {
+	idle_backoff_t backoff;
+	IdleBackoffInit(&backoff, MIN_MS, MAX_MS);
+	CHECK_EQ(IdleBackoffIntervalMs(&backoff), MIN_MS);
+	CHECK_EQ(IdleBackoffNextMs(&backoff, false), 100);
+	CHECK_EQ(IdleBackoffNextMs(&backoff, false), 200);
+	for (int i = 0; i < 20; i++)
+		IdleBackoffNextMs(&backoff, false);
+	CHECK_EQ(IdleBackoffIntervalMs(&backoff), MAX_MS);
+	CHECK_EQ(IdleBackoffNextMs(&backoff, true), MIN_MS);
+
+	IdleBackoffNextMs(&backoff, false);
+	IdleBackoffReset(&backoff);
+	CHECK_EQ(IdleBackoffIntervalMs(&backoff), MIN_MS);
+	CHECK_EQ(IdleBackoffNextMs(&backoff, false), 2 * MIN_MS);
+}
+
+static void odd_ceilings_are_not_overshot(void) {
+	idle_backoff_t backoff;
+	IdleBackoffInit(&backoff, 50, 1000);
+	uint32_t last = 0;
+	for (int i = 0; i < 10; i++)
+		last = IdleBackoffNextMs(&backoff, false);
+	CHECK_EQ(last, 1000);
+	IdleBackoffInit(&backoff, 0, 0);
+	CHECK_EQ(IdleBackoffNextMs(&backoff, false), 1);
+}
+
+// a day connected to the hub: an upload every upload_every_ms kicks DoWork and keeps the SDK busy
+// until its confirmations arrive ack_ms later, and a reconnect every reconnect_every_ms authenticates
+// for auth_ms. DoWork runs as do_work_and_reschedule would, ignoring the timer slack
+typedef struct {
+	uint32_t upload_every_ms;
+	uint32_t ack_ms;
+	uint32_t reconnect_every_ms;
+	uint32_t auth_ms;
+} sim_config_t;
+
+typedef struct {
+	uint32_t wakeups;
+	uint32_t max_gap_ms;
+	uint32_t max_ack_delay_ms; // from a confirmation arriving to the DoWork that handles it
+} sim_result_t;
+
+static sim_result_t simulate(const sim_config_t* sim) {
+	sim_result_t result = { 0 };
+	idle_backoff_t backoff;
+	IdleBackoffInit(&backoff, MIN_MS, MAX_MS);
+	uint32_t busy_until = 0, ack_at = 0;
+	uint32_t last = 0, next = 0;
+	for (uint32_t now = 0; now < DAY_MS; now++) {
+		bool kicked = false;
+		if (now % sim->upload_every_ms == 0) {
+			ack_at = now + sim->ack_ms;
+			busy_until = ack_at;
+			kicked = true;
+		}
+		if (sim->reconnect_every_ms != 0 && now % sim->reconnect_every_ms == 0) {
+			busy_until = now + sim->auth_ms > busy_until ? now + sim->auth_ms : busy_until;
+			kicked = true;
+		}
+		if (kicked)
+			IdleBackoffReset(&backoff);
+		else if (now != next)
+			continue;
+
+		result.wakeups++;
+		if (now - last > result.max_gap_ms)
+			result.max_gap_ms = now - last;
+		last = now;
+		if (ack_at != 0 && now >= ack_at) {
+			if (now - ack_at > result.max_ack_delay_ms)
+				result.max_ack_delay_ms = now - ack_at;
+			ack_at = 0;
+		}
+		next = now + IdleBackoffNextMs(&backoff, now < busy_until);
+	}
+	return result;
+}
+
+static void report(const char* name, const sim_result_t* result) {
+	const uint32_t fixed = DAY_MS / MIN_MS;
+	fprintf(stderr, "  %s: %u DoWork wakeups a day against %u at a fixed %u ms (%.2f%%), longest gap %u ms, acks handled within %u ms\n",
+		name, result->wakeups, fixed, MIN_MS, 100.0 * result->wakeups / fixed, result->max_gap_ms, result->max_ack_delay_ms);
+}
+
+static void idle_link_wakes_a_fraction_of_the_fixed_poll(void) {
+	// the default upload pace stretched to its ceiling, one reconnect a day
+	const sim_config_t sim = { .upload_every_ms = 1800 * 1000, .ack_ms = 830, .reconnect_every_ms = DAY_MS - 1, .auth_ms = 5000 };
+	const sim_result_t result = simulate(&sim);
+	report("idle", &result);
+	CHECK(result.wakeups * 100 < DAY_MS / MIN_MS);
+	// the SDK still runs well inside the MQTT keepalive, and a confirmation is not left waiting
+	CHECK(result.max_gap_ms <= MAX_MS);
+	CHECK(result.max_ack_delay_ms <= MIN_MS);
+}
+
+static void busy_link_stays_fast_while_it_has_work(void) {
+	// an upload a minute with slow confirmations
+	const sim_config_t sim = { .upload_every_ms = 60 * 1000, .ack_ms = 4970 };
+	const sim_result_t result = simulate(&sim);
+	report("busy", &result);
+	CHECK(result.wakeups * 5 < DAY_MS / MIN_MS);
+	CHECK(result.max_gap_ms <= MAX_MS);
+	CHECK(result.max_ack_delay_ms <= MIN_MS);
+}
+
+int main(void) {
+	RUN_TEST(doubles_to_the_ceiling_and_snaps_back);
+	RUN_TEST(odd_ceilings_are_not_overshot);
+	RUN_TEST(idle_link_wakes_a_fraction_of_the_fixed_poll);
+	RUN_TEST(busy_link_stays_fast_while_it_has_work);
+	return TEST_EXIT();
+}
@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "test.h"
+#include "json_scan.h"
+
+static json_span_t span(const char* text) { return (json_span_t) { .ptr = text, .len = strlen(text) }; }
+
+static bool member_is(const char* json, const char* key, const char* expected) {
+	json_span_t value;
+	return JsonScanMember(span(json), key, &value) == 0 && value.len == strlen(expected) && memcmp(value.ptr, expected, value.len) == 0;
+}
+
+static bool number_is(const char* text, double expected) {
+	double value;
+	return JsonScanNumber(span(text), &value) == 0 && value == expected;
+}
+
+static bool is_not_number(const char* text) {
+	double value = 0;
+	return JsonScanNumber(span(text), &value) == -1 && value == 0;
+}
+
+static void members_are_found_at_the_top_level(void) {
+	const char* desired = "{ \"$version\": 12, \"tuning\": {\"sample_interval_s\": 60, \"queue_capacity\": 50}, \"other\": [1, {\"x\": 2}] }";
+	CHECK(member_is(desired, "$version", "12"));
+	CHECK(member_is(desired, "tuning", "{\"sample_interval_s\": 60, \"queue_capacity\": 50}"));
+	CHECK(member_is(desired, "other", "[1, {\"x\": 2}]"));
+
+	json_span_t tuning, value;
+	CHECK_EQ(JsonScanMember(span(desired), "tuning", &tuning), 0);
+	CHECK_EQ(JsonScanMember(tuning, "queue_capacity", &value), 0);
+	CHECK(value.len == 2 && memcmp(value.ptr, "50", 2) == 0);
+	// members of nested objects are not members of the outer one
+	CHECK_EQ(JsonScanMember(span(desired), "sample_interval_s", &value), -1);
+	CHECK_EQ(JsonScanMember(span(desired), "x", &value), -1);
+	CHECK_EQ(JsonScanMember(span(desired), "missing", &value), -1);
+}
+
+static void brackets_and_escapes_in_strings_are_skipped(void) {
+	const char* json = "{\"note\": \"a } and a \\\" quote\", \"path\": \"c:\\\\\", \"after\": true}";
+	CHECK(member_is(json, "note", "\"a } and a \\\" quote\""));
+	CHECK(member_is(json, "path", "\"c:\\\\\""));
+	CHECK(member_is(json, "after", "true"));
+	// keys are compared as written, escapes included
+	CHECK(member_is("{\"a\\\"b\": 1}", "a\\\"b", "1"));
+	CHECK(!member_is("{\"a\\\"b\": 1}", "a\"b", "1"));
+}
+
+static void spans_need_no_terminator(void) {
+	const char buffer[] = "{\"a\": 1, \"b\": 2}garbage";
+	const json_span_t json = { .ptr = buffer, .len = strlen("{\"a\": 1, \"b\": 2}") };
+	json_span_t value;
+	CHECK_EQ(JsonScanMember(json, "b", &value), 0);
+	CHECK(value.len == 1 && value.ptr[0] == '2');
+	// the number stops at the span, not at the terminator
+	const json_span_t digits = { .ptr = "12345", .len = 2 };
+	double number;
+	CHECK_EQ(JsonScanNumber(digits, &number), 0);
+	CHECK(number == 12);
+}
+
+static void truncated_input_is_refused(void) {
+	const char* json = "{\"a\": 1, \"tuning\": {\"b\": 2}, \"c\": \"text\"}";
+	json_span_t value;
+	// every cut before the final member is read fails instead of reading past the span
+	for (size_t len = 0; len < strlen(json) - strlen(" \"text\"}"); len++) {
+		const json_span_t cut = { .ptr = json, .len = len };
+		CHECK_EQ(JsonScanMember(cut, "c", &value), -1);
+	}
+	CHECK_EQ(JsonScanMember(span("{\"a\": \"open"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("{\"a\": \"ends in \\"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("{\"a\": {\"b\": [1, 2}"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("{\"a\" 1}"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("{\"a\": }"), "a", &value), -1);
+}
+
+static void only_objects_have_members(void) {
+	json_span_t value;
+	CHECK_EQ(JsonScanMember(span("[{\"a\": 1}]"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("\"a\""), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("42"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("{}"), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span(""), "a", &value), -1);
+	CHECK_EQ(JsonScanMember(span("  {\"a\": 1}"), "a", &value), 0);
+}
+
+static void numbers_are_read(void) {
+	CHECK(number_is("0", 0));
+	CHECK(number_is("-12", -12));
+	CHECK(number_is("0.5", 0.5));
+	CHECK(number_is("2.5e2", 250));
+	CHECK(number_is("1E-3", 0.001));
+	CHECK(number_is("1e308", 1e308));
+}
+
+static void other_types_are_not_numbers(void) {
+	CHECK(is_not_number("\"60\""));
+	CHECK(is_not_number("true"));
+	CHECK(is_not_number("null"));
+	CHECK(is_not_number("{\"a\": 1}"));
+	CHECK(is_not_number("[60]"));
+	CHECK(is_not_number(""));
+	// what strtod takes but JSON does not
+	CHECK(is_not_number("0x3c"));
+	CHECK(is_not_number(" 60"));
+	CHECK(is_not_number("+60"));
+	CHECK(is_not_number("inf"));
+	CHECK(is_not_number("nan"));
+	CHECK(is_not_number("60s"));
+}
+
+static void out_of_range_numbers_are_refused(void) {
+	CHECK(is_not_number("1e400"));
+	CHECK(is_not_number("-1e400"));
+	// longer than any double needs
+	CHECK(is_not_number("123456789012345678901234567890123"));
+	CHECK(number_is("12345678901234567890123456789012", 12345678901234567890123456789012.0));
+}
+
+int main(void) {
+	RUN_TEST(members_are_found_at_the_top_level);
+	RUN_TEST(brackets_and_escapes_in_strings_are_skipped);
+	RUN_TEST(spans_need_no_terminator);
+	RUN_TEST(truncated_input_is_refused);
+	RUN_TEST(only_objects_have_members);
+	RUN_TEST(numbers_are_read);
+	RUN_TEST(other_types_are_not_numbers);
+	RUN_TEST(out_of_range_numbers_are_refused);
+	return TEST_EXIT();
+}
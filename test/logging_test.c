@@ -0,0 +1,103 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+#include "logging.h"
+
+// built with LOG_MIN_LEVEL at LOG_LEVEL_INFO, as a build between Release (warn) and Debug
+
+static int emitted = 0;
+static char last_line[128];
+
+// formats like the real one would, so the benchmark pays for what an emitted line costs
+int Log_Debug(const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	const int res = vsnprintf(last_line, sizeof(last_line), fmt, args);
+	va_end(args);
+	emitted++;
+	return res;
+}
+
+static int evaluated = 0;
+static int argument(int value) {
+	evaluated++;
+	return value;
+}
+
+static void compiled_out_sites_do_not_evaluate_their_arguments(void) {
+	emitted = evaluated = 0;
+	LOG_DEBUG("debug %i\n", argument(1));
+	LOG_TRACE("trace %i\n", argument(2));
+	CHECK_EQ(evaluated, 0);
+	CHECK_EQ(emitted, 0);
+
+	LOG_INFO("info %i\n", argument(3));
+	LOG_WARN("warn %i\n", argument(4));
+	LOG_ERROR("error %i\n", argument(5));
+	CHECK_EQ(evaluated, 3);
+	CHECK_EQ(emitted, 3);
+	CHECK(strcmp(last_line, "error 5\n") == 0);
+}
+
+static void runtime_levels_skip_the_arguments_too(void) {
+	CHECK_EQ(LogSetModuleLevel(LOG_MODULE, LOG_LEVEL_WARN), 0);
+	emitted = evaluated = 0;
+	LOG_INFO("info %i\n", argument(1));
+	LOG_WARN("warn %i\n", argument(2));
+	CHECK_EQ(evaluated, 1);
+	CHECK_EQ(emitted, 1);
+
+	CHECK_EQ(LogSetModuleLevel(LOG_MODULE, LOG_LEVEL_OFF), 0);
+	LOG_ERROR("error %i\n", argument(3));
+	CHECK_EQ(evaluated, 1);
+	CHECK_EQ(LogSetModuleLevel(LOG_MODULE, LOG_MIN_LEVEL), 0);
+}
+
+static void levels_stop_at_the_compiled_floor(void) {
+	CHECK_EQ(LogSetModuleLevel(LogModule_Sensors, LOG_LEVEL_TRACE), 0);
+	CHECK_EQ(LogModuleLevel(LogModule_Sensors), LOG_LEVEL_INFO);
+	CHECK_EQ(LogSetModuleLevel(LogModule_Sensors, -3), 0);
+	CHECK_EQ(LogModuleLevel(LogModule_Sensors), LOG_LEVEL_OFF);
+	CHECK_EQ(LogSetModuleLevel(LogModule_Count, LOG_LEVEL_INFO), -1);
+	CHECK_EQ(LogModuleLevel(LogModule_Count), LOG_LEVEL_OFF);
+	LogSetModuleLevel(LogModule_Sensors, LOG_MIN_LEVEL);
+}
+
+static double elapsed_ns(const struct timespec* from, const struct timespec* to) {
+	return (double)(to->tv_sec - from->tv_sec) * 1e9 + (double)(to->tv_nsec - from->tv_nsec);
+}
+
+#define BENCH_CALLS 1000000
+#define BENCH(name, site) do { \
+	struct timespec _from, _to; \
+	clock_gettime(CLOCK_MONOTONIC, &_from); \
+	for (int _i = 0; _i < BENCH_CALLS; _i++) \
+		site; \
+	clock_gettime(CLOCK_MONOTONIC, &_to); \
+	fprintf(stderr, "  %-26s %7.1f ns per site\n", name, elapsed_ns(&_from, &_to) / BENCH_CALLS); \
+} while (0)
+
+// what a log site costs per level, printed for comparison only since host timings vary too much to assert
+static void cost_per_level(void) {
+	emitted = evaluated = 0;
+	BENCH("trace, compiled out", LOG_TRACE("sample %i took %.1f ms\n", argument(_i), 1.5));
+	BENCH("debug, compiled out", LOG_DEBUG("sample %i took %.1f ms\n", argument(_i), 1.5));
+	LogSetModuleLevel(LOG_MODULE, LOG_LEVEL_WARN);
+	BENCH("info, off at runtime", LOG_INFO("sample %i took %.1f ms\n", argument(_i), 1.5));
+	LogSetModuleLevel(LOG_MODULE, LOG_MIN_LEVEL);
+	BENCH("info, emitted", LOG_INFO("sample %i took %.1f ms\n", argument(_i), 1.5));
+	BENCH("warn, emitted", LOG_WARN("sample %i took %.1f ms\n", argument(_i), 1.5));
+	CHECK_EQ(evaluated, 2 * BENCH_CALLS);
+	CHECK_EQ(emitted, 2 * BENCH_CALLS);
+}
+
+int main(void) {
+	RUN_TEST(compiled_out_sites_do_not_evaluate_their_arguments);
+	RUN_TEST(runtime_levels_skip_the_arguments_too);
+	RUN_TEST(levels_stop_at_the_compiled_floor);
+	RUN_TEST(cost_per_level);
+	return TEST_EXIT();
+}
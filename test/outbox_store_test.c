@@ -0,0 +1,237 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "test.h"
+#include "outbox_store.h"
+
+// every pwrite from the store is counted, the flash only wears where bytes are written
+static size_t written_bytes = 0;
+ssize_t __real_pwrite(int fd, const void* buf, size_t count, off_t offset);
+ssize_t __wrap_pwrite(int fd, const void* buf, size_t count, off_t offset) {
+	const ssize_t ret = __real_pwrite(fd, buf, count, offset);
+	if (ret > 0)
+		written_bytes += (size_t)ret;
+	return ret;
+}
+
+// a stored record is a uint16_t length and an int64_t queue time before the payload bytes
+#define RECORD_BYTES(payload) (sizeof(uint16_t) + sizeof(int64_t) + strlen(payload))
+
+// queue times for up to four payloads, tests pass an offset into it along with the payloads
+static const int64_t queued_at[] = { 1000, 1060, 1120, 1180 };
+
+typedef struct {
+	char payloads[8][64];
+	int64_t queued_at[8];
+	size_t count;
+} loaded_t;
+
+static void collect(const char* payload, size_t len, int64_t queued, void* ctx) {
+	loaded_t* loaded = (loaded_t*)ctx;
+	if (loaded->count < 8 && len < sizeof(loaded->payloads[0])) {
+		memcpy(loaded->payloads[loaded->count], payload, len);
+		loaded->payloads[loaded->count][len] = '\0';
+		loaded->queued_at[loaded->count] = queued;
+	}
+	loaded->count++;
+}
+
+static int open_store(void) {
+	char path[] = "/tmp/outbox_store_testXXXXXX";
+	const int fd = mkstemp(path);
+	unlink(path);
+	return fd;
+}
+
+static off_t store_size(int fd) {
+	struct stat st;
+	return fstat(fd, &st) == 0 ? st.st_size : -1;
+}
+
+static size_t save(int fd, const outbox_resume_t* resume, const char* const* payloads, const int64_t* queued, size_t count) {
+	written_bytes = 0;
+	CHECK_EQ(OutboxStoreSave(fd, resume, payloads, queued, count), 0);
+	return written_bytes;
+}
+
+static void round_trip(void) {
+	const int fd = open_store();
+	const char* payloads[] = { "{\"a\":1}", "", "{\"b\":22}" };
+	outbox_resume_t resume = { .saved_at = 100, .next_upload = 700, .sample_count = 42, .power_downs = 3, .reported_valid = 5, .sample_interval_s = 300, .alert_count = 1 };
+	resume.reported[2] = 21.5;
+	save(fd, &resume, payloads, queued_at, 3);
+
+	outbox_resume_t out = { 0 };
+	loaded_t loaded = { 0 };
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 3);
+	CHECK_EQ(loaded.count, 3);
+	CHECK(strcmp(loaded.payloads[0], payloads[0]) == 0);
+	CHECK(strcmp(loaded.payloads[1], payloads[1]) == 0);
+	CHECK(strcmp(loaded.payloads[2], payloads[2]) == 0);
+	CHECK_EQ(loaded.queued_at[0], queued_at[0]);
+	CHECK_EQ(loaded.queued_at[2], queued_at[2]);
+	CHECK_EQ(out.saved_at, 100);
+	CHECK_EQ(out.next_upload, 700);
+	CHECK_EQ(out.sample_count, 42);
+	CHECK_EQ(out.power_downs, 3);
+	CHECK_EQ(out.reported_valid, 5);
+	CHECK_EQ(out.sample_interval_s, 300);
+	CHECK_EQ(out.alert_count, 1);
+	CHECK(out.reported[2] == 21.5);
+	close(fd);
+}
+
+static void empty_and_corrupt_stores_are_rejected(void) {
+	const int fd = open_store();
+	outbox_resume_t out;
+	loaded_t loaded = { 0 };
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), -1);
+
+	const char* payloads[] = { "{\"a\":1}", "{\"b\":2}" };
+	const outbox_resume_t resume = { .saved_at = 1 };
+	save(fd, &resume, payloads, queued_at, 2);
+	// a flipped payload byte fails the record checksum, a flipped header byte the header checksum
+	const off_t size = store_size(fd);
+	CHECK(pwrite(fd, "X", 1, size - 2) == 1);
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), -1);
+	save(fd, &resume, payloads, queued_at, 2);
+	CHECK(pwrite(fd, "X", 1, 9) == 1);
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), -1);
+	CHECK_EQ(loaded.count, 0);
+
+	// and an empty queue is a valid store
+	save(fd, &resume, payloads, queued_at, 0);
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 0);
+	close(fd);
+}
+
+static void unchanged_queue_only_rewrites_the_header(void) {
+	const int fd = open_store();
+	const char* payloads[] = { "{\"sample\":1,\"padding\":\"xxxxxxxxxxxxxxxxxxxxxxxx\"}", "{\"sample\":2,\"padding\":\"xxxxxxxxxxxxxxxxxxxxxxxx\"}" };
+	outbox_resume_t resume = { .saved_at = 100, .sample_count = 1 };
+	const size_t first = save(fd, &resume, payloads, queued_at, 2);
+	CHECK_EQ(first, (size_t)store_size(fd));
+
+	resume.saved_at = 160;
+	resume.sample_count = 2;
+	const size_t second = save(fd, &resume, payloads, queued_at, 2);
+	const size_t body = 2 * RECORD_BYTES(payloads[0]);
+	CHECK_EQ(second, (size_t)store_size(fd) - body);
+
+	outbox_resume_t out;
+	loaded_t loaded = { 0 };
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 2);
+	CHECK_EQ(out.saved_at, 160);
+	CHECK_EQ(out.sample_count, 2);
+	close(fd);
+}
+
+static void grown_queue_only_writes_the_new_records(void) {
+	const int fd = open_store();
+	const char* payloads[] = { "{\"sample\":1}", "{\"sample\":2}", "{\"sample\":3}" };
+	const outbox_resume_t resume = { .saved_at = 100 };
+	save(fd, &resume, payloads, queued_at, 2);
+	const size_t header = (size_t)store_size(fd) - 2 * RECORD_BYTES(payloads[0]);
+
+	CHECK_EQ(save(fd, &resume, payloads, queued_at, 3), header + RECORD_BYTES(payloads[2]));
+
+	outbox_resume_t out;
+	loaded_t loaded = { 0 };
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 3);
+	CHECK(strcmp(loaded.payloads[2], payloads[2]) == 0);
+	close(fd);
+}
+
+static void uploaded_records_shrink_the_store(void) {
+	const int fd = open_store();
+	const char* payloads[] = { "{\"sample\":1}", "{\"sample\":2}", "{\"sample\":3}" };
+	const outbox_resume_t resume = { .saved_at = 100 };
+	save(fd, &resume, payloads, queued_at, 3);
+	const off_t full = store_size(fd);
+
+	// the oldest went out, everything after it moves and is written again
+	save(fd, &resume, payloads + 1, queued_at + 1, 2);
+	CHECK_EQ(store_size(fd), full - (off_t)RECORD_BYTES(payloads[0]));
+
+	outbox_resume_t out;
+	loaded_t loaded = { 0 };
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 2);
+	CHECK(strcmp(loaded.payloads[0], payloads[1]) == 0);
+	CHECK(strcmp(loaded.payloads[1], payloads[2]) == 0);
+	CHECK_EQ(loaded.queued_at[0], queued_at[1]);
+	close(fd);
+}
+
+static void cleared_store_is_not_replayed_but_spares_the_next_save(void) {
+	const int fd = open_store();
+	const char* payloads[] = { "{\"sample\":1}", "{\"sample\":2}" };
+	const outbox_resume_t resume = { .saved_at = 100 };
+	save(fd, &resume, payloads, queued_at, 2);
+	const off_t size = store_size(fd);
+
+	outbox_resume_t out;
+	loaded_t loaded = { 0 };
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 2);
+	CHECK_EQ(OutboxStoreClear(fd), 0);
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), -1);
+	CHECK_EQ(loaded.count, 2);
+
+	// the wake restored the same queue, saving it again only marks the records live
+	const size_t body = 2 * RECORD_BYTES(payloads[0]);
+	CHECK_EQ(save(fd, &resume, payloads, queued_at, 2), (size_t)size - body);
+	CHECK_EQ(OutboxStoreLoad(fd, &out, collect, &loaded), 2);
+	close(fd);
+}
+
+static void clearing_a_damaged_store_empties_it(void) {
+	const int fd = open_store();
+	CHECK(pwrite(fd, "not a store at all, just some bytes to be thrown away", 54, 0) == 54);
+	CHECK_EQ(OutboxStoreClear(fd), 0);
+	CHECK_EQ(store_size(fd), 0);
+	close(fd);
+}
+
+static void oversized_queue_is_refused(void) {
+	const int fd = open_store();
+	static char big[OUTBOX_STORE_MAX_BYTES + 1];
+	memset(big, 'x', OUTBOX_STORE_MAX_BYTES);
+	const char* payloads[] = { big };
+	const outbox_resume_t resume = { .saved_at = 100 };
+	CHECK_EQ(OutboxStoreSave(fd, &resume, payloads, queued_at, 1), -1);
+	close(fd);
+}
+
+static void capacity_worth_of_full_payloads_fits(void) {
+	const int fd = open_store();
+	enum { FullLen = 320 };
+	static char full[FullLen + 1];
+	memset(full, 'x', FullLen);
+	static const char* payloads[OUTBOX_STORE_MAX_BYTES / FullLen];
+	static int64_t times[OUTBOX_STORE_MAX_BYTES / FullLen];
+	const size_t capacity = OutboxStoreCapacity(FullLen);
+	CHECK(capacity > 0 && capacity < OUTBOX_STORE_MAX_BYTES / FullLen);
+	for (size_t i = 0; i <= capacity; i++)
+		payloads[i] = full;
+
+	const outbox_resume_t resume = { .saved_at = 100 };
+	CHECK_EQ(OutboxStoreSave(fd, &resume, payloads, times, capacity), 0);
+	CHECK_EQ(OutboxStoreSave(fd, &resume, payloads, times, capacity + 1), -1);
+	close(fd);
+}
+
+int main(void) {
+	RUN_TEST(round_trip);
+	RUN_TEST(empty_and_corrupt_stores_are_rejected);
+	RUN_TEST(unchanged_queue_only_rewrites_the_header);
+	RUN_TEST(grown_queue_only_writes_the_new_records);
+	RUN_TEST(uploaded_records_shrink_the_store);
+	RUN_TEST(cleared_store_is_not_replayed_but_spares_the_next_save);
+	RUN_TEST(clearing_a_damaged_store_empties_it);
+	RUN_TEST(oversized_queue_is_refused);
+	RUN_TEST(capacity_worth_of_full_payloads_fits);
+	return TEST_EXIT();
+}
@@ -0,0 +1,12 @@
+/** Host stand-in for the Azure Sphere memory counters, which read as zero */
+
+#ifndef APPLIBS_APPLICATIONS_H
+#define APPLIBS_APPLICATIONS_H
+
+#include <stddef.h>
+
+static inline size_t Applications_GetTotalMemoryUsageInKB(void) { return 0; }
+static inline size_t Applications_GetUserModeMemoryUsageInKB(void) { return 0; }
+static inline size_t Applications_GetPeakUserModeMemoryUsageInKB(void) { return 0; }
+
+#endif
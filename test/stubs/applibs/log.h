@@ -0,0 +1,8 @@
+/** Host stand-in for the Azure Sphere debug log, tests that log provide Log_Debug themselves */
+
+#ifndef APPLIBS_LOG_H
+#define APPLIBS_LOG_H
+
+int Log_Debug(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,8 @@
+/** Host stand-in for the Azure Sphere power management calls, tests that power down provide them */
+
+#ifndef APPLIBS_POWERMANAGEMENT_H
+#define APPLIBS_POWERMANAGEMENT_H
+
+int PowerManagement_ForceSystemPowerDown(unsigned int maximum_residency_in_seconds);
+
+#endif
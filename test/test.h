@@ -0,0 +1,34 @@
+/** Minimal assertions for the host tests, a failed check is reported and the test exits non-zero */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	const long long _a = (long long)(a), _b = (long long)(b); \
+	if (_a != _b) { \
+		fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed, %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define RUN_TEST(fn) do { \
+	const int _before = test_failures; \
+	fn(); \
+	fprintf(stderr, "%s %s\n", test_failures == _before ? "PASS" : "FAIL", #fn); \
+} while (0)
+
+#define TEST_EXIT() (test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "upload_pacer.h"
+
+// the pacer as main.c configures it by default
+static const upload_pacer_config_t config = {
+	.min_interval_s = 60,
+	.max_interval_s = 1800,
+	.latency_slo_s = 900,
+	.slack_s = 30,
+	.batch_max = 16,
+	.slow_ack_ms = 5000
+};
+
+#define SIM_QUEUE_MAX 1024
+
+// one simulated device: samples are queued on a fixed period, the upload timer fires slack_s late
+// (the worst the event loop allows) and a send that fails goes back to the end of the queue with its
+// original queue time, as azure_send_cb_unsafe does
+typedef struct {
+	uint32_t sample_every_s; // 0 for no samples
+	uint32_t ack_ms;
+	uint32_t outage_from_s; // the link is down in [outage_from_s, outage_to_s)
+	uint32_t outage_to_s;
+	uint32_t preload; // messages queued at the start
+} sim_config_t;
+
+typedef struct {
+	uint32_t uploads;
+	uint32_t queued;
+	uint32_t delivered;
+	uint32_t max_latency_s;
+	uint32_t max_latency_after_s; // of messages queued after latency_after_s
+	uint32_t max_backlog;
+	uint32_t last_interval_s;
+	uint32_t drained_at_s; // when the queue first emptied
+	upload_pacer_stats_t pacer;
+} sim_result_t;
+
+typedef struct {
+	uint32_t queued_at[SIM_QUEUE_MAX];
+	size_t head;
+	size_t count;
+} sim_queue_t;
+
+static void push(sim_queue_t* queue, uint32_t queued_at) {
+	CHECK(queue->count < SIM_QUEUE_MAX);
+	queue->queued_at[(queue->head + queue->count++) % SIM_QUEUE_MAX] = queued_at;
+}
+
+static uint32_t pop(sim_queue_t* queue) {
+	const uint32_t queued_at = queue->queued_at[queue->head];
+	queue->head = (queue->head + 1) % SIM_QUEUE_MAX;
+	queue->count--;
+	return queued_at;
+}
+
+// requeued sends sit behind newer messages, so the oldest is looked for across the whole queue
+static uint32_t oldest_age(const sim_queue_t* queue, uint32_t now) {
+	uint32_t oldest = 0;
+	for (size_t i = 0; i < queue->count; i++) {
+		const uint32_t age = now - queue->queued_at[(queue->head + i) % SIM_QUEUE_MAX];
+		if (age > oldest)
+			oldest = age;
+	}
+	return oldest;
+}
+
+static sim_result_t simulate(const sim_config_t* sim, uint32_t duration_s, uint32_t latency_after_s) {
+	static sim_queue_t queue;
+	memset(&queue, 0, sizeof(queue));
+	sim_result_t result = { 0 };
+	upload_pacer_t pacer;
+	UploadPacerInit(&pacer, &config);
+
+	for (uint32_t i = 0; i < sim->preload; i++)
+		push(&queue, 0);
+	result.queued = sim->preload;
+	// the first upload goes out right away, as entering PeriodicUpload does
+	uint32_t next_upload = 0;
+
+	for (uint32_t now = 0; now < duration_s; now++) {
+		if (sim->sample_every_s > 0 && now % sim->sample_every_s == 0) {
+			push(&queue, now);
+			result.queued++;
+			// upload_for_queued brings an idle schedule in
+			const uint32_t due = now + UploadPacerDueS(&pacer, 0);
+			if (due < next_upload)
+				next_upload = due;
+		}
+		if (queue.count > result.max_backlog)
+			result.max_backlog = (uint32_t)queue.count;
+
+		if (now != next_upload + (next_upload == 0 ? 0 : config.slack_s))
+			continue;
+		result.uploads++;
+		UploadPacerUploadStarted(&pacer, oldest_age(&queue, now));
+		const bool link_up = now < sim->outage_from_s || now >= sim->outage_to_s;
+		size_t failed = 0;
+		for (size_t sent = 0; sent < config.batch_max && queue.count > failed; sent++) {
+			const uint32_t queued_at = pop(&queue);
+			UploadPacerAck(&pacer, link_up ? sim->ack_ms : 0, link_up);
+			if (!link_up) {
+				push(&queue, queued_at);
+				failed++;
+				continue;
+			}
+			const uint32_t latency = now - queued_at;
+			result.delivered++;
+			if (latency > result.max_latency_s)
+				result.max_latency_s = latency;
+			if (queued_at >= latency_after_s && latency > result.max_latency_after_s)
+				result.max_latency_after_s = latency;
+		}
+		if (queue.count == 0 && result.drained_at_s == 0)
+			result.drained_at_s = now;
+		result.last_interval_s = UploadPacerNextS(&pacer, queue.count, oldest_age(&queue, now));
+		next_upload = now + result.last_interval_s;
+	}
+	result.pacer = UploadPacerStats(&pacer);
+	return result;
+}
+
+static void report(const char* name, const sim_result_t* result) {
+	fprintf(stderr, "  %s: %u uploads, %u of %u delivered, %.1f per upload, max latency %u s, max backlog %u, %u objective misses\n",
+		name, result->uploads, result->delivered, result->queued, result->uploads > 0 ? (double)result->delivered / result->uploads : 0.0,
+		result->max_latency_s, result->max_backlog, result->pacer.slo_misses);
+}
+
+static void idle_link_stretches_to_the_ceiling(void) {
+	const sim_config_t sim = { .ack_ms = 800 };
+	const sim_result_t result = simulate(&sim, 6 * 3600, 0);
+	report("idle", &result);
+	CHECK_EQ(result.last_interval_s, config.max_interval_s);
+	CHECK(result.uploads <= 6 * 3600 / config.max_interval_s + 1);
+}
+
+static void steady_samples_meet_the_objective(void) {
+	const sim_config_t sim = { .sample_every_s = 60, .ack_ms = 800 };
+	const sim_result_t result = simulate(&sim, 24 * 3600, 0);
+	report("steady", &result);
+	CHECK(result.max_latency_s <= config.latency_slo_s);
+	CHECK_EQ(result.pacer.slo_misses, 0);
+	// every sample still waits for company, about one upload per objective rather than per sample
+	CHECK(result.uploads <= 24 * 3600 / (config.latency_slo_s - config.slack_s - config.min_interval_s) + 1);
+	CHECK(result.queued - result.delivered <= config.batch_max);
+}
+
+static void sparse_samples_meet_the_objective(void) {
+	// the deadband holds most samples back, one message every half hour
+	const sim_config_t sim = { .sample_every_s = 1800, .ack_ms = 800 };
+	const sim_result_t result = simulate(&sim, 24 * 3600, 0);
+	report("sparse", &result);
+	CHECK(result.max_latency_s <= config.latency_slo_s);
+	CHECK_EQ(result.pacer.slo_misses, 0);
+	CHECK(result.uploads <= 2 * 24 + 1);
+}
+
+static void outage_backlog_drains_and_recovers(void) {
+	// two hours without a link, sends fail and are requeued with their age
+	const sim_config_t sim = { .sample_every_s = 60, .ack_ms = 800, .outage_from_s = 2 * 3600, .outage_to_s = 4 * 3600 };
+	const sim_result_t result = simulate(&sim, 12 * 3600, 6 * 3600);
+	report("outage", &result);
+	CHECK(result.max_backlog >= 2 * 3600 / sim.sample_every_s);
+	CHECK(result.pacer.failures > 0);
+	// the requeued messages kept their age, the wait is counted as a miss and not hidden
+	CHECK(result.max_latency_s >= sim.outage_to_s - sim.outage_from_s);
+	CHECK(result.pacer.slo_misses > 0);
+	// nothing lost, and once drained the objective holds again
+	CHECK(result.queued - result.delivered <= config.batch_max);
+	CHECK(result.max_latency_after_s <= config.latency_slo_s);
+}
+
+static void slow_acks_send_fewer_larger_batches(void) {
+	const sim_config_t fast = { .ack_ms = 800, .preload = 320 };
+	const sim_config_t slow = { .ack_ms = 12000, .preload = 320 };
+	const sim_result_t fast_result = simulate(&fast, 6 * 3600, 0);
+	const sim_result_t slow_result = simulate(&slow, 6 * 3600, 0);
+	report("drain fast", &fast_result);
+	report("drain slow", &slow_result);
+	CHECK_EQ(fast_result.delivered, 320);
+	CHECK_EQ(slow_result.delivered, 320);
+	// 20 batches at min_interval_s, or stretched by the slow acks
+	CHECK(fast_result.drained_at_s <= 20 * (config.min_interval_s + config.slack_s));
+	CHECK(slow_result.drained_at_s >= 2 * fast_result.drained_at_s);
+}
+
+int main(void) {
+	RUN_TEST(idle_link_stretches_to_the_ceiling);
+	RUN_TEST(steady_samples_meet_the_objective);
+	RUN_TEST(sparse_samples_meet_the_objective);
+	RUN_TEST(outage_backlog_drains_and_recovers);
+	RUN_TEST(slow_acks_send_fewer_larger_batches);
+	return TEST_EXIT();
+}